@@ -0,0 +1,208 @@
+//
+//  BatchFetchBench.cpp
+//  Benchmarks
+//
+//  Times drawing the same vertices from a GLBatch (a buffer object per
+//  attribute) and from a GLInterleavedBatch (one interleaved buffer):
+//
+//      floor   the demo's floor, a four vertex fan with positions and
+//              texture coordinates, drawn many times over
+//      large   a million points with positions, normals and texture
+//              coordinates, all beyond the far plane, so the time is the
+//              vertex fetch and shading rather than rasterizing
+//
+//  and the time to build and upload the large batch one vertex at a time
+//  through GLBatch, against generating it straight into a GLVertexBuilder.
+//
+//  Needs a GL context, so it opens a small GLUT window for one.
+//
+//  Build (from this directory, against a GLTools build for the host):
+//      c++ -O2 -std=gnu++14 -I../include -I../include/GL BatchFetchBench.cpp -L<GLTools> -lGLTools -lGLEW -lglut -lGL -o BatchFetchBench
+//
+#include "GLTools.h"
+#include "GLShaderManager.h"
+#include "GLInterleavedBatch.h"
+#include "GLVertexBuilder.h"
+#include "StopWatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#ifdef __APPLE__
+#include <glut/glut.h>
+#else
+#define FREEGLUT_STATIC
+#include <GL/glut.h>
+#endif
+
+#define FLOOR_DRAWS     20000
+#define LARGE_VERTS     (1024 * 1024)
+#define LARGE_DRAWS     20
+#define REPEATS         5
+
+static GLShaderManager  shaderManager;
+static M3DMatrix44f     mIdentity;
+static GLfloat          vWhite[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+static GLfloat          vLightPos[] = { 3.0f, 0.0f, 3.0f };
+
+template <class Batch> static void BuildFloor(Batch& batch)
+{
+    batch.Begin(GL_TRIANGLE_FAN, 4, 1);
+    batch.MultiTexCoord2f(0, 0.0f, 0.0f);
+    batch.Vertex3f(-0.5f, -0.5f, 0.0f);
+    batch.MultiTexCoord2f(0, 10.0f, 0.0f);
+    batch.Vertex3f(0.5f, -0.5f, 0.0f);
+    batch.MultiTexCoord2f(0, 10.0f, 10.0f);
+    batch.Vertex3f(0.5f, 0.5f, 0.0f);
+    batch.MultiTexCoord2f(0, 0.0f, 10.0f);
+    batch.Vertex3f(-0.5f, 0.5f, 0.0f);
+    batch.End();
+}
+
+template <class Batch> static void BuildLarge(Batch& batch, std::vector<GLfloat>& vVerts, std::vector<GLfloat>& vNorms,
+                                              std::vector<GLfloat>& vTexCoords)
+{
+    batch.Begin(GL_POINTS, LARGE_VERTS, 1);
+    batch.CopyVertexData3f(&vVerts[0]);
+    batch.CopyNormalDataf(&vNorms[0]);
+    batch.CopyTexCoordData2f(&vTexCoords[0], 0);
+    batch.End();
+}
+
+// Best of REPEATS, in nanoseconds per vertex
+static double TimeDraws(GLBatchBase& batch, int nDraws, int nVerts, bool bLit)
+{
+    if(bLit)
+        shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, mIdentity, mIdentity, vLightPos, vWhite, 0);
+    else
+        shaderManager.UseStockShader(GLT_SHADER_TEXTURE_MODULATE, mIdentity, vWhite, 0);
+
+    // Once untimed, for the driver to settle the buffers
+    batch.Draw();
+    glFinish();
+
+    double fBest = 0.0;
+    for(int r = 0; r < REPEATS; r++) {
+        CStopWatch timer;
+        for(int d = 0; d < nDraws; d++)
+            batch.Draw();
+        glFinish();
+        double fElapsed = timer.GetElapsedSeconds();
+        if(r == 0 || fElapsed < fBest)
+            fBest = fElapsed;
+        }
+    return fBest * 1e9 / (double(nDraws) * nVerts);
+}
+
+// The large batch's points, generated as the test goes
+static inline void LargeVertex(int i, GLfloat *pVert, GLfloat *pNorm, GLfloat *pTexCoord)
+{
+    m3dLoadVector3(pVert, float(i & 1023) / 1024.0f - 0.5f, float(i >> 10) / 1024.0f - 0.5f, 2.0f);
+    m3dLoadVector3(pNorm, 0.0f, 0.0f, 1.0f);
+    m3dLoadVector2(pTexCoord, float(i & 1023) / 1024.0f, float(i >> 10) / 1024.0f);
+}
+
+// Best of REPEATS, in nanoseconds per vertex, to build and upload the large
+// batch with GLBatch's immediate mode calls
+static double TimeBuildImmediate(void)
+{
+    double fBest = 0.0;
+    for(int r = 0; r < REPEATS; r++) {
+        GLBatch batch;
+        CStopWatch timer;
+        batch.Begin(GL_POINTS, LARGE_VERTS, 1);
+        for(int i = 0; i < LARGE_VERTS; i++) {
+            M3DVector3f vVert, vNorm;
+            M3DVector2f vTexCoord;
+            LargeVertex(i, vVert, vNorm, vTexCoord);
+            batch.Normal3fv(vNorm);
+            batch.MultiTexCoord2fv(0, vTexCoord);
+            batch.Vertex3fv(vVert);
+        }
+        batch.End();
+        glFinish();
+        double fElapsed = timer.GetElapsedSeconds();
+        if(r == 0 || fElapsed < fBest)
+            fBest = fElapsed;
+    }
+    return fBest * 1e9 / LARGE_VERTS;
+}
+
+// The same through a GLVertexBuilder, written in place
+static double TimeBuildBuilder(void)
+{
+    GLVertexBuilder builder;
+    double fBest = 0.0;
+    for(int r = 0; r < REPEATS; r++) {
+        GLInterleavedBatch batch;
+        CStopWatch timer;
+        builder.Reserve(LARGE_VERTS, true, false, 1);
+        GLfloat *pVerts = builder.Positions().Extend(LARGE_VERTS);
+        GLfloat *pNorms = builder.Normals().Extend(LARGE_VERTS);
+        GLfloat *pTexCoords = builder.TexCoords(0).Extend(LARGE_VERTS);
+        for(int i = 0; i < LARGE_VERTS; i++)
+            LargeVertex(i, pVerts + i * 3, pNorms + i * 3, pTexCoords + i * 2);
+        builder.End(batch, GL_POINTS);
+        glFinish();
+        double fElapsed = timer.GetElapsedSeconds();
+        if(r == 0 || fElapsed < fBest)
+            fBest = fElapsed;
+    }
+    return fBest * 1e9 / LARGE_VERTS;
+}
+
+static void Report(const char *szName, double fSeparate, double fInterleaved)
+{
+    printf("%-8s GLBatch %8.3f ns/vertex   GLInterleavedBatch %8.3f ns/vertex   (%.2fx)\n",
+           szName, fSeparate, fInterleaved, fSeparate / fInterleaved);
+}
+
+int main(int argc, char *argv[])
+{
+    gltSetWorkingDirectory(argv[0]);
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("BatchFetchBench");
+
+    GLenum err = glewInit();
+    if(GLEW_OK != err) {
+        fprintf(stderr, "glew error:%s\n", glewGetErrorString(err));
+        return 1;
+    }
+
+    shaderManager.InitializeStockShaders();
+    m3dLoadIdentity44(mIdentity);
+    glDisable(GL_DEPTH_TEST);
+    glViewport(0, 0, 64, 64);
+
+    GLBatch floorSeparate;
+    GLInterleavedBatch floorInterleaved;
+    BuildFloor(floorSeparate);
+    BuildFloor(floorInterleaved);
+    double fSeparate = TimeDraws(floorSeparate, FLOOR_DRAWS, 4, false);
+    double fInterleaved = TimeDraws(floorInterleaved, FLOOR_DRAWS, 4, false);
+    Report("floor", fSeparate, fInterleaved);
+
+    // Points past the far plane (z > 1 with an identity projection)
+    std::vector<GLfloat> vVerts(LARGE_VERTS * 3), vNorms(LARGE_VERTS * 3), vTexCoords(LARGE_VERTS * 2);
+    for(int i = 0; i < LARGE_VERTS; i++) {
+        m3dLoadVector3(&vVerts[i * 3], float(rand()) / RAND_MAX - 0.5f, float(rand()) / RAND_MAX - 0.5f, 2.0f);
+        m3dLoadVector3(&vNorms[i * 3], 0.0f, 0.0f, 1.0f);
+        m3dLoadVector2(&vTexCoords[i * 2], float(i & 1023) / 1024.0f, float(i >> 10) / 1024.0f);
+    }
+
+    GLBatch largeSeparate;
+    GLInterleavedBatch largeInterleaved;
+    BuildLarge(largeSeparate, vVerts, vNorms, vTexCoords);
+    BuildLarge(largeInterleaved, vVerts, vNorms, vTexCoords);
+    fSeparate = TimeDraws(largeSeparate, LARGE_DRAWS, LARGE_VERTS, true);
+    fInterleaved = TimeDraws(largeInterleaved, LARGE_DRAWS, LARGE_VERTS, true);
+    Report("large", fSeparate, fInterleaved);
+
+    double fImmediate = TimeBuildImmediate();
+    double fBuilder = TimeBuildBuilder();
+    printf("%-8s GLBatch %8.3f ns/vertex   GLVertexBuilder    %8.3f ns/vertex   (%.2fx)\n",
+           "build", fImmediate, fBuilder, fImmediate / fBuilder);
+
+    return 0;
+}
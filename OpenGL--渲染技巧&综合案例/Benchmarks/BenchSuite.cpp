@@ -0,0 +1,765 @@
+//
+//  BenchSuite.cpp
+//  Benchmarks
+//
+//  Times every public math3d.h routine (float and double forms), the
+//  GLMatrixStack operations, GLFrame rotations, GLFrustum::TestSphere and the
+//  TGA/BMP loaders, and reports ns/op. Results can be written as JSON and
+//  compared against a stored JSON baseline.
+//
+//  Build (from this directory, against a GLTools build for the host):
+//      c++ -O2 -std=gnu++14 -I../include -I../include/GL BenchSuite.cpp -L<GLTools> -lGLTools -lGLEW -lGL -o BenchSuite
+//
+//  Usage:
+//      BenchSuite [--filter <text>] [--json <out.json>] [--baseline <base.json>]
+//                 [--threshold <percent>] [--noise <ns>] [--min-time <ms>] [--repeats <n>]
+//                 [--data <dir>]
+//
+//  Each case runs for at least --min-time (default 50 ms) per repeat and the
+//  fastest of --repeats (default 5) is reported. With --baseline, any case
+//  more than --threshold percent (default 10) slower than the baseline is
+//  listed and the exit code is 1. Cases of a nanosecond or two jitter by more
+//  than that from run to run, so a slowdown must also be over --noise
+//  nanoseconds (default 0.5) to count.
+//
+#include "GLTools.h"
+#include "GLMatrixStack.h"
+#include "GLFrame.h"
+#include "GLFrustum.h"
+#include "GLGeometryTransform.h"
+#include "math3dSIMD.h"
+#include "math3dBatch.h"
+#include "math3dTrig.h"
+#include "GLSplinePath.h"
+#include "GLFrameArray.h"
+#include "GLSceneGraph.h"
+#include "GLBVH.h"
+#include "GLOcclusionBuffer.h"
+#include "GLLODSet.h"
+#include "GLVertexBuilder.h"
+#include "StopWatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Stops the compiler from folding the loop body away or hoisting it out of
+// the loop: everything in memory is assumed read and written each time.
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BENCH_CLOBBER()     _ReadWriteBarrier()
+#else
+#define BENCH_CLOBBER()     __asm__ __volatile__("" ::: "memory")
+#endif
+
+#define DATA_COUNT      256         // Power of two
+#define DATA_MASK       (DATA_COUNT - 1)
+
+typedef void (*BenchFunc)(int nIters);
+
+struct BenchCase
+{
+    const char  *szName;
+    BenchFunc   pRun;
+};
+
+struct BenchResult
+{
+    std::string name;
+    double      nsPerOp;
+};
+
+// A case is a name and a statement. The statement sees k, an index into the
+// data arrays that changes every iteration, and n, the next index along.
+#define BENCH_CASE(szName, ...) \
+    { szName, [](int nIters) { for(int i = 0; i < nIters; i++) { int k = i & DATA_MASK; int n = (i + 1) & DATA_MASK; (void)k; (void)n; __VA_ARGS__; BENCH_CLOBBER(); } } }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Inputs and outputs. Inputs are filled once with well behaved values (unit
+// axes, rotation matrices, points in front of the camera).
+static float            fScalar[DATA_COUNT];
+static double           dScalar[DATA_COUNT];
+static M3DVector2f      vf2[DATA_COUNT], vf2Out[DATA_COUNT];
+static M3DVector2d      vd2[DATA_COUNT], vd2Out[DATA_COUNT];
+static M3DVector3f      vf3[DATA_COUNT], vf3Out[DATA_COUNT], vf3Unit[DATA_COUNT];
+static M3DVector3d      vd3[DATA_COUNT], vd3Out[DATA_COUNT], vd3Unit[DATA_COUNT];
+static M3DVector4f      vf4[DATA_COUNT], vf4Out[DATA_COUNT];
+static M3DVector4d      vd4[DATA_COUNT], vd4Out[DATA_COUNT];
+static M3DMatrix33f     mf33[DATA_COUNT], mf33Out[DATA_COUNT];
+static M3DMatrix33d     md33[DATA_COUNT], md33Out[DATA_COUNT];
+static M3DMatrix44f     mf44[DATA_COUNT], mf44Out[DATA_COUNT];
+static M3DMatrix44d     md44[DATA_COUNT], md44Out[DATA_COUNT];
+static M3DVector3f      vfTriangle[DATA_COUNT][3];
+static M3DVector2f      vfTexCoords[DATA_COUNT][3];
+static M3DQuaternionf   qf[DATA_COUNT];
+// Results land in the sinks. They are all read back into a checksum after
+// the run (SinkChecksum), or the compiler would drop the stores, and with
+// them the work of cases that are inlined.
+static float            fSink[DATA_COUNT], fSink2[DATA_COUNT], fSink3[DATA_COUNT];
+static double           dSink[DATA_COUNT];
+static unsigned int     uSink[DATA_COUNT];
+static bool             bSink[DATA_COUNT];
+static int              iViewport[4] = { 0, 0, 800, 600 };
+static float            fBoundsX[DATA_COUNT], fBoundsY[DATA_COUNT], fBoundsZ[DATA_COUNT], fBoundsR[DATA_COUNT];
+static float            fBoundsMin[3][DATA_COUNT], fBoundsMax[3][DATA_COUNT];
+static unsigned char    uPlaneCache[DATA_COUNT];
+
+static GLMatrixStack    matrixStack;
+static GLMatrixStack    projectionStack;
+static GLGeometryTransform transformPipeline;
+static GLFrame          frames[DATA_COUNT];
+static GLFrame          quatFrames[DATA_COUNT];
+static GLFrustum        frustumScratch;     // For the cases that set planes
+static GLSplinePath     splinePath;
+static GLFrameArray     frameArray;
+static GLSceneGraph     sceneGraph;
+static GLBVH            bvh;
+static GLuint           uBVHVisible[4096 / 32];
+static GLOcclusionBuffer occlusionBuffer;
+static M3DMatrix44f     mOcclusionViewProj;
+static M3DVector3f      vf3Wall[33 * 33];
+static GLushort         usWallIndexes[32 * 32 * 6];
+static M3DVector3f      vf3SphereVerts[51 * 101], vf3SphereNorms[51 * 101];
+static M3DVector2f      vf2SphereTexCoords[51 * 101];
+static GLushort         usSphereIndexes[50 * 100 * 6];
+static std::vector<GLfloat> vSimpleVerts, vSimpleNorms, vSimpleTexCoords;
+static std::vector<GLushort> vSimpleIndexes;
+static GLVertexBuilder  vertexBuilder;
+static GLfloat          fInterleaved[51 * 101 * 8];
+
+static std::string      strTGAFile = "../OpenGL/moonLike.tga";
+static std::string      strBMPFile = "../OpenGL/earth.bmp";
+
+// The culling cases all test against this one fixed view, so what they find
+// visible doesn't depend on which cases ran before them or for how long
+static GLFrame CullCamera(void)
+{
+    GLFrame camera;
+    camera.MoveForward(-5.0f);
+    return camera;
+}
+
+static GLFrustum CullFrustum(void)
+{
+    GLFrustum cull(35.0f, 4.0f / 3.0f, 1.0f, 100.0f);
+    GLFrame camera = CullCamera();
+    cull.Transform(camera);
+    return cull;
+}
+
+static const GLFrustum  cullFrustum = CullFrustum();
+
+
+static float RandomFloat(float fMin, float fMax)
+{
+    return fMin + (fMax - fMin) * float(rand()) / float(RAND_MAX);
+}
+
+static void SetupData(void)
+{
+    srand(1234);
+
+    for(int i = 0; i < DATA_COUNT; i++) {
+        fScalar[i] = RandomFloat(-4.0f, 4.0f);
+        dScalar[i] = fScalar[i];
+
+        for(int j = 0; j < 4; j++) {
+            float f = RandomFloat(-10.0f, 10.0f);
+            if(j < 2) { vf2[i][j] = f; vd2[i][j] = f; }
+            if(j < 3) { vf3[i][j] = f; vd3[i][j] = f; }
+            vf4[i][j] = f; vd4[i][j] = f;
+            }
+        vf4[i][3] = 1.0f; vd4[i][3] = 1.0;
+
+        m3dCopyVector3(vf3Unit[i], vf3[i]);
+        m3dNormalizeVector3(vf3Unit[i]);
+        m3dCopyVector3(vd3Unit[i], vd3[i]);
+        m3dNormalizeVector3(vd3Unit[i]);
+
+        // Rigid body matrices, the common case
+        float fAngle = RandomFloat(0.0f, 6.0f);
+        m3dRotationMatrix44(mf44[i], fAngle, vf3Unit[i][0], vf3Unit[i][1], vf3Unit[i][2]);
+        mf44[i][12] = vf3[i][0]; mf44[i][13] = vf3[i][1]; mf44[i][14] = vf3[i][2];
+        m3dRotationMatrix33(mf33[i], fAngle, vf3Unit[i][0], vf3Unit[i][1], vf3Unit[i][2]);
+        for(int j = 0; j < 16; j++) md44[i][j] = mf44[i][j];
+        for(int j = 0; j < 9; j++) md33[i][j] = mf33[i][j];
+
+        for(int j = 0; j < 3; j++) {
+            vfTriangle[i][j][0] = RandomFloat(-1.0f, 1.0f);
+            vfTriangle[i][j][1] = RandomFloat(-1.0f, 1.0f);
+            vfTriangle[i][j][2] = 0.0f;
+            vfTexCoords[i][j][0] = vfTriangle[i][j][0] * 0.5f + 0.5f;
+            vfTexCoords[i][j][1] = vfTriangle[i][j][1] * 0.5f + 0.5f;
+            }
+
+        m3dQuatFromAxisAngle(qf[i], fAngle, vf3Unit[i][0], vf3Unit[i][1], vf3Unit[i][2]);
+
+        frames[i].SetOrigin(vf3[i]);
+        frames[i].RotateWorld(fAngle, vf3Unit[i][0], vf3Unit[i][1], vf3Unit[i][2]);
+        quatFrames[i] = frames[i];
+        quatFrames[i].SetQuaternionMode(true);
+        }
+
+    // Culling bounds, spheres and boxes around the points
+    for(int i = 0; i < DATA_COUNT; i++) {
+        fBoundsX[i] = vf3[i][0]; fBoundsY[i] = vf3[i][1]; fBoundsZ[i] = vf3[i][2];
+        fBoundsR[i] = 0.5f;
+        for(int j = 0; j < 3; j++) {
+            fBoundsMin[j][i] = vf3[i][j] - 0.5f;
+            fBoundsMax[j][i] = vf3[i][j] + 0.5f;
+            }
+        uPlaneCache[i] = GLT_FRUSTUM_NO_PLANE;
+        }
+
+    // 4096 spheres scattered around the camera
+    for(int i = 0; i < 4096; i++) {
+        M3DVector3f vCenter = { RandomFloat(-50.0f, 50.0f), RandomFloat(-50.0f, 50.0f), RandomFloat(-100.0f, 20.0f) };
+        bvh.AddSphere(vCenter, RandomFloat(0.1f, 1.0f));
+        }
+    bvh.Build();
+
+    splinePath.SetPoints(vf3, 16, true);
+    for(int i = 0; i < DATA_COUNT; i++)
+        frameArray.Add(frames[i]);
+
+    // 64 binary trees of 63 nodes
+    for(int t = 0; t < 64; t++) {
+        int iFirst = sceneGraph.GetNodeCount();
+        for(int i = 0; i < 63; i++) {
+            int iNode = sceneGraph.AddNode((i == 0) ? -1 : iFirst + (i - 1) / 2);
+            sceneGraph.GetFrame(iNode) = frames[(t * 63 + i) % DATA_COUNT];
+            }
+        }
+    sceneGraph.Update();
+
+    projectionStack.LoadMatrix(mf44[0]);
+    transformPipeline.SetMatrixStacks(matrixStack, projectionStack);
+
+    // A wall of 2048 triangles across the cull view, with the BVH spheres
+    // scattered in front of and behind it
+    M3DMatrix44f mCamera;
+    CullCamera().GetCameraMatrix(mCamera);
+    m3dMatrixMultiply44(mOcclusionViewProj, cullFrustum.GetProjectionMatrix(), mCamera);
+    for(int y = 0; y <= 32; y++)
+        for(int x = 0; x <= 32; x++)
+            m3dLoadVector3(vf3Wall[y * 33 + x], float(x) * 1.25f - 20.0f, float(y) * 1.25f - 20.0f, -20.0f);
+    for(int y = 0, i = 0; y < 32; y++)
+        for(int x = 0; x < 32; x++, i += 6) {
+            GLushort v = GLushort(y * 33 + x);
+            usWallIndexes[i] = v; usWallIndexes[i + 1] = v + 1; usWallIndexes[i + 2] = v + 34;
+            usWallIndexes[i + 3] = v; usWallIndexes[i + 4] = v + 34; usWallIndexes[i + 5] = v + 33;
+            }
+    occlusionBuffer.Begin(mOcclusionViewProj);
+    occlusionBuffer.AddOccluder(vf3Wall, 33 * 33, usWallIndexes, 32 * 32 * 6);
+    occlusionBuffer.End();
+
+    // A sphere as tessellated as the demo's earth, 10000 triangles
+    for(int y = 0; y <= 100; y++)
+        for(int x = 0; x <= 50; x++) {
+            float fTheta = M3D_PI * float(y) / 100.0f, fPhi = 2.0f * M3D_PI * float(x) / 50.0f;
+            int i = y * 51 + x;
+            m3dLoadVector3(vf3SphereNorms[i], sinf(fTheta) * cosf(fPhi), sinf(fTheta) * sinf(fPhi), cosf(fTheta));
+            m3dCopyVector3(vf3SphereVerts[i], vf3SphereNorms[i]);
+            m3dScaleVector3(vf3SphereVerts[i], 0.5f);
+            m3dLoadVector2(vf2SphereTexCoords[i], float(x) / 50.0f, float(y) / 100.0f);
+            }
+    for(int y = 0, i = 0; y < 100; y++)
+        for(int x = 0; x < 50; x++, i += 6) {
+            GLushort v = GLushort(y * 51 + x);
+            usSphereIndexes[i] = v; usSphereIndexes[i + 1] = v + 51; usSphereIndexes[i + 2] = v + 1;
+            usSphereIndexes[i + 3] = v + 1; usSphereIndexes[i + 4] = v + 51; usSphereIndexes[i + 5] = v + 52;
+            }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+static const BenchCase benchCases[] = {
+    // Vector load, copy, arithmetic
+    BENCH_CASE("m3dLoadVector2/f", m3dLoadVector2(vf2Out[k], fScalar[k], fScalar[n])),
+    BENCH_CASE("m3dLoadVector2/d", m3dLoadVector2(vd2Out[k], fScalar[k], fScalar[n])),
+    BENCH_CASE("m3dLoadVector3/f", m3dLoadVector3(vf3Out[k], fScalar[k], fScalar[n], 1.0f)),
+    BENCH_CASE("m3dLoadVector3/d", m3dLoadVector3(vd3Out[k], dScalar[k], dScalar[n], 1.0)),
+    BENCH_CASE("m3dLoadVector4/f", m3dLoadVector4(vf4Out[k], fScalar[k], fScalar[n], 1.0f, 1.0f)),
+    BENCH_CASE("m3dLoadVector4/d", m3dLoadVector4(vd4Out[k], dScalar[k], dScalar[n], 1.0, 1.0)),
+    BENCH_CASE("m3dCopyVector2/f", m3dCopyVector2(vf2Out[k], vf2[n])),
+    BENCH_CASE("m3dCopyVector2/d", m3dCopyVector2(vd2Out[k], vd2[n])),
+    BENCH_CASE("m3dCopyVector3/f", m3dCopyVector3(vf3Out[k], vf3[n])),
+    BENCH_CASE("m3dCopyVector3/d", m3dCopyVector3(vd3Out[k], vd3[n])),
+    BENCH_CASE("m3dCopyVector4/f", m3dCopyVector4(vf4Out[k], vf4[n])),
+    BENCH_CASE("m3dCopyVector4/d", m3dCopyVector4(vd4Out[k], vd4[n])),
+    BENCH_CASE("m3dAddVectors2/f", m3dAddVectors2(vf2Out[k], vf2[k], vf2[n])),
+    BENCH_CASE("m3dAddVectors2/d", m3dAddVectors2(vd2Out[k], vd2[k], vd2[n])),
+    BENCH_CASE("m3dAddVectors3/f", m3dAddVectors3(vf3Out[k], vf3[k], vf3[n])),
+    BENCH_CASE("m3dAddVectors3/d", m3dAddVectors3(vd3Out[k], vd3[k], vd3[n])),
+    BENCH_CASE("m3dAddVectors4/f", m3dAddVectors4(vf4Out[k], vf4[k], vf4[n])),
+    BENCH_CASE("m3dAddVectors4/d", m3dAddVectors4(vd4Out[k], vd4[k], vd4[n])),
+    BENCH_CASE("m3dSubtractVectors2/f", m3dSubtractVectors2(vf2Out[k], vf2[k], vf2[n])),
+    BENCH_CASE("m3dSubtractVectors2/d", m3dSubtractVectors2(vd2Out[k], vd2[k], vd2[n])),
+    BENCH_CASE("m3dSubtractVectors3/f", m3dSubtractVectors3(vf3Out[k], vf3[k], vf3[n])),
+    BENCH_CASE("m3dSubtractVectors3/d", m3dSubtractVectors3(vd3Out[k], vd3[k], vd3[n])),
+    BENCH_CASE("m3dSubtractVectors4/f", m3dSubtractVectors4(vf4Out[k], vf4[k], vf4[n])),
+    BENCH_CASE("m3dSubtractVectors4/d", m3dSubtractVectors4(vd4Out[k], vd4[k], vd4[n])),
+    BENCH_CASE("m3dScaleVector2/f", m3dCopyVector2(vf2Out[k], vf2[k]); m3dScaleVector2(vf2Out[k], fScalar[n])),
+    BENCH_CASE("m3dScaleVector2/d", m3dCopyVector2(vd2Out[k], vd2[k]); m3dScaleVector2(vd2Out[k], dScalar[n])),
+    BENCH_CASE("m3dScaleVector3/f", m3dCopyVector3(vf3Out[k], vf3[k]); m3dScaleVector3(vf3Out[k], fScalar[n])),
+    BENCH_CASE("m3dScaleVector3/d", m3dCopyVector3(vd3Out[k], vd3[k]); m3dScaleVector3(vd3Out[k], dScalar[n])),
+    BENCH_CASE("m3dScaleVector4/f", m3dCopyVector4(vf4Out[k], vf4[k]); m3dScaleVector4(vf4Out[k], fScalar[n])),
+    BENCH_CASE("m3dScaleVector4/d", m3dCopyVector4(vd4Out[k], vd4[k]); m3dScaleVector4(vd4Out[k], dScalar[n])),
+    BENCH_CASE("m3dCrossProduct3/f", m3dCrossProduct3(vf3Out[k], vf3[k], vf3[n])),
+    BENCH_CASE("m3dCrossProduct3/d", m3dCrossProduct3(vd3Out[k], vd3[k], vd3[n])),
+    BENCH_CASE("m3dDotProduct3/f", fSink[k] = m3dDotProduct3(vf3[k], vf3[n])),
+    BENCH_CASE("m3dDotProduct3/d", dSink[k] = m3dDotProduct3(vd3[k], vd3[n])),
+    BENCH_CASE("m3dGetAngleBetweenVectors3/f", fSink[k] = m3dGetAngleBetweenVectors3(vf3Unit[k], vf3Unit[n])),
+    BENCH_CASE("m3dGetAngleBetweenVectors3/d", dSink[k] = m3dGetAngleBetweenVectors3(vd3Unit[k], vd3Unit[n])),
+    BENCH_CASE("m3dGetVectorLengthSquared3/f", fSink[k] = m3dGetVectorLengthSquared3(vf3[k])),
+    BENCH_CASE("m3dGetVectorLengthSquared3/d", dSink[k] = m3dGetVectorLengthSquared3(vd3[k])),
+    BENCH_CASE("m3dGetVectorLength3/f", fSink[k] = m3dGetVectorLength3(vf3[k])),
+    BENCH_CASE("m3dGetVectorLength3/d", dSink[k] = m3dGetVectorLength3(vd3[k])),
+    BENCH_CASE("m3dNormalizeVector3/f", m3dCopyVector3(vf3Out[k], vf3[k]); m3dNormalizeVector3(vf3Out[k])),
+    BENCH_CASE("m3dNormalizeVector3/d", m3dCopyVector3(vd3Out[k], vd3[k]); m3dNormalizeVector3(vd3Out[k])),
+    BENCH_CASE("m3dGetDistanceSquared3/f", fSink[k] = m3dGetDistanceSquared3(vf3[k], vf3[n])),
+    BENCH_CASE("m3dGetDistanceSquared3/d", dSink[k] = m3dGetDistanceSquared3(vd3[k], vd3[n])),
+    BENCH_CASE("m3dGetDistance3/f", fSink[k] = m3dGetDistance3(vf3[k], vf3[n])),
+    BENCH_CASE("m3dGetDistance3/d", dSink[k] = m3dGetDistance3(vd3[k], vd3[n])),
+    BENCH_CASE("m3dGetMagnitudeSquared3/f", fSink[k] = m3dGetMagnitudeSquared3(vf3[k])),
+    BENCH_CASE("m3dGetMagnitudeSquared3/d", dSink[k] = m3dGetMagnitudeSquared3(vd3[k])),
+    BENCH_CASE("m3dGetMagnitude3/f", fSink[k] = m3dGetMagnitude3(vf3[k])),
+    BENCH_CASE("m3dGetMagnitude3/d", dSink[k] = m3dGetMagnitude3(vd3[k])),
+    BENCH_CASE("m3dCloseEnough/f", bSink[k] = m3dCloseEnough(fScalar[k], fScalar[n], 0.001f)),
+    BENCH_CASE("m3dCloseEnough/d", bSink[k] = m3dCloseEnough(dScalar[k], dScalar[n], 0.001)),
+    BENCH_CASE("m3dIsPOW2", uSink[k] = m3dIsPOW2(unsigned(i & 0xffff))),
+
+    // Matrix load, copy, columns
+    BENCH_CASE("m3dCopyMatrix33/f", m3dCopyMatrix33(mf33Out[k], mf33[n])),
+    BENCH_CASE("m3dCopyMatrix33/d", m3dCopyMatrix33(md33Out[k], md33[n])),
+    BENCH_CASE("m3dCopyMatrix44/f", m3dCopyMatrix44(mf44Out[k], mf44[n])),
+    BENCH_CASE("m3dCopyMatrix44/d", m3dCopyMatrix44(md44Out[k], md44[n])),
+    BENCH_CASE("m3dLoadIdentity33/f", m3dLoadIdentity33(mf33Out[k])),
+    BENCH_CASE("m3dLoadIdentity33/d", m3dLoadIdentity33(md33Out[k])),
+    BENCH_CASE("m3dLoadIdentity44/f", m3dLoadIdentity44(mf44Out[k])),
+    BENCH_CASE("m3dLoadIdentity44/d", m3dLoadIdentity44(md44Out[k])),
+    BENCH_CASE("m3dGetMatrixColumn33/f", m3dGetMatrixColumn33(vf3Out[k], mf33[n], k & 1)),
+    BENCH_CASE("m3dGetMatrixColumn33/d", m3dGetMatrixColumn33(vd3Out[k], md33[n], k & 1)),
+    BENCH_CASE("m3dSetMatrixColumn33/f", m3dSetMatrixColumn33(mf33Out[k], vf3[n], k & 1)),
+    BENCH_CASE("m3dSetMatrixColumn33/d", m3dSetMatrixColumn33(md33Out[k], vd3[n], k & 1)),
+    BENCH_CASE("m3dGetMatrixColumn44/f", m3dGetMatrixColumn44(vf4Out[k], mf44[n], k & 3)),
+    BENCH_CASE("m3dGetMatrixColumn44/d", m3dGetMatrixColumn44(vd4Out[k], md44[n], k & 3)),
+    BENCH_CASE("m3dSetMatrixColumn44/f", m3dSetMatrixColumn44(mf44Out[k], vf4[n], k & 3)),
+    BENCH_CASE("m3dSetMatrixColumn44/d", m3dSetMatrixColumn44(md44Out[k], vd4[n], k & 3)),
+    BENCH_CASE("m3dExtractRotationMatrix33/f", m3dExtractRotationMatrix33(mf33Out[k], mf44[n])),
+    BENCH_CASE("m3dExtractRotationMatrix33/d", m3dExtractRotationMatrix33(md33Out[k], md44[n])),
+    BENCH_CASE("m3dInjectRotationMatrix44/f", m3dInjectRotationMatrix44(mf44Out[k], mf33[n])),
+    BENCH_CASE("m3dInjectRotationMatrix44/d", m3dInjectRotationMatrix44(md44Out[k], md33[n])),
+
+    // Matrix math
+    BENCH_CASE("m3dMultiplyAffine44/f", m3dMultiplyAffine44(mf44Out[k], mf44[k], mf44[n])),
+    BENCH_CASE("m3dClassifyMatrix44/f", uSink[k] = m3dClassifyMatrix44(mf44[n])),
+    BENCH_CASE("m3dMatrixMultiply44/f", m3dMatrixMultiply44(mf44Out[k], mf44[k], mf44[n])),
+    BENCH_CASE("m3dMatrixMultiply44/d", m3dMatrixMultiply44(md44Out[k], md44[k], md44[n])),
+    BENCH_CASE("m3dMatrixMultiply33/f", m3dMatrixMultiply33(mf33Out[k], mf33[k], mf33[n])),
+    BENCH_CASE("m3dMatrixMultiply33/d", m3dMatrixMultiply33(md33Out[k], md33[k], md33[n])),
+    BENCH_CASE("m3dTransformVector3/f", m3dTransformVector3(vf3Out[k], vf3[n], mf44[k])),
+    BENCH_CASE("m3dTransformVector3/d", m3dTransformVector3(vd3Out[k], vd3[n], md44[k])),
+    BENCH_CASE("m3dTransformVector4/f", m3dTransformVector4(vf4Out[k], vf4[n], mf44[k])),
+    BENCH_CASE("m3dTransformVector4/d", m3dTransformVector4(vd4Out[k], vd4[n], md44[k])),
+    BENCH_CASE("m3dRotateVector/f", m3dRotateVector(vf3Out[k], vf3[n], mf33[k])),
+    BENCH_CASE("m3dRotateVector/d", m3dRotateVector(vd3Out[k], vd3[n], md33[k])),
+    BENCH_CASE("m3dScaleMatrix33/f", m3dScaleMatrix33(mf33Out[k], fScalar[k], fScalar[n], 2.0f)),
+    BENCH_CASE("m3dScaleMatrix33/d", m3dScaleMatrix33(md33Out[k], dScalar[k], dScalar[n], 2.0)),
+    BENCH_CASE("m3dScaleMatrix33/fv", m3dScaleMatrix33(mf33Out[k], vf3[n])),
+    BENCH_CASE("m3dScaleMatrix33/dv", m3dScaleMatrix33(md33Out[k], vd3[n])),
+    BENCH_CASE("m3dScaleMatrix44/f", m3dScaleMatrix44(mf44Out[k], fScalar[k], fScalar[n], 2.0f)),
+    BENCH_CASE("m3dScaleMatrix44/d", m3dScaleMatrix44(md44Out[k], dScalar[k], dScalar[n], 2.0)),
+    BENCH_CASE("m3dScaleMatrix44/fv", m3dScaleMatrix44(mf44Out[k], vf3[n])),
+    BENCH_CASE("m3dScaleMatrix44/dv", m3dScaleMatrix44(md44Out[k], vd3[n])),
+    BENCH_CASE("m3dTranslationMatrix44/f", m3dTranslationMatrix44(mf44Out[k], vf3[n][0], vf3[n][1], vf3[n][2])),
+    BENCH_CASE("m3dTranslationMatrix44/d", m3dTranslationMatrix44(md44Out[k], vd3[n][0], vd3[n][1], vd3[n][2])),
+    BENCH_CASE("m3dRotationMatrix33/f", m3dRotationMatrix33(mf33Out[k], fScalar[n], vf3[k][0], vf3[k][1], vf3[k][2])),
+    BENCH_CASE("m3dRotationMatrix33/d", m3dRotationMatrix33(md33Out[k], dScalar[n], vd3[k][0], vd3[k][1], vd3[k][2])),
+    BENCH_CASE("m3dRotationMatrix44/f", m3dRotationMatrix44(mf44Out[k], fScalar[n], vf3[k][0], vf3[k][1], vf3[k][2])),
+    BENCH_CASE("m3dRotationMatrix44/d", m3dRotationMatrix44(md44Out[k], dScalar[n], vd3[k][0], vd3[k][1], vd3[k][2])),
+    BENCH_CASE("m3dMakePerspectiveMatrix/f", m3dMakePerspectiveMatrix(mf44Out[k], 0.6f + 0.001f * float(k), 1.333f, 1.0f, 100.0f)),
+    BENCH_CASE("m3dMakeOrthographicMatrix/f", m3dMakeOrthographicMatrix(mf44Out[k], -1.0f, 1.0f, -1.0f, 1.0f, fScalar[k] - 10.0f, 10.0f)),
+    BENCH_CASE("m3dInvertMatrix44/f", m3dInvertMatrix44(mf44Out[k], mf44[n])),
+    BENCH_CASE("m3dInvertMatrix44/d", m3dInvertMatrix44(md44Out[k], md44[n])),
+    BENCH_CASE("m3dInvertRigid44/f", m3dInvertRigid44(mf44Out[k], mf44[n])),
+    BENCH_CASE("m3dInvertRigid44/d", m3dInvertRigid44(md44Out[k], md44[n])),
+    BENCH_CASE("m3dInvertAffine44/f", m3dInvertAffine44(mf44Out[k], mf44[n])),
+    BENCH_CASE("m3dInvertAffine44/d", m3dInvertAffine44(md44Out[k], md44[n])),
+    BENCH_CASE("m3dMakePlanarShadowMatrix/f", m3dMakePlanarShadowMatrix(mf44Out[k], vf4[n], vf3[k])),
+    BENCH_CASE("m3dMakePlanarShadowMatrix/d", m3dMakePlanarShadowMatrix(md44Out[k], vd4[n], vd3[k])),
+
+    // Geometry
+    BENCH_CASE("m3dFindNormal/f", m3dFindNormal(vf3Out[k], vfTriangle[k][0], vfTriangle[k][1], vfTriangle[k][2])),
+    BENCH_CASE("m3dFindNormal/d", m3dFindNormal(vd3Out[k], vd3[k], vd3[n], vd3Unit[k])),
+    BENCH_CASE("m3dGetDistanceToPlane/f", fSink[k] = m3dGetDistanceToPlane(vf3[k], vf4[n])),
+    BENCH_CASE("m3dGetDistanceToPlane/d", dSink[k] = m3dGetDistanceToPlane(vd3[k], vd4[n])),
+    BENCH_CASE("m3dGetPlaneEquation/f", m3dGetPlaneEquation(vf4Out[k], vfTriangle[k][0], vfTriangle[k][1], vfTriangle[k][2])),
+    BENCH_CASE("m3dGetPlaneEquation/d", m3dGetPlaneEquation(vd4Out[k], vd3[k], vd3[n], vd3Unit[k])),
+    BENCH_CASE("m3dRaySphereTest/f", fSink[k] = m3dRaySphereTest(vf3[k], vf3Unit[n], vf3[n], 3.0f)),
+    BENCH_CASE("m3dRaySphereTest/d", dSink[k] = m3dRaySphereTest(vd3[k], vd3Unit[n], vd3[n], 3.0)),
+    BENCH_CASE("m3dProjectXY/f", m3dProjectXY(vf2Out[k], mf44[k], mf44[n], iViewport, vf3[k])),
+    BENCH_CASE("m3dProjectXYZ/f", m3dProjectXYZ(vf3Out[k], mf44[k], mf44[n], iViewport, vf3[k])),
+    BENCH_CASE("m3dCatmullRom/f", m3dCatmullRom(vf3Out[k], vf3[k], vf3[n], vf3Unit[k], vf3Unit[n], 0.3f)),
+    BENCH_CASE("m3dCatmullRom/d", m3dCatmullRom(vd3Out[k], vd3[k], vd3[n], vd3Unit[k], vd3Unit[n], 0.3)),
+    BENCH_CASE("m3dCalculateTangentBasis/f", m3dCalculateTangentBasis(vf3Out[k], vfTriangle[k], vfTexCoords[k], vf3Unit[n])),
+    BENCH_CASE("m3dSmoothStep/f", fSink[k] = m3dSmoothStep(-2.0f, 2.0f, fScalar[k])),
+    BENCH_CASE("m3dSmoothStep/d", dSink[k] = m3dSmoothStep(-2.0, 2.0, dScalar[k])),
+    BENCH_CASE("m3dClosestPointOnRay/f", fSink[k] = m3dClosestPointOnRay(vf3Out[k], vf3[k], vf3Unit[n], vf3[n])),
+    BENCH_CASE("m3dClosestPointOnRay/d", dSink[k] = m3dClosestPointOnRay(vd3Out[k], vd3[k], vd3Unit[n], vd3[n])),
+
+    // SIMD, batch and trig extensions
+    BENCH_CASE("m3dSIMDMatrixMultiply44/f", m3dSIMDMatrixMultiply44(mf44Out[k], mf44[k], mf44[n])),
+    BENCH_CASE("m3dSIMDMatrixMultiply44/d", m3dSIMDMatrixMultiply44(md44Out[k], md44[k], md44[n])),
+    BENCH_CASE("m3dSIMDInvertMatrix44/f", m3dSIMDInvertMatrix44(mf44Out[k], mf44[n])),
+    BENCH_CASE("m3dTransformVectors3/x256", m3dTransformVectors3(vf3Out, vf3, DATA_COUNT, mf44[k])),
+    BENCH_CASE("m3dTransformVectors4/x256", m3dTransformVectors4(vf4Out, vf4, DATA_COUNT, mf44[k])),
+    BENCH_CASE("m3dProjectVectorsXYZ/x256", m3dProjectVectorsXYZ(vf3Out, mf44[k], mf44[n], iViewport, vf3, DATA_COUNT)),
+    BENCH_CASE("m3dProjectVectorsXYZSoA/x256", m3dProjectVectorsXYZSoA(fSink, fSink2, fSink3, fBoundsX, fBoundsY, fBoundsZ, DATA_COUNT, mf44[k], iViewport)),
+    BENCH_CASE("m3dSinCos/precise", m3dSinCos(fScalar[k], &fSink[k], &fSink[n], M3D_SINCOS_PRECISE)),
+    BENCH_CASE("m3dSinCosv/precise/x256", m3dSinCosv(fSink, fSink2, fScalar, DATA_COUNT, M3D_SINCOS_PRECISE)),
+    BENCH_CASE("m3dSinCosv/fast/x256", m3dSinCosv(fSink, fSink2, fScalar, DATA_COUNT, M3D_SINCOS_FAST)),
+    BENCH_CASE("m3dRotationMatrices44/x256", m3dRotationMatrices44(mf44Out, fScalar, vf3, DATA_COUNT)),
+    BENCH_CASE("m3dQuatMultiply/f", m3dQuatMultiply(vf4Out[k], qf[k], qf[n])),
+    BENCH_CASE("m3dQuatSlerp/f", m3dQuatSlerp(vf4Out[k], qf[k], qf[n], 0.3f)),
+    BENCH_CASE("GLSplinePath::GetPoint", splinePath.GetPoint(vf3Out[k], float(k) * 0.0625f)),
+    BENCH_CASE("GLSplinePath::Sample/x256", splinePath.Sample(vf3Out, DATA_COUNT)),
+    BENCH_CASE("GLSplinePath::SampleArcLength/x256", splinePath.SampleArcLength(vf3Out, DATA_COUNT)),
+
+    // GLMatrixStack. Scale alternates 2 and 0.5 so the top stays finite.
+    BENCH_CASE("GLMatrixStack::LoadIdentity", matrixStack.LoadIdentity()),
+    BENCH_CASE("GLMatrixStack::LoadMatrix", matrixStack.LoadMatrix(mf44[k])),
+    BENCH_CASE("GLMatrixStack::MultMatrix", matrixStack.LoadMatrix(mf44[k]); matrixStack.MultMatrix(mf44[n])),
+    BENCH_CASE("GLMatrixStack::MultMatrix/rigid", matrixStack.LoadMatrix(mf44[k], M3D_MATRIX_RIGID); matrixStack.MultMatrix(mf44[n], M3D_MATRIX_RIGID)),
+    BENCH_CASE("GLMatrixStack::MultMatrix/projective", matrixStack.LoadMatrix(mf44[k], M3D_MATRIX_PROJECTIVE); matrixStack.MultMatrix(mf44[n], M3D_MATRIX_PROJECTIVE)),
+    BENCH_CASE("GLMatrixStack::MultMatrix(GLFrame)", matrixStack.LoadMatrix(mf44[k]); matrixStack.MultMatrix(frames[n])),
+    BENCH_CASE("GLMatrixStack::PushPopMatrix", matrixStack.PushMatrix(); matrixStack.PopMatrix()),
+    BENCH_CASE("GLMatrixStack::PushMatrix(GLFrame)", matrixStack.PushMatrix(frames[k]); matrixStack.PopMatrix()),
+    BENCH_CASE("GLMatrixStack::Translate", matrixStack.LoadMatrix(mf44[k]); matrixStack.Translate(vf3[n][0], vf3[n][1], vf3[n][2])),
+    BENCH_CASE("GLMatrixStack::Translatev", matrixStack.LoadMatrix(mf44[k]); matrixStack.Translatev(vf3[n])),
+    BENCH_CASE("GLMatrixStack::Scale", matrixStack.LoadMatrix(mf44[k]); matrixStack.Scale(2.0f, 0.5f, 2.0f)),
+    BENCH_CASE("GLMatrixStack::Scalev", matrixStack.LoadMatrix(mf44[k]); matrixStack.Scalev(vf3Unit[n])),
+    BENCH_CASE("GLMatrixStack::Rotate", matrixStack.LoadMatrix(mf44[k]); matrixStack.Rotate(fScalar[n] * 30.0f, 0.0f, 1.0f, 0.0f)),
+    BENCH_CASE("GLMatrixStack::Rotatev", matrixStack.LoadMatrix(mf44[k]); matrixStack.Rotatev(fScalar[n] * 30.0f, vf3Unit[k])),
+    BENCH_CASE("GLMatrixStack::GetMatrix", matrixStack.GetMatrix(mf44Out[k])),
+
+    // GLGeometryTransform. Cached: nothing changed since the last call.
+    BENCH_CASE("GLGeometryTransform::GetModelViewProjectionMatrix", matrixStack.LoadMatrix(mf44[k]); fSink[k] = transformPipeline.GetModelViewProjectionMatrix()[0]),
+    BENCH_CASE("GLGeometryTransform::GetModelViewProjectionMatrix/cached", fSink[k] = transformPipeline.GetModelViewProjectionMatrix()[0]),
+    BENCH_CASE("GLGeometryTransform::GetNormalMatrix", matrixStack.LoadMatrix(mf44[k]); fSink[k] = transformPipeline.GetNormalMatrix()[0]),
+    BENCH_CASE("GLGeometryTransform::GetNormalMatrix/cached", fSink[k] = transformPipeline.GetNormalMatrix()[0]),
+
+    // GLFrame
+    BENCH_CASE("GLFrame::GetMatrix/x256", for(int j = 0; j < DATA_COUNT; j++) frames[j].GetMatrix(mf44Out[j])),
+    BENCH_CASE("GLFrameArray::GetMatrices/x256", frameArray.GetMatrices(mf44Out)),
+    BENCH_CASE("GLFrameArray::GetMatrices/view/x256", frameArray.GetMatrices(mf44Out, 0, -1, mf44[k])),
+    BENCH_CASE("GLFrameArray::RotateWorld/x256", frameArray.RotateWorld(0.01f, vf3Unit[n][0], vf3Unit[n][1], vf3Unit[n][2])),
+    BENCH_CASE("GLFrame::RotateWorld", frames[k].RotateWorld(0.01f, vf3Unit[n][0], vf3Unit[n][1], vf3Unit[n][2])),
+    BENCH_CASE("GLFrame::RotateLocal", frames[k].RotateLocal(0.01f, vf3Unit[n][0], vf3Unit[n][1], vf3Unit[n][2])),
+    BENCH_CASE("GLFrame::RotateLocalX", frames[k].RotateLocalX(0.01f)),
+    BENCH_CASE("GLFrame::RotateLocalY", frames[k].RotateLocalY(0.01f)),
+    BENCH_CASE("GLFrame::RotateLocalZ", frames[k].RotateLocalZ(0.01f)),
+    BENCH_CASE("GLFrame::RotateWorld/quat", quatFrames[k].RotateWorld(0.01f, vf3Unit[n][0], vf3Unit[n][1], vf3Unit[n][2])),
+    BENCH_CASE("GLFrame::RotateLocal/quat", quatFrames[k].RotateLocal(0.01f, vf3Unit[n][0], vf3Unit[n][1], vf3Unit[n][2])),
+    BENCH_CASE("GLFrame::RotateLocalX/quat", quatFrames[k].RotateLocalX(0.01f)),
+    BENCH_CASE("GLFrame::RotateLocalY/quat", quatFrames[k].RotateLocalY(0.01f)),
+    BENCH_CASE("GLFrame::RotateLocalZ/quat", quatFrames[k].RotateLocalZ(0.01f)),
+    BENCH_CASE("GLFrame::Normalize", frames[k].Normalize()),
+    BENCH_CASE("GLFrame::GetMatrix", frames[k].GetMatrix(mf44Out[k])),
+    BENCH_CASE("GLFrame::GetMatrix/moved", frames[k].MoveForward(0.0f); frames[k].GetMatrix(mf44Out[k])),
+    BENCH_CASE("GLFrame::GetMatrix/rotated", frames[k].RotateLocalY(0.0f); frames[k].GetMatrix(mf44Out[k])),
+    BENCH_CASE("GLFrame::TransformPoint", frames[k].TransformPoint(vf3[n], vf3Out[k])),
+    BENCH_CASE("GLFrame::GetCameraMatrix", frames[k].GetCameraMatrix(mf44Out[k])),
+    BENCH_CASE("GLFrame::LocalToWorld", frames[k].LocalToWorld(vf3[n], vf3Out[k])),
+    BENCH_CASE("GLFrame::WorldToLocal", frames[k].WorldToLocal(vf3[n], vf3Out[k])),
+    BENCH_CASE("GLFrame::Slerp", quatFrames[k].Slerp(frames[k], frames[n], 0.3f)),
+
+    // GLSceneGraph
+    BENCH_CASE("GLSceneGraph::Update/static/x4032", sceneGraph.Update()),
+    BENCH_CASE("GLSceneGraph::Update/leaf", sceneGraph.GetFrame(k * 63 % 4032 + 62).MoveForward(0.0f); sceneGraph.Update()),
+    BENCH_CASE("GLSceneGraph::Update/tree/x63", sceneGraph.GetFrame(k * 63 % 4032).MoveForward(0.0f); sceneGraph.Update()),
+
+    // GLFrustum
+    BENCH_CASE("GLFrustum::TestSphere", uSink[k] = cullFrustum.TestSphere(vf3[k], 1.0f)),
+    BENCH_CASE("GLFrustum::Transform", frustumScratch.Transform(frames[k])),
+    BENCH_CASE("GLFrustum::ExtractPlanes", frustumScratch.ExtractPlanes(mf44[k])),
+    BENCH_CASE("GLFrustum::ExtractPlanes/window", frustumScratch.ExtractPlanes(mf44[k], -1.0f, 1.0f, -1.0f, 0.0f)),
+    BENCH_CASE("GLFrustum::TestSpheres/x256", cullFrustum.TestSpheres(fBoundsX, fBoundsY, fBoundsZ, fBoundsR, DATA_COUNT, uSink)),
+    BENCH_CASE("GLFrustum::TestSpheres/cached/x256", cullFrustum.TestSpheres(fBoundsX, fBoundsY, fBoundsZ, fBoundsR, DATA_COUNT, uSink, GLT_FRUSTUM_ALL_PLANES, uPlaneCache)),
+    BENCH_CASE("GLFrustum::TestAABBs/x256", cullFrustum.TestAABBs(fBoundsMin[0], fBoundsMin[1], fBoundsMin[2], fBoundsMax[0], fBoundsMax[1], fBoundsMax[2], DATA_COUNT, uSink)),
+
+    // GLBVH
+    BENCH_CASE("GLBVH::Build/x4096", bvh.Build()),
+    BENCH_CASE("GLBVH::Cull/x4096", uSink[k] = bvh.Cull(cullFrustum, uBVHVisible)),
+    BENCH_CASE("GLBVH::Intersect/x4096", uSink[k] = bvh.Intersect(vf3[k], vf3Unit[n]).iIndex),
+
+    // GLOcclusionBuffer
+    BENCH_CASE("GLOcclusionBuffer::Rasterize/x2048", occlusionBuffer.Begin(mOcclusionViewProj); occlusionBuffer.AddOccluder(vf3Wall, 33 * 33, usWallIndexes, 32 * 32 * 6); occlusionBuffer.End()),
+    BENCH_CASE("GLOcclusionBuffer::TestAABB", uSink[k] = occlusionBuffer.TestAABB(bvh.GetObjectBounds(k * 16).vMin, bvh.GetObjectBounds(k * 16).vMax)),
+    BENCH_CASE("GLOcclusionBuffer::CullHidden/x4096", memset(uBVHVisible, 0xFF, sizeof(uBVHVisible)); uSink[k] = occlusionBuffer.CullHidden(bvh, uBVHVisible)),
+
+    // GLLODSet
+    BENCH_CASE("GLLODSet::ProjectedRadius", fSink[k] = GLLODSet::ProjectedRadius(mf44[k], 0.5f, mf44[n], 800.0f)),
+    BENCH_CASE("gltSimplifyMesh/x10000/grid16", gltSimplifyMesh(vSimpleVerts, vSimpleNorms, vSimpleTexCoords, vSimpleIndexes, vf3SphereVerts, vf3SphereNorms,
+                                                                vf2SphereTexCoords, 51 * 101, usSphereIndexes, 50 * 100 * 6, 16)),
+
+    // GLVertexBuilder, filling the sphere's vertices (the GL upload in End is not timed)
+    BENCH_CASE("GLVertexBuilder::Add/x5151", vertexBuilder.Clear();
+               for(int j = 0; j < 51 * 101; j++) {
+                   vertexBuilder.Positions().Add(vf3SphereVerts[j][0], vf3SphereVerts[j][1], vf3SphereVerts[j][2]);
+                   vertexBuilder.Normals().Add(vf3SphereNorms[j][0], vf3SphereNorms[j][1], vf3SphereNorms[j][2]);
+                   vertexBuilder.TexCoords(0).Add(vf2SphereTexCoords[j][0], vf2SphereTexCoords[j][1]);
+               }
+               uSink[k] = vertexBuilder.GetVertexCount()),
+    BENCH_CASE("GLVertexBuilder::Append/x5151", vertexBuilder.Clear();
+               vertexBuilder.Positions().Append(vf3SphereVerts[0], 51 * 101);
+               vertexBuilder.Normals().Append(vf3SphereNorms[0], 51 * 101);
+               vertexBuilder.TexCoords(0).Append(vf2SphereTexCoords[0], 51 * 101);
+               uSink[k] = vertexBuilder.GetVertexCount()),
+    BENCH_CASE("GLInterleavedBatch::Interleave/x5151", GLInterleavedBatch::Interleave(fInterleaved, 8, vf3SphereVerts[0], 3, 51 * 101);
+               GLInterleavedBatch::Interleave(fInterleaved + 3, 8, vf3SphereNorms[0], 3, 51 * 101);
+               GLInterleavedBatch::Interleave(fInterleaved + 6, 8, vf2SphereTexCoords[0], 2, 51 * 101)),
+
+    // GLBVH, last, as moving spheres about loosens the tree
+    BENCH_CASE("GLBVH::Refit/moved", bvh.MoveSphere(k * 16, vf3[n], 0.5f); bvh.Refit()),
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Image loaders, timed per file load
+static void BenchReadTGA(int nIters)
+{
+    for(int i = 0; i < nIters; i++) {
+        GLint iWidth, iHeight, iComponents;
+        GLenum eFormat;
+        GLbyte *pBits = gltReadTGABits(strTGAFile.c_str(), &iWidth, &iHeight, &iComponents, &eFormat);
+        free(pBits);
+        BENCH_CLOBBER();
+        }
+}
+
+static void BenchReadBMP(int nIters)
+{
+    for(int i = 0; i < nIters; i++) {
+        int iWidth, iHeight;
+        GLbyte *pBits = gltReadBMPBits(strBMPFile.c_str(), &iWidth, &iHeight);
+        free(pBits);
+        BENCH_CLOBBER();
+        }
+}
+
+static double SinkChecksum(void)
+{
+    double fSum = 0.0;
+    for(int i = 0; i < DATA_COUNT; i++)
+        fSum += double(fSink[i]) + fSink2[i] + fSink3[i] + dSink[i] + double(uSink[i]) + (bSink[i] ? 1.0 : 0.0);
+    return fSum;
+}
+
+static bool FileExists(const std::string& strFile)
+{
+    FILE *pFile = fopen(strFile.c_str(), "rb");
+    if(pFile == NULL)
+        return false;
+    fclose(pFile);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Grow the iteration count until one run takes fMinSeconds, then keep the
+// fastest of nRepeats runs at that count.
+static double TimeCase(BenchFunc pRun, float fMinSeconds, int nRepeats)
+{
+    CStopWatch timer;
+    int nIters = 16;
+    float fElapsed;
+
+    for(;;) {
+        timer.Reset();
+        pRun(nIters);
+        fElapsed = timer.GetElapsedSeconds();
+        if(fElapsed >= fMinSeconds || nIters >= (1 << 28))
+            break;
+
+        // Aim a little past the target so this usually takes one more pass
+        if(fElapsed <= 0.0f)
+            nIters *= 16;
+        else {
+            double fScale = 1.2 * fMinSeconds / fElapsed;
+            nIters = int(nIters * (fScale > 16.0 ? 16.0 : (fScale < 2.0 ? 2.0 : fScale)));
+            }
+        }
+
+    double fBest = fElapsed;
+    for(int r = 1; r < nRepeats; r++) {
+        timer.Reset();
+        pRun(nIters);
+        fElapsed = timer.GetElapsedSeconds();
+        if(fElapsed < fBest)
+            fBest = fElapsed;
+        }
+
+    return fBest * 1e9 / double(nIters);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// JSON in and out. The reader only understands what the writer produces:
+// "name": "...", "ns_per_op": <number> pairs.
+static void WriteJSON(const char *szFile, const std::vector<BenchResult>& results)
+{
+    FILE *pFile = fopen(szFile, "w");
+    if(pFile == NULL) {
+        fprintf(stderr, "Cannot write %s\n", szFile);
+        return;
+        }
+
+    fprintf(pFile, "{\n  \"simd_level\": \"%s\",\n  \"results\": [\n", m3dSIMDLevelName(m3dSIMDGetLevel()));
+    for(size_t i = 0; i < results.size(); i++)
+        fprintf(pFile, "    { \"name\": \"%s\", \"ns_per_op\": %.4f }%s\n", results[i].name.c_str(),
+                results[i].nsPerOp, (i + 1 < results.size()) ? "," : "");
+    fprintf(pFile, "  ]\n}\n");
+    fclose(pFile);
+}
+
+static bool ReadJSON(const char *szFile, std::vector<BenchResult>& results)
+{
+    FILE *pFile = fopen(szFile, "rb");
+    if(pFile == NULL)
+        return false;
+
+    std::string strText;
+    char szBuffer[4096];
+    size_t nRead;
+    while((nRead = fread(szBuffer, 1, sizeof(szBuffer), pFile)) > 0)
+        strText.append(szBuffer, nRead);
+    fclose(pFile);
+
+    size_t pos = 0;
+    while((pos = strText.find("\"name\"", pos)) != std::string::npos) {
+        size_t nameStart = strText.find('"', strText.find(':', pos)) + 1;
+        size_t nameEnd = strText.find('"', nameStart);
+        size_t valuePos = strText.find("\"ns_per_op\"", nameEnd);
+        if(nameEnd == std::string::npos || valuePos == std::string::npos)
+            break;
+
+        BenchResult result;
+        result.name = strText.substr(nameStart, nameEnd - nameStart);
+        result.nsPerOp = atof(strText.c_str() + strText.find(':', valuePos) + 1);
+        results.push_back(result);
+        pos = valuePos;
+        }
+
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *szFilter = NULL;
+    const char *szJSON = NULL;
+    const char *szBaseline = NULL;
+    double fThreshold = 10.0;
+    double fNoise = 0.5;
+    float fMinSeconds = 0.05f;
+    int nRepeats = 5;
+
+    for(int i = 1; i < argc; i++) {
+        bool bHasValue = (i + 1 < argc);
+        if(strcmp(argv[i], "--filter") == 0 && bHasValue)
+            szFilter = argv[++i];
+        else if(strcmp(argv[i], "--json") == 0 && bHasValue)
+            szJSON = argv[++i];
+        else if(strcmp(argv[i], "--baseline") == 0 && bHasValue)
+            szBaseline = argv[++i];
+        else if(strcmp(argv[i], "--threshold") == 0 && bHasValue)
+            fThreshold = atof(argv[++i]);
+        else if(strcmp(argv[i], "--noise") == 0 && bHasValue)
+            fNoise = atof(argv[++i]);
+        else if(strcmp(argv[i], "--min-time") == 0 && bHasValue)
+            fMinSeconds = float(atof(argv[++i]) / 1000.0);
+        else if(strcmp(argv[i], "--repeats") == 0 && bHasValue)
+            nRepeats = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--data") == 0 && bHasValue) {
+            std::string strDir = argv[++i];
+            strTGAFile = strDir + "/moonLike.tga";
+            strBMPFile = strDir + "/earth.bmp";
+            }
+        else {
+            fprintf(stderr, "Usage: %s [--filter <text>] [--json <out.json>] [--baseline <base.json>]\n"
+                            "       [--threshold <percent>] [--noise <ns>] [--min-time <ms>] [--repeats <n>]\n"
+                            "       [--data <dir>]\n", argv[0]);
+            return 2;
+            }
+        }
+
+    if(nRepeats < 1)
+        nRepeats = 1;
+
+    SetupData();
+
+    std::vector<BenchCase> cases(benchCases, benchCases + sizeof(benchCases) / sizeof(benchCases[0]));
+    if(FileExists(strTGAFile)) {
+        BenchCase tgaCase = { "gltReadTGABits", BenchReadTGA };
+        cases.push_back(tgaCase);
+        }
+    else
+        fprintf(stderr, "Skipping gltReadTGABits, %s not found (see --data)\n", strTGAFile.c_str());
+
+    if(FileExists(strBMPFile)) {
+        BenchCase bmpCase = { "gltReadBMPBits", BenchReadBMP };
+        cases.push_back(bmpCase);
+        }
+    else
+        fprintf(stderr, "Skipping gltReadBMPBits, %s not found (see --data)\n", strBMPFile.c_str());
+
+    std::vector<BenchResult> baseline;
+    if(szBaseline != NULL && !ReadJSON(szBaseline, baseline)) {
+        fprintf(stderr, "Cannot read baseline %s\n", szBaseline);
+        return 2;
+        }
+
+    printf("SIMD level: %s\n", m3dSIMDLevelName(m3dSIMDGetLevel()));
+
+    std::vector<BenchResult> results;
+    int nRegressions = 0;
+    for(size_t c = 0; c < cases.size(); c++) {
+        if(szFilter != NULL && strstr(cases[c].szName, szFilter) == NULL)
+            continue;
+
+        BenchResult result;
+        result.name = cases[c].szName;
+        result.nsPerOp = TimeCase(cases[c].pRun, fMinSeconds, nRepeats);
+        results.push_back(result);
+
+        printf("%-40s %12.3f ns/op", result.name.c_str(), result.nsPerOp);
+
+        for(size_t b = 0; b < baseline.size(); b++) {
+            if(baseline[b].name != result.name || baseline[b].nsPerOp <= 0.0)
+                continue;
+
+            double fChange = (result.nsPerOp / baseline[b].nsPerOp - 1.0) * 100.0;
+            printf("  %+7.1f%%", fChange);
+            if(fChange > fThreshold && result.nsPerOp - baseline[b].nsPerOp > fNoise) {
+                printf("  REGRESSION");
+                nRegressions++;
+                }
+            break;
+            }
+        printf("\n");
+        }
+
+    // Keep the results alive
+    printf("(checksum %f)\n", SinkChecksum());
+
+    if(szJSON != NULL)
+        WriteJSON(szJSON, results);
+
+    if(szBaseline != NULL)
+        printf("%d regression(s) over %.1f%%\n", nRegressions, fThreshold);
+
+    return (nRegressions > 0) ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+//
+//  InvertBench.cpp
+//  Benchmarks
+//
+//  Times the general cofactor inverse (m3dInvertMatrix44) against the SIMD
+//  inverse and the affine/rigid body specializations, on rigid body matrices
+//  like the ones GLFrame produces.
+//
+//  Build (from this directory, against a GLTools build for the host):
+//      c++ -O2 -I../include -I../include/GL InvertBench.cpp -L<GLTools> -lGLTools -o InvertBench
+//
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "StopWatch.h"
+#include <stdio.h>
+
+#if defined(M3D_SIMD_X86)
+#define BENCH_HAVE_TSC
+#endif
+
+#define MATRIX_COUNT	1024
+#define REPEATS			2000
+
+static M3DMatrix44f mSource[MATRIX_COUNT];
+static M3DMatrix44f mResult[MATRIX_COUNT];
+
+typedef void (*InvertFunc)(M3DMatrix44f, const M3DMatrix44f);
+
+static void InvertGeneral(M3DMatrix44f mInverse, const M3DMatrix44f m) { m3dInvertMatrix44(mInverse, m); }
+static void InvertSIMD(M3DMatrix44f mInverse, const M3DMatrix44f m) { m3dSIMDInvertMatrix44(mInverse, m); }
+static void InvertAffine(M3DMatrix44f mInverse, const M3DMatrix44f m) { m3dInvertAffine44(mInverse, m); }
+static void InvertRigid(M3DMatrix44f mInverse, const M3DMatrix44f m) { m3dInvertRigid44(mInverse, m); }
+
+// Random rotation plus translation
+static void MakeRigid(M3DMatrix44f m)
+{
+    float angle = float(rand() % 3600) * 0.1f;
+    float x = float(rand() % 200 - 100) + 0.5f;
+    float y = float(rand() % 200 - 100);
+    float z = float(rand() % 200 - 100);
+    m3dRotationMatrix44(m, float(m3dDegToRad(angle)), x, y, z);
+    m[12] = float(rand() % 100);
+    m[13] = float(rand() % 100);
+    m[14] = float(rand() % 100);
+}
+
+static void Run(const char *szName, InvertFunc pInvert)
+{
+    CStopWatch timer;
+#ifdef BENCH_HAVE_TSC
+    unsigned long long start = __rdtsc();
+#endif
+    for(int r = 0; r < REPEATS; r++)
+        for(int i = 0; i < MATRIX_COUNT; i++)
+            pInvert(mResult[i], mSource[i]);
+
+    double nOps = double(REPEATS) * MATRIX_COUNT;
+    double ns = double(timer.GetElapsedSeconds()) * 1e9 / nOps;
+#ifdef BENCH_HAVE_TSC
+    double cycles = double(__rdtsc() - start) / nOps;
+    printf("%-28s %8.2f ns/op %8.1f cycles/op\n", szName, ns, cycles);
+#else
+    printf("%-28s %8.2f ns/op\n", szName, ns);
+#endif
+}
+
+int main(void)
+{
+    for(int i = 0; i < MATRIX_COUNT; i++)
+        MakeRigid(mSource[i]);
+
+    printf("SIMD level: %s\n", m3dSIMDLevelName(m3dSIMDGetLevel()));
+    Run("m3dInvertMatrix44", InvertGeneral);
+    Run("m3dSIMDInvertMatrix44", InvertSIMD);
+    Run("m3dInvertAffine44", InvertAffine);
+    Run("m3dInvertRigid44", InvertRigid);
+
+    // Keep the results alive
+    float fSum = 0.0f;
+    for(int i = 0; i < MATRIX_COUNT; i++)
+        fSum += mResult[i][12];
+    printf("(checksum %f)\n", fSum);
+    return 0;
+}
@@ -8,9 +8,18 @@
 #include "GLTools.h"
 #include "GLMatrixStack.h"
 #include "GLFrame.h"
+#include "GLFrameArray.h"
+#include "GLSceneGraph.h"
+#include "GLBVH.h"
+#include "GLOcclusionBuffer.h"
+#include "GLLODSet.h"
+#include "GLInterleavedBatch.h"
+#include "GLVertexBuilder.h"
 #include "GLFrustum.h"
 #include "GLGeometryTransform.h"
+#include "GLTransformBuffer.h"
 #include "StopWatch.h"
+#include <vector>
 #ifdef __APPLE__
 #include <glut/glut.h>
 #else
@@ -29,16 +38,66 @@ GLGeometryTransform transformPipeline;
 GLShaderManager     shaderManager;
 GLFrame             cameraFrame; //观察者/相机坐标系
 GLFrame             objectFrame; //地球的模型空间坐标系
-GLFrame             sphereFrames[SPHERE_NUMS];//30个随机球的模型空间坐标系
+GLFrameArray        sphereFrames;//30个随机球的模型空间坐标系（按分量连续存放，矩阵一次算出）
 GLFrustum           viewFrustum; //视景体
 
-GLTriangleBatch     earthBatch;//地球
-GLTriangleBatch     sphereBatch;//小球
-GLBatch             floorBatch;//地板
+//地球和公转小球的层级：地球底座 -> 地球自转 / 公转轨道 -> 公转小球
+GLSceneGraph        sceneGraph;
+int                 iEarthBase, iEarth, iMoonOrbit, iMoon;
+
+//包围体层次：30个小球、地球和公转小球，按视景体剔除
+GLBVH               sceneBVH;
+GLFrustum           cullFrustum;
+int                 iEarthObject, iMoonObject;
+GLuint              uiVisible[(SPHERE_NUMS + 2 + 31) / 32];
+
+//遮挡剔除：用低面数的地球代理模型画一张小深度图，被地球挡住的小球不再提交
+//（地板是半透明的，不能当遮挡物）
+GLMeshBatch         earthProxy;
+GLOcclusionBuffer   occlusionBuffer;
+
+//倒影：镜面是 y = -0.4 的平面（见mirrorWorld），地板略低于镜面
+const GLfloat       fMirrorY = -0.4f;
+const GLfloat       fFloorY = -0.41f;
+const GLfloat       fFloorSize = 25.0f;
+
+//倒影这一帧是否看得见、地板在屏幕上的范围（规范化设备坐标，左右下上），
+//以及把近裁剪面换成镜面的投影矩阵。绘制倒影时pCullWindow指向地板范围
+bool                bMirrorVisible = false;
+GLfloat             vMirrorWindow[4];
+M3DMatrix44f        mMirrorProjection;
+const GLfloat       *pCullWindow = NULL;
+GLint               iWindowWidth = 1, iWindowHeight = 1;
+
+//地球和小球按屏幕上的半径（像素）选细节层次，每个物体（包围体层次里的下标）记住
+//上一次的层次，正常画面和倒影各记一份
+GLLODSet            earthLOD;//地球
+GLLODSet            sphereLOD;//小球
+int                 iLODLevels[2][SPHERE_NUMS + 2];
+GLInterleavedBatch  floorBatch;//地板（位置和纹理坐标交错放在一个缓冲区里）
 
 //纹理数组
 GLuint uiTextures[3];
 
+//光源位置&漫反射颜色
+GLfloat vWhite[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+GLfloat vLightPos[] = { 3.0f, 0.0f, 3.0f, 3.0f };
+
+//整帧的模型视图矩阵先录制下来，一次上传到统一缓冲区，每次绘制只传下标
+GLTransformBuffer   transformBuffer;
+GLTransformShaders  transformShaders;
+bool                bTransformBuffer = false; //不支持统一缓冲区时逐个上传矩阵
+
+//录制下来的一次绘制
+struct SceneDraw {
+    GLTriangleBatch *pBatch;
+    GLuint          uiTexture;
+    GLint           iTransform;
+};
+std::vector<SceneDraw> mirrorDraws;     //镜面部分
+std::vector<SceneDraw> sceneDraws;      //地面以上部分
+std::vector<SceneDraw> *pRecordDraws = NULL;
+
 void init();
 void changeSize(GLint w,GLint h);
 void display(void);
@@ -89,6 +148,7 @@ void init()
     glClearColor(0.0f,0.0f,0.0f,1.0f);
     //初始化着色管理器
     shaderManager.InitializeStockShaders();
+    bTransformBuffer = transformShaders.InitializeShaders();
     //开启深度测试
     glEnable(GL_DEPTH_TEST);
     //开启背面剔除
@@ -96,22 +156,30 @@ void init()
     glEnable(GL_CULL_FACE);
     
     //地球
-    gltMakeSphere(earthBatch, 0.5, 50, 100);
+    gltMakeSphere(earthLOD.AddLevel(150.0f), 0.5, 50, 100);
+    gltMakeSphere(earthLOD.AddLevel(60.0f), 0.5, 24, 48);
+    gltMakeSphere(earthLOD.AddLevel(20.0f), 0.5, 12, 24);
+    gltMakeSphere(earthLOD.AddLevel(0.0f), 0.5, 8, 12);
+    //地球的遮挡代理：顶点都在球面上，整体在地球内部
+    gltMakeSphere(earthProxy, 0.5, 12, 6);
+    earthProxy.ReadBack();
     //小球
-    gltMakeSphere(sphereBatch, 0.1, 28, 14);
+    gltMakeSphere(sphereLOD.AddLevel(40.0f), 0.1, 28, 14);
+    gltMakeSphere(sphereLOD.AddLevel(12.0f), 0.1, 14, 7);
+    gltMakeSphere(sphereLOD.AddLevel(0.0f), 0.1, 8, 4);
+    for(int i = 0; i < SPHERE_NUMS + 2; i++)
+        iLODLevels[0][i] = iLODLevels[1][i] = -1;
     
     //设置地板顶点数据&地板纹理
     GLfloat texSize = 10.0f;
-    floorBatch.Begin(GL_TRIANGLE_FAN, 4,1);
-    floorBatch.MultiTexCoord2f(0, 0.0f, 0.0f);
-    floorBatch.Vertex3f(-25.f, -0.41f, 25.0f);
-    floorBatch.MultiTexCoord2f(0, texSize, 0.0f);
-    floorBatch.Vertex3f(25.0f, -0.41f, 25.f);
-    floorBatch.MultiTexCoord2f(0, texSize, texSize);
-    floorBatch.Vertex3f(25.0f, -0.41f, -25.0f);
-    floorBatch.MultiTexCoord2f(0, 0.0f, texSize);
-    floorBatch.Vertex3f(-25.0f, -0.41f, -25.0f);
-    floorBatch.End();
+    GLfloat vFloorVerts[] = { -fFloorSize, fFloorY, fFloorSize,   fFloorSize, fFloorY, fFloorSize,
+                              fFloorSize, fFloorY, -fFloorSize,   -fFloorSize, fFloorY, -fFloorSize };
+    GLfloat vFloorTexCoords[] = { 0.0f, 0.0f,   texSize, 0.0f,   texSize, texSize,   0.0f, texSize };
+    //整段追加到各属性流，End时交错并一次上传
+    GLVertexBuilder floorBuilder;
+    floorBuilder.Positions().Append(vFloorVerts, 4);
+    floorBuilder.TexCoords(0).Append(vFloorTexCoords, 4);
+    floorBuilder.End(floorBatch, GL_TRIANGLE_FAN);
     
     //随机小球顶点坐标
     for (int i = 0; i < SPHERE_NUMS; i++) {
@@ -122,9 +190,30 @@ void init()
         
         //在y方向，将球体设置为0.0的位置，这使得它们看起来是飘浮在眼睛的高度
         //对spheres数组中的每一个顶点，设置顶点数据
-        sphereFrames[i].SetOrigin(x, 0.0f, z);
+        int iSphere = sphereFrames.Add(1);
+        sphereFrames.SetOrigin(iSphere, x, 0.0f, z);
+        
+        //包围球，下标和小球一致
+        M3DVector3f vCenter = { x, 0.0f, z };
+        sceneBVH.AddSphere(vCenter, 0.1f);
     }
     
+    //地球底座：平移到前方，绕X轴转-90度；地球和公转轨道都挂在它下面
+    iEarthBase = sceneGraph.AddNode();
+    sceneGraph.GetFrame(iEarthBase).SetOrigin(0.0f, 0.2f, -2.5f);
+    sceneGraph.GetFrame(iEarthBase).RotateLocalX(m3dDegToRad(-90.0f));
+    iEarth = sceneGraph.AddNode(iEarthBase);
+    iMoonOrbit = sceneGraph.AddNode(iEarthBase);
+    //公转小球离轨道中心0.8
+    iMoon = sceneGraph.AddNode(iMoonOrbit);
+    sceneGraph.GetFrame(iMoon).SetOrigin(0.8f, 0.0f, 0.0f);
+    
+    //地球不动；公转小球每帧在updateScene里移动
+    M3DVector3f vEarth = { 0.0f, 0.2f, -2.5f };
+    iEarthObject = sceneBVH.AddSphere(vEarth, 0.5f);
+    iMoonObject = sceneBVH.AddSphere(vEarth, 0.1f);
+    sceneBVH.Build();
+    
     //命名纹理对象
     glGenTextures(3, uiTextures);
     
@@ -185,57 +274,264 @@ bool loadTexture(const char *szFileName, GLenum minFilter, GLenum magFilter, GLe
     return true;
 }
 
-void drawSomething(GLfloat yRot)
+//用栈顶矩阵绘制；录制时只记下矩阵下标，等整帧上传后再绘制
+void drawBatch(GLTriangleBatch &batch, GLuint uiTexture)
 {
-    //1.定义光源位置&漫反射颜色
-    static GLfloat vWhite[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    static GLfloat vLightPos[] = { 3.0f, 0.0f, 3.0f, 3.0f };
-    
-    //2.绘制静止悬浮小球
-    glBindTexture(GL_TEXTURE_2D, uiTextures[2]);
-    for(int i = 0; i < SPHERE_NUMS; i++) {
-        mvMatrixStack.PushMatrix();
-        mvMatrixStack.MultMatrix(sphereFrames[i]);
-        shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF,
-                                     mvMatrixStack.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(),
-                                     vLightPos,
-                                     vWhite,
-                                     0);
-        sphereBatch.Draw();
-        mvMatrixStack.PopMatrix();
+    if(pRecordDraws != NULL) {
+        SceneDraw draw = { &batch, uiTexture, mvMatrixStack.RecordMatrix() };
+        pRecordDraws->push_back(draw);
+        return;
     }
     
-    //3.绘制地球
-    mvMatrixStack.Translate(0.0f, 0.2f, -2.5f);
-    mvMatrixStack.Rotate(-90, 1.0f, 0.0f, 0.0f);
-    mvMatrixStack.PushMatrix();
-    mvMatrixStack.Rotate(yRot, 0.0f, 0.0f, 1.0f);
-    glBindTexture(GL_TEXTURE_2D, uiTextures[1]);
+    glBindTexture(GL_TEXTURE_2D, uiTexture);
     shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF,
                                  mvMatrixStack.GetMatrix(),
                                  transformPipeline.GetProjectionMatrix(),
                                  vLightPos,
                                  vWhite,
                                  0);
-    earthBatch.Draw();
+    batch.Draw();
+}
+
+//每帧只改动地球自转和公转轨道两个节点，只有它们的子树重新计算
+void updateScene(GLfloat yRot)
+{
+    GLFrame &earth = sceneGraph.GetFrame(iEarth);
+    earth.SetForwardVector(0.0f, 0.0f, 1.0f);
+    earth.SetUpVector(0.0f, 1.0f, 0.0f);
+    earth.RotateLocalZ(m3dDegToRad(yRot));
+    
+    GLFrame &orbit = sceneGraph.GetFrame(iMoonOrbit);
+    orbit.SetForwardVector(0.0f, 0.0f, 1.0f);
+    orbit.SetUpVector(0.0f, 1.0f, 0.0f);
+    orbit.RotateLocalX(m3dDegToRad(-90.0f));
+    orbit.RotateLocalY(m3dDegToRad(yRot * 2.0f));
+    
+    sceneGraph.Update();
+    
+    //只有公转小球移动，只重算它上面的包围盒
+    const M3DMatrix44f &mMoon = sceneGraph.GetWorldMatrix(iMoon);
+    sceneBVH.MoveSphere(iMoonObject, &mMoon[12], 0.1f);
+    sceneBVH.Refit();
+}
+
+//物体是否在当前视景体内（上一次cullScene的结果）
+inline bool isVisible(int iObject)
+{
+    return (uiVisible[iObject >> 5] >> (iObject & 31)) & 1;
+}
+
+//由当前模型视图投影矩阵求出世界空间的视景体平面（镜面翻转也适用），剔除看不见的物体
+void cullScene()
+{
+    //绘制倒影时只看地板覆盖的那块屏幕
+    if(pCullWindow != NULL)
+        cullFrustum.ExtractPlanes(transformPipeline.GetModelViewProjectionMatrix(),
+                                  pCullWindow[0], pCullWindow[1], pCullWindow[2], pCullWindow[3]);
+    else
+        cullFrustum.ExtractPlanes(transformPipeline.GetModelViewProjectionMatrix());
+    sceneBVH.Cull(cullFrustum, uiVisible);
+    
+    //再剔除被地球挡住的物体
+    occlusionBuffer.Begin(transformPipeline.GetModelViewProjectionMatrix());
+    occlusionBuffer.AddOccluder(earthProxy, sceneGraph.GetWorldMatrix(iEarth));
+    occlusionBuffer.End();
+    occlusionBuffer.CullHidden(sceneBVH, uiVisible);
+}
+
+//按栈顶矩阵下物体在屏幕上的大小选细节层次
+GLTriangleBatch &selectLOD(GLLODSet &lod, int iObject, GLfloat fRadius)
+{
+    int iPass = (pCullWindow != NULL) ? 1 : 0;
+    float fPixels = GLLODSet::ProjectedRadius(mvMatrixStack.GetMatrix(), fRadius,
+                                              transformPipeline.GetProjectionMatrix(), GLfloat(iWindowHeight));
+    return lod.Select(fPixels, iLODLevels[iPass][iObject]);
+}
+
+//用场景节点的世界矩阵绘制
+void drawNode(int iNode, GLLODSet &lod, int iObject, GLfloat fRadius, GLuint uiTexture)
+{
+    mvMatrixStack.PushMatrix();
+    const M3DMatrix44f &mWorld = sceneGraph.GetWorldMatrix(iNode);
+    mvMatrixStack.MultMatrix(mWorld, m3dClassifyMatrix44Quick(mWorld));
+    drawBatch(selectLOD(lod, iObject, fRadius), uiTexture);
+    mvMatrixStack.PopMatrix();
+}
+
+void drawSomething()
+{
+    //1.绘制静止悬浮小球：一次算出所有小球的模型视图矩阵
+    static M3DMatrix44f mSpheres[SPHERE_NUMS];
+    cullScene();
+    sphereFrames.GetMatrices(mSpheres, 0, SPHERE_NUMS, mvMatrixStack.GetMatrix());
+    for(int i = 0; i < SPHERE_NUMS; i++) {
+        if(!isVisible(i))
+            continue;
+        mvMatrixStack.PushMatrix(mSpheres[i]);
+        drawBatch(selectLOD(sphereLOD, i, 0.1f), uiTextures[2]);
+        mvMatrixStack.PopMatrix();
+    }
+    
+    //2.绘制地球
+    if(isVisible(iEarthObject))
+        drawNode(iEarth, earthLOD, iEarthObject, 0.5f, uiTextures[1]);
+    
+    //3.绘制公转小球（公转自转)
+    if(isVisible(iMoonObject))
+        drawNode(iMoon, sphereLOD, iMoonObject, 0.1f, uiTextures[2]);
+    
+}
+
+//镜面世界：翻转Y轴，再围绕Y轴平移一定间距（即以 y = fMirrorY 为镜面）
+void mirrorWorld()
+{
+    mvMatrixStack.Scale(1.0f, -1.0f, 1.0f);
+    mvMatrixStack.Translate(0.0f, -2.0f * fMirrorY, 0.0f);
+}
+
+//地板在屏幕上的范围（规范化设备坐标，左右下上）。四边形先按近裁剪面裁掉相机后面的部分
+bool floorWindow(const M3DMatrix44f mViewProjection, GLfloat vWindow[4])
+{
+    M3DVector4f vCorners[4] = {
+        { -fFloorSize, fFloorY,  fFloorSize, 1.0f }, {  fFloorSize, fFloorY,  fFloorSize, 1.0f },
+        {  fFloorSize, fFloorY, -fFloorSize, 1.0f }, { -fFloorSize, fFloorY, -fFloorSize, 1.0f } };
+    M3DVector4f vClip[4];
+    for(int i = 0; i < 4; i++)
+        m3dTransformVector4(vClip[i], vCorners[i], mViewProjection);
+    
+    vWindow[0] = vWindow[2] = 1.0f;
+    vWindow[1] = vWindow[3] = -1.0f;
+    int nPoints = 0;
+    for(int i = 0; i < 4; i++) {
+        const float *a = vClip[i], *b = vClip[(i + 1) & 3];
+        float da = a[2] + a[3], db = b[2] + b[3];  //到近裁剪面的距离
+        M3DVector4f vPoints[2];
+        int n = 0;
+        if(da >= 0.0f)
+            m3dCopyVector4(vPoints[n++], a);
+        if((da >= 0.0f) != (db >= 0.0f)) {
+            float t = da / (da - db);
+            for(int j = 0; j < 4; j++)
+                vPoints[n][j] = a[j] + (b[j] - a[j]) * t;
+            n++;
+        }
+        for(int k = 0; k < n; k++) {
+            float w = (vPoints[k][3] > 1e-6f) ? vPoints[k][3] : 1e-6f;
+            float x = vPoints[k][0] / w, y = vPoints[k][1] / w;
+            vWindow[0] = (x < vWindow[0]) ? x : vWindow[0];
+            vWindow[1] = (x > vWindow[1]) ? x : vWindow[1];
+            vWindow[2] = (y < vWindow[2]) ? y : vWindow[2];
+            vWindow[3] = (y > vWindow[3]) ? y : vWindow[3];
+        }
+        nPoints += n;
+    }
+    
+    vWindow[0] = (vWindow[0] < -1.0f) ? -1.0f : vWindow[0];
+    vWindow[1] = (vWindow[1] > 1.0f) ? 1.0f : vWindow[1];
+    vWindow[2] = (vWindow[2] < -1.0f) ? -1.0f : vWindow[2];
+    vWindow[3] = (vWindow[3] > 1.0f) ? 1.0f : vWindow[3];
+    return nPoints > 0 && vWindow[0] < vWindow[1] && vWindow[2] < vWindow[3];
+}
+
+//把投影矩阵的近裁剪面换成相机空间的平面vPlane（Lengyel的斜视景体），
+//平面正面一侧保留，相机要在背面一侧
+void obliqueProjection(M3DMatrix44f mProjection, const M3DVector4f vPlane)
+{
+    M3DVector4f q;
+    q[0] = ((vPlane[0] > 0.0f ? 1.0f : (vPlane[0] < 0.0f ? -1.0f : 0.0f)) + mProjection[8]) / mProjection[0];
+    q[1] = ((vPlane[1] > 0.0f ? 1.0f : (vPlane[1] < 0.0f ? -1.0f : 0.0f)) + mProjection[9]) / mProjection[5];
+    q[2] = -1.0f;
+    q[3] = (1.0f + mProjection[10]) / mProjection[14];
+    
+    float fScale = 2.0f / (vPlane[0] * q[0] + vPlane[1] * q[1] + vPlane[2] * q[2] + vPlane[3] * q[3]);
+    mProjection[2] = vPlane[0] * fScale;
+    mProjection[6] = vPlane[1] * fScale;
+    mProjection[10] = vPlane[2] * fScale + 1.0f;
+    mProjection[14] = vPlane[3] * fScale;
+}
+
+//每帧先算好倒影：地板不在屏幕上或相机在镜面下方时整个倒影都不画
+void setupMirror(const M3DMatrix44f mCamera)
+{
+    bMirrorVisible = false;
+    if(!floorWindow(transformPipeline.GetModelViewProjectionMatrix(), vMirrorWindow))
+        return;
+    
+    //镜面 y = fMirrorY 下方保留，换到相机空间（平面乘以相机矩阵的逆）
+    M3DMatrix44f mInverse;
+    m3dInvertMatrix44(mInverse, mCamera);
+    M3DVector4f vWorldPlane = { 0.0f, -1.0f, 0.0f, fMirrorY };
+    M3DVector4f vEyePlane;
+    for(int i = 0; i < 4; i++)
+        vEyePlane[i] = vWorldPlane[0] * mInverse[i * 4] + vWorldPlane[1] * mInverse[i * 4 + 1] +
+                       vWorldPlane[2] * mInverse[i * 4 + 2] + vWorldPlane[3] * mInverse[i * 4 + 3];
+    if(vEyePlane[3] >= 0.0f)
+        return;
+    
+    m3dCopyMatrix44(mMirrorProjection, transformPipeline.GetProjectionMatrix());
+    obliqueProjection(mMirrorProjection, vEyePlane);
+    bMirrorVisible = true;
+}
+
+//进入倒影：镜面世界、斜近裁剪面的投影，剔除限制在地板范围内
+void beginMirror()
+{
+    mvMatrixStack.PushMatrix();
+    mirrorWorld();
+    pMatrixStack.PushMatrix();
+    pMatrixStack.LoadMatrix(mMirrorProjection);
+    pCullWindow = vMirrorWindow;
+}
+
+void endMirror()
+{
+    pCullWindow = NULL;
+    pMatrixStack.PopMatrix();
     mvMatrixStack.PopMatrix();
+}
+
+//录制整帧的矩阵（镜面部分和地面以上部分），一次上传
+void recordFrame()
+{
+    transformBuffer.Reset();
+    mirrorDraws.clear();
+    sceneDraws.clear();
+    mvMatrixStack.BeginRecording(transformBuffer);
+    
+    if(bMirrorVisible) {
+        beginMirror();
+        pRecordDraws = &mirrorDraws;
+        drawSomething();
+        endMirror();
+    }
     
-    //4.绘制公转小球（公转自转)
-    mvMatrixStack.Rotate(-90, 1.0f, 0.0f, 0.0f);
     mvMatrixStack.PushMatrix();
-    mvMatrixStack.Rotate(yRot * 2.0f, 0.0f, 1.0f, 0.0f);
-    mvMatrixStack.Translate(0.8f, 0.0f, 0.0f);
-    glBindTexture(GL_TEXTURE_2D, uiTextures[2]);
-    shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF,
-                                 mvMatrixStack.GetMatrix(),
-                                 transformPipeline.GetProjectionMatrix(),
-                                 vLightPos,
-                                 vWhite,
-                                 0);
-    sphereBatch.Draw();
+    pRecordDraws = &sceneDraws;
+    drawSomething();
     mvMatrixStack.PopMatrix();
     
+    pRecordDraws = NULL;
+    mvMatrixStack.EndRecording();
+    transformBuffer.Upload();
+}
+
+//绘制录制下来的部分，投影、光源和颜色只设置一次
+void drawRecorded(const std::vector<SceneDraw> &draws)
+{
+    transformShaders.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF,
+                                    transformPipeline.GetProjectionMatrix(),
+                                    vLightPos,
+                                    vWhite,
+                                    0);
+    GLuint uiBound = 0;
+    for(size_t i = 0; i < draws.size(); i++) {
+        if(i == 0 || draws[i].uiTexture != uiBound) {
+            uiBound = draws[i].uiTexture;
+            glBindTexture(GL_TEXTURE_2D, uiBound);
+        }
+        transformShaders.SetTransform(transformBuffer, draws[i].iTransform);
+        draws[i].pBatch->Draw();
+    }
 }
 
 //渲染
@@ -249,6 +545,9 @@ void display(void)
     //动画周期
     static CStopWatch    rotTimer;
     float yRot = rotTimer.GetElapsedSeconds() * 60.0f;
+    earthLOD.ResetStats();
+    sphereLOD.ResetStats();
+    updateScene(yRot);
     // 压栈
     mvMatrixStack.PushMatrix();
     
@@ -257,26 +556,45 @@ void display(void)
     cameraFrame.GetCameraMatrix(mCamera);
     mvMatrixStack.MultMatrix(mCamera);
     
-    //压栈
-    mvMatrixStack.PushMatrix();
-    
-    //---添加反光效果---
-    //翻转Y轴
-    mvMatrixStack.Scale(1.0f, -1.0f, 1.0f);
-    //镜面世界围绕Y轴平移一定间距
-    mvMatrixStack.Translate(0.0f, 0.8f, 0.0f);
-    
-    //指定顺时针为正面
-    glFrontFace(GL_CW);
+    //倒影看不看得见、画在屏幕哪一块
+    setupMirror(mCamera);
     
-    //绘制地面以下其他部分
-    drawSomething(yRot);
+    //支持统一缓冲区时，先录制并上传整帧的矩阵
+    if(bTransformBuffer)
+        recordFrame();
     
-    //恢复为逆时针为正面
-    glFrontFace(GL_CCW);
-    
-    //镜面绘制结束，恢复矩阵
-    mvMatrixStack.PopMatrix();
+    //---添加反光效果---
+    if(bMirrorVisible) {
+        //压栈，翻转到镜面世界
+        beginMirror();
+        
+        //只画地板覆盖的那块屏幕
+        GLint x0 = GLint(floorf((vMirrorWindow[0] * 0.5f + 0.5f) * iWindowWidth));
+        GLint x1 = GLint(ceilf((vMirrorWindow[1] * 0.5f + 0.5f) * iWindowWidth));
+        GLint y0 = GLint(floorf((vMirrorWindow[2] * 0.5f + 0.5f) * iWindowHeight));
+        GLint y1 = GLint(ceilf((vMirrorWindow[3] * 0.5f + 0.5f) * iWindowHeight));
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x0, y0, x1 - x0, y1 - y0);
+        
+        //指定顺时针为正面
+        glFrontFace(GL_CW);
+        
+        //绘制地面以下其他部分
+        if(bTransformBuffer)
+            drawRecorded(mirrorDraws);
+        else
+            drawSomething();
+        
+        //恢复为逆时针为正面
+        glFrontFace(GL_CCW);
+        
+        //斜近裁剪面的深度和正常投影不一致，清掉这块深度，地板和地面以上部分照常测试
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
+        
+        //镜面绘制结束，恢复矩阵
+        endMirror();
+    }
     
     //开启混合功能(绘制地板) 因为需要半透明效果
     glEnable(GL_BLEND);
@@ -299,7 +617,10 @@ void display(void)
     glDisable(GL_BLEND);
     
     //绘制地面以上部分
-    drawSomething(yRot);
+    if(bTransformBuffer)
+        drawRecorded(sceneDraws);
+    else
+        drawSomething();
     
     //绘制完，恢复矩阵
     mvMatrixStack.PopMatrix();
@@ -307,6 +628,17 @@ void display(void)
     //交换缓存区
     glutSwapBuffers();
     
+    //每秒在标题栏显示一次细节层次画了多少三角形、省了多少
+    static CStopWatch    titleTimer;
+    if(titleTimer.GetElapsedSeconds() >= 1.0f) {
+        char szTitle[128];
+        sprintf(szTitle, "GL_Earth - LOD: %u triangles, %u saved",
+                earthLOD.GetTrianglesDrawn() + sphereLOD.GetTrianglesDrawn(),
+                earthLOD.GetTrianglesSaved() + sphereLOD.GetTrianglesSaved());
+        glutSetWindowTitle(szTitle);
+        titleTimer.Reset();
+    }
+    
     //提交重新渲染
     glutPostRedisplay();
     
@@ -316,6 +648,8 @@ void display(void)
 void changeSize(GLint w,GLint h)
 {
     glViewport(0,0, w, h);
+    iWindowWidth = w;
+    iWindowHeight = h;
     viewFrustum.SetPerspective(40.f, GLfloat(w)/GLfloat(h), 1.0f, 500.f);
     pMatrixStack.LoadMatrix(viewFrustum.GetProjectionMatrix());
     mvMatrixStack.LoadIdentity();
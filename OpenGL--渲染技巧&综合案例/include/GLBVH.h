@@ -0,0 +1,462 @@
+// GLBVH.h
+// A bounding volume hierarchy over scene objects, for culling and picking.
+//
+// Each object is an axis aligned box (AddSphere makes the box around a
+// sphere). Build() sorts them into a binary tree of boxes, choosing every
+// split with the surface area heuristic over GLT_BVH_BINS bins per axis, so
+// the tree is good for both frustum and ray queries.
+//
+// Objects that move are given their new bounds with MoveObject, and Refit()
+// then grows or shrinks only the boxes above them, walking up until a box
+// comes out the same. The cost follows the number of objects that moved,
+// not the size of the scene. Refitting keeps the tree's shape, which gets
+// less efficient as objects wander far from where they were built; Build()
+// again when that happens.
+//
+// Cull() walks the tree against a GLFrustum with the hierarchical
+// TestAABB: a box outside a plane drops its whole subtree, and a box inside
+// every plane takes its whole subtree with no further tests. Intersect()
+// walks it along a ray, nearer child first, skipping boxes further than the
+// best hit so far.
+//
+// Objects keep the index AddObject returned. Build() must be called after
+// adding objects and before querying.
+
+#ifndef __GL_BVH
+#define __GL_BVH
+
+#include "math3d.h"
+#include "GLFrustum.h"
+#include "GLRayQuery.h"
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#define GLT_BVH_BINS		16		// Split candidates per axis
+#define GLT_BVH_LEAF_SIZE	2		// Objects a leaf is always allowed
+#define GLT_BVH_MAX_LEAF	8		// Objects a leaf never exceeds, unless they can't be told apart
+
+struct GLBVHBounds
+	{
+	M3DVector3f vMin, vMax;
+	};
+
+struct GLBVHNode
+	{
+	GLBVHBounds	bounds;
+	int			iFirst, nCount;		// The objects below, a run of GetObjectOrder()
+	int			iChild;				// First of two children, -1 for a leaf
+	int			iParent;
+	};
+
+inline void gltBoundsEmpty(GLBVHBounds& b)
+	{
+	b.vMin[0] = b.vMin[1] = b.vMin[2] = FLT_MAX;
+	b.vMax[0] = b.vMax[1] = b.vMax[2] = -FLT_MAX;
+	}
+
+inline void gltBoundsAdd(GLBVHBounds& b, const GLBVHBounds& a)
+	{
+	for(int i = 0; i < 3; i++) {
+		b.vMin[i] = (a.vMin[i] < b.vMin[i]) ? a.vMin[i] : b.vMin[i];
+		b.vMax[i] = (a.vMax[i] > b.vMax[i]) ? a.vMax[i] : b.vMax[i];
+		}
+	}
+
+// Half the surface area, all the heuristic needs
+inline float gltBoundsArea(const GLBVHBounds& b)
+	{
+	float dx = b.vMax[0] - b.vMin[0], dy = b.vMax[1] - b.vMin[1], dz = b.vMax[2] - b.vMin[2];
+	if(dx < 0.0f || dy < 0.0f || dz < 0.0f)
+		return 0.0f;
+	return dx * dy + dy * dz + dz * dx;
+	}
+
+// Distance along the ray to where it enters the box (zero from inside), or
+// a negative value on a miss. vInvDir is one over each direction component.
+inline float gltRayBoxDistance(const M3DVector3f vOrigin, const M3DVector3f vInvDir, const GLBVHBounds& b, float fMaxDistance)
+	{
+	float tNear = 0.0f, tFar = fMaxDistance;
+	for(int i = 0; i < 3; i++) {
+		float t0 = (b.vMin[i] - vOrigin[i]) * vInvDir[i];
+		float t1 = (b.vMax[i] - vOrigin[i]) * vInvDir[i];
+		if(t0 > t1) {
+			float t = t0; t0 = t1; t1 = t;
+			}
+		// fmaxf and fminf drop the NaN of a ray lying in a slab's plane
+		tNear = fmaxf(tNear, t0);
+		tFar = fminf(tFar, t1);
+		}
+	return (tNear <= tFar) ? tNear : -1.0f;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLBVH
+	{
+	public:
+		GLBVH(void) : bBuilt(false) {}
+
+		void Clear(void) {
+			vObjects.clear();
+			vNodes.clear();
+			vOrder.clear();
+			vLeaf.clear();
+			vMoved.clear();
+			bBuilt = false;
+			}
+
+		inline int GetObjectCount(void) const { return int(vObjects.size()); }
+		inline int GetNodeCount(void) const { return int(vNodes.size()); }
+		inline const GLBVHNode& GetNode(int i) const { return vNodes[i]; }
+		inline const GLBVHBounds& GetObjectBounds(int i) const { return vObjects[i]; }
+		inline const int *GetObjectOrder(void) const { return vOrder.empty() ? NULL : &vOrder[0]; }
+
+		// Returns the object's index
+		int AddObject(const M3DVector3f vMin, const M3DVector3f vMax) {
+			GLBVHBounds b;
+			m3dCopyVector3(b.vMin, vMin);
+			m3dCopyVector3(b.vMax, vMax);
+			vObjects.push_back(b);
+			vLeaf.push_back(-1);
+			bBuilt = false;
+			return int(vObjects.size()) - 1;
+			}
+
+		int AddSphere(const M3DVector3f vCenter, float fRadius) {
+			M3DVector3f vMin, vMax;
+			SphereBounds(vCenter, fRadius, vMin, vMax);
+			return AddObject(vMin, vMax);
+			}
+
+		// New bounds for an object, picked up by the next Refit
+		void MoveObject(int i, const M3DVector3f vMin, const M3DVector3f vMax) {
+			m3dCopyVector3(vObjects[i].vMin, vMin);
+			m3dCopyVector3(vObjects[i].vMax, vMax);
+			vMoved.push_back(i);
+			}
+
+		void MoveSphere(int i, const M3DVector3f vCenter, float fRadius) {
+			M3DVector3f vMin, vMax;
+			SphereBounds(vCenter, fRadius, vMin, vMax);
+			MoveObject(i, vMin, vMax);
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Build the tree from scratch
+		void Build(void) {
+			vNodes.clear();
+			vMoved.clear();
+			bBuilt = true;
+
+			int nObjects = GetObjectCount();
+			if(nObjects == 0)
+				return;
+
+			vOrder.resize(nObjects);
+			vCentroids.resize(3 * nObjects);
+			for(int i = 0; i < nObjects; i++) {
+				vOrder[i] = i;
+				for(int j = 0; j < 3; j++)
+					vCentroids[3 * i + j] = (vObjects[i].vMin[j] + vObjects[i].vMax[j]) * 0.5f;
+				}
+
+			vNodes.reserve(2 * nObjects);
+			vNodes.push_back(MakeNode(0, nObjects, -1));
+
+			std::vector<int> vPending(1, 0);
+			while(!vPending.empty()) {
+				int iNode = vPending.back();
+				vPending.pop_back();
+
+				int iSplit = Split(vNodes[iNode]);
+				if(iSplit < 0) {
+					for(int j = vNodes[iNode].iFirst; j < vNodes[iNode].iFirst + vNodes[iNode].nCount; j++)
+						vLeaf[vOrder[j]] = iNode;
+					continue;
+					}
+
+				int iFirst = vNodes[iNode].iFirst, nCount = vNodes[iNode].nCount;
+				int iChild = int(vNodes.size());
+				vNodes[iNode].iChild = iChild;
+				vNodes.push_back(MakeNode(iFirst, iSplit - iFirst, iNode));
+				vNodes.push_back(MakeNode(iSplit, iFirst + nCount - iSplit, iNode));
+				vPending.push_back(iChild);
+				vPending.push_back(iChild + 1);
+				}
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Bring the boxes above moved objects up to date
+		void Refit(void) {
+			if(!bBuilt) {
+				Build();
+				return;
+				}
+
+			for(size_t m = 0; m < vMoved.size(); m++) {
+				int iNode = vLeaf[vMoved[m]];
+				GLBVHBounds b;
+				LeafBounds(vNodes[iNode], b);
+				while(memcmp(&b, &vNodes[iNode].bounds, sizeof(GLBVHBounds)) != 0) {
+					vNodes[iNode].bounds = b;
+					iNode = vNodes[iNode].iParent;
+					if(iNode < 0)
+						break;
+
+					b = vNodes[vNodes[iNode].iChild].bounds;
+					gltBoundsAdd(b, vNodes[vNodes[iNode].iChild + 1].bounds);
+					}
+				}
+			vMoved.clear();
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Set a bit in pVisible (gltFrustumMaskWords(GetObjectCount())
+		// words) for every object that may be visible. Returns how many.
+		int Cull(const GLFrustum& frustum, GLuint *pVisible) {
+			int nObjects = GetObjectCount();
+			if(nObjects == 0)
+				return 0;
+			memset(pVisible, 0, sizeof(GLuint) * gltFrustumMaskWords(nObjects));
+			if(vNodes.empty())
+				return 0;
+
+			int nVisible = 0;
+			vCullStack.clear();
+			vCullStack.push_back(CullEntry(0, GLT_FRUSTUM_ALL_PLANES));
+			while(!vCullStack.empty()) {
+				CullEntry entry = vCullStack.back();
+				vCullStack.pop_back();
+
+				const GLBVHNode& node = vNodes[entry.iNode];
+				GLuint nPlaneMask = entry.nPlaneMask;
+				if(!frustum.TestAABB(node.bounds.vMin, node.bounds.vMax, nPlaneMask))
+					continue;
+
+				if(nPlaneMask == 0 || node.iChild < 0) {
+					for(int j = node.iFirst; j < node.iFirst + node.nCount; j++) {
+						int i = vOrder[j];
+						GLuint nObjectMask = nPlaneMask;
+						if(nPlaneMask == 0 || frustum.TestAABB(vObjects[i].vMin, vObjects[i].vMax, nObjectMask)) {
+							pVisible[i >> 5] |= 1u << (i & 31);
+							nVisible++;
+							}
+						}
+					continue;
+					}
+
+				vCullStack.push_back(CullEntry(node.iChild, nPlaneMask));
+				vCullStack.push_back(CullEntry(node.iChild + 1, nPlaneMask));
+				}
+			return nVisible;
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Nearest object along the ray. fnTest(iObject, vOrigin, vDirection,
+		// fDistance) decides whether an object whose box the ray reaches is
+		// really hit, and how far along; distances are in units of
+		// vDirection's length.
+		template <class RayTest>
+		GLRayHit Intersect(const M3DVector3f vOrigin, const M3DVector3f vDirection, RayTest fnTest) const {
+			GLRayHit hit;
+			gltRayHitReset(hit);
+			if(vNodes.empty())
+				return hit;
+
+			M3DVector3f vInvDir;
+			for(int i = 0; i < 3; i++)
+				vInvDir[i] = 1.0f / vDirection[i];
+
+			std::vector<int> vStack;
+			if(gltRayBoxDistance(vOrigin, vInvDir, vNodes[0].bounds, FLT_MAX) >= 0.0f)
+				vStack.push_back(0);
+
+			while(!vStack.empty()) {
+				int iNode = vStack.back();
+				vStack.pop_back();
+
+				const GLBVHNode& node = vNodes[iNode];
+				if(node.iChild < 0) {
+					for(int j = node.iFirst; j < node.iFirst + node.nCount; j++) {
+						int i = vOrder[j];
+						if(gltRayBoxDistance(vOrigin, vInvDir, vObjects[i], hit.fDistance) < 0.0f)
+							continue;
+
+						float fDistance;
+						if(fnTest(i, vOrigin, vDirection, fDistance) && fDistance >= 0.0f)
+							gltRayHitMerge(hit, i, fDistance, 0.0f, 0.0f);
+						}
+					continue;
+					}
+
+				// Push the further child first so the nearer is taken next
+				float t0 = gltRayBoxDistance(vOrigin, vInvDir, vNodes[node.iChild].bounds, hit.fDistance);
+				float t1 = gltRayBoxDistance(vOrigin, vInvDir, vNodes[node.iChild + 1].bounds, hit.fDistance);
+				int iNear = node.iChild, iFar = node.iChild + 1;
+				if(t1 >= 0.0f && (t0 < 0.0f || t1 < t0)) {
+					float t = t0; t0 = t1; t1 = t;
+					iNear = node.iChild + 1; iFar = node.iChild;
+					}
+
+				if(t1 >= 0.0f)
+					vStack.push_back(iFar);
+				if(t0 >= 0.0f)
+					vStack.push_back(iNear);
+				}
+			return hit;
+			}
+
+		// Nearest object box along the ray
+		GLRayHit Intersect(const M3DVector3f vOrigin, const M3DVector3f vDirection) const {
+			M3DVector3f vInvDir;
+			for(int i = 0; i < 3; i++)
+				vInvDir[i] = 1.0f / vDirection[i];
+
+			return Intersect(vOrigin, vDirection, [this, &vInvDir](int i, const float *o, const float *, float& fDistance) {
+				fDistance = gltRayBoxDistance(o, vInvDir, vObjects[i], FLT_MAX);
+				return fDistance >= 0.0f;
+				});
+			}
+
+	protected:
+		struct CullEntry
+			{
+			CullEntry(int i, GLuint nMask) : iNode(i), nPlaneMask(nMask) {}
+			int		iNode;
+			GLuint	nPlaneMask;
+			};
+
+		static void SphereBounds(const M3DVector3f vCenter, float fRadius, M3DVector3f vMin, M3DVector3f vMax) {
+			for(int i = 0; i < 3; i++) {
+				vMin[i] = vCenter[i] - fRadius;
+				vMax[i] = vCenter[i] + fRadius;
+				}
+			}
+
+		void LeafBounds(const GLBVHNode& node, GLBVHBounds& b) const {
+			gltBoundsEmpty(b);
+			for(int j = node.iFirst; j < node.iFirst + node.nCount; j++)
+				gltBoundsAdd(b, vObjects[vOrder[j]]);
+			}
+
+		GLBVHNode MakeNode(int iFirst, int nCount, int iParent) const {
+			GLBVHNode node;
+			node.iFirst = iFirst;
+			node.nCount = nCount;
+			node.iChild = -1;
+			node.iParent = iParent;
+			LeafBounds(node, node.bounds);
+			return node;
+			}
+
+		// Partition the node's objects along the cheapest split. Returns
+		// where the second half starts, or -1 to keep the node a leaf.
+		int Split(const GLBVHNode& node) {
+			int iFirst = node.iFirst, nCount = node.nCount;
+			if(nCount <= GLT_BVH_LEAF_SIZE)
+				return -1;
+
+			GLBVHBounds centroids;
+			gltBoundsEmpty(centroids);
+			for(int j = iFirst; j < iFirst + nCount; j++)
+				for(int k = 0; k < 3; k++) {
+					float c = vCentroids[3 * vOrder[j] + k];
+					centroids.vMin[k] = (c < centroids.vMin[k]) ? c : centroids.vMin[k];
+					centroids.vMax[k] = (c > centroids.vMax[k]) ? c : centroids.vMax[k];
+					}
+
+			// Small nodes don't need every bin
+			int nBins = (nCount < GLT_BVH_BINS) ? nCount : GLT_BVH_BINS;
+			float fBestCost = FLT_MAX;
+			int iBestAxis = -1, iBestBin = 0;
+			for(int k = 0; k < 3; k++) {
+				float fExtent = centroids.vMax[k] - centroids.vMin[k];
+				if(!(fExtent > 0.0f))
+					continue;
+
+				GLBVHBounds bins[GLT_BVH_BINS];
+				int nBin[GLT_BVH_BINS];
+				for(int b = 0; b < nBins; b++) {
+					gltBoundsEmpty(bins[b]);
+					nBin[b] = 0;
+					}
+
+				float fScale = nBins / fExtent;
+				for(int j = iFirst; j < iFirst + nCount; j++) {
+					int b = BinOf(vCentroids[3 * vOrder[j] + k], centroids.vMin[k], fScale, nBins);
+					gltBoundsAdd(bins[b], vObjects[vOrder[j]]);
+					nBin[b]++;
+					}
+
+				// Sweep from the right for the right hand sides, then from the
+				// left scoring each split
+				float fRightArea[GLT_BVH_BINS];
+				int nRight[GLT_BVH_BINS];
+				GLBVHBounds acc;
+				gltBoundsEmpty(acc);
+				int n = 0;
+				for(int b = nBins - 1; b > 0; b--) {
+					gltBoundsAdd(acc, bins[b]);
+					n += nBin[b];
+					fRightArea[b] = gltBoundsArea(acc);
+					nRight[b] = n;
+					}
+
+				gltBoundsEmpty(acc);
+				n = 0;
+				for(int b = 0; b < nBins - 1; b++) {
+					gltBoundsAdd(acc, bins[b]);
+					n += nBin[b];
+					if(n == 0 || nRight[b + 1] == 0)
+						continue;
+					float fCost = n * gltBoundsArea(acc) + nRight[b + 1] * fRightArea[b + 1];
+					if(fCost < fBestCost) {
+						fBestCost = fCost;
+						iBestAxis = k;
+						iBestBin = b + 1;
+						}
+					}
+				}
+
+			if(iBestAxis < 0) {
+				// Every centroid in one spot, so no split tells them apart
+				if(nCount <= GLT_BVH_MAX_LEAF)
+					return -1;
+				return iFirst + nCount / 2;
+				}
+
+			// Splitting costs a box test more than testing them all here
+			float fLeafCost = nCount * gltBoundsArea(node.bounds);
+			if(fBestCost >= fLeafCost && nCount <= GLT_BVH_MAX_LEAF)
+				return -1;
+
+			float fMin = centroids.vMin[iBestAxis];
+			float fScale = nBins / (centroids.vMax[iBestAxis] - fMin);
+			int *pMid = std::partition(&vOrder[iFirst], &vOrder[iFirst] + nCount, [&](int i) {
+				return BinOf(vCentroids[3 * i + iBestAxis], fMin, fScale, nBins) < iBestBin;
+				});
+			return int(pMid - &vOrder[0]);
+			}
+
+		static inline int BinOf(float c, float fMin, float fScale, int nBins) {
+			int b = int((c - fMin) * fScale);
+			return (b < 0) ? 0 : ((b >= nBins) ? nBins - 1 : b);
+			}
+
+		std::vector<GLBVHBounds>	vObjects;
+		std::vector<GLBVHNode>		vNodes;
+		std::vector<int>			vOrder;			// Objects in leaf order
+		std::vector<int>			vLeaf;			// Leaf node of each object
+		std::vector<int>			vMoved;			// Objects moved since the last Refit
+		std::vector<float>			vCentroids;		// Scratch for Build, x y z per object
+		std::vector<CullEntry>		vCullStack;
+		bool						bBuilt;
+	};
+
+#endif
@@ -31,6 +31,7 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 */
 
 #include "math3d.h"
+#include "math3dQuat.h"
 
 #ifndef _ORTHO_FRAME_
 #define _ORTHO_FRAME_
@@ -45,6 +46,20 @@ class GLFrame
         M3DVector3f vForward;	// Where am I going?
         M3DVector3f vUp;		// Which way is up?
 
+        // Quaternion mode (see SetQuaternionMode). vForward and vUp are kept
+        // in step with qOrientation, so everything that reads them still works.
+        M3DQuaternionf qOrientation;
+        bool bQuaternionMode;
+        bool bQuaternionStale;	// The vectors were set directly
+
+        // The frame's matrix and its inverse, built when first asked for after
+        // a change. Moves only update the matrix's translation; rotations and
+        // directly set vectors mark both for a rebuild.
+        M3DMatrix44f mMatrix;
+        M3DMatrix44f mInverse;
+        bool bMatrixDirty;
+        bool bInverseDirty;
+
     public:
 		// Default position and orientation. At the origin, looking
 		// down the positive Z axis (right handed coordinate system).
@@ -57,16 +72,70 @@ class GLFrame
 
 			// Forward is -Z (default OpenGL)
             vForward[0] = 0.0f; vForward[1] = 0.0f; vForward[2] = -1.0f;
+
+			// The same orientation: x axis -X, up +Y, forward -Z is half a turn around Y
+			qOrientation[0] = 0.0f; qOrientation[1] = 1.0f; qOrientation[2] = 0.0f; qOrientation[3] = 0.0f;
+			bQuaternionMode = false;
+			bQuaternionStale = false;
+			bMatrixDirty = true;
+			bInverseDirty = true;
             }
 
 
+		/////////////////////////////////////////////////////////////
+		// Orientation storage. By default the frame rotates its forward and up
+		// vectors directly, building a rotation matrix for every call. In
+		// quaternion mode rotations are composed on a unit quaternion instead:
+		// one sin/cos pair, a 16 multiply product and a normalize per call, and
+		// no drift, so Normalize() is never needed.
+		inline void SetQuaternionMode(bool bEnable) {
+			if(bEnable && !bQuaternionMode)
+				bQuaternionStale = true;
+			bQuaternionMode = bEnable;
+			}
+
+		inline bool GetQuaternionMode(void) const { return bQuaternionMode; }
+
+		// Works in either mode
+		void GetOrientation(M3DQuaternionf q) const {
+			if(bQuaternionMode && !bQuaternionStale)
+				m3dQuatCopy(q, qOrientation);
+			else
+				QuaternionFromVectors(q);
+			}
+
+		void SetOrientation(const M3DQuaternionf q) {
+			m3dQuatCopy(qOrientation, q);
+			m3dQuatNormalize(qOrientation);
+			bQuaternionStale = false;
+			UpdateVectors();
+			}
+
+		// Interpolate between two frames: origin linearly, orientation by slerp.
+		// Either frame may be this one. The result is in quaternion mode.
+		void Slerp(const GLFrame& frameA, const GLFrame& frameB, float t) {
+			M3DQuaternionf qA, qB;
+			frameA.GetOrientation(qA);
+			frameB.GetOrientation(qB);
+
+			vOrigin[0] = frameA.vOrigin[0] + (frameB.vOrigin[0] - frameA.vOrigin[0]) * t;
+			vOrigin[1] = frameA.vOrigin[1] + (frameB.vOrigin[1] - frameA.vOrigin[1]) * t;
+			vOrigin[2] = frameA.vOrigin[2] + (frameB.vOrigin[2] - frameA.vOrigin[2]) * t;
+
+			bQuaternionMode = true;
+			m3dQuatSlerp(qOrientation, qA, qB, t);
+			bQuaternionStale = false;
+			UpdateVectors();
+			}
+
+
         /////////////////////////////////////////////////////////////
         // Set Location
         inline void SetOrigin(const M3DVector3f vPoint) {
-			m3dCopyVector3(vOrigin, vPoint); }
+			m3dCopyVector3(vOrigin, vPoint); OriginChanged(); }
         
         inline void SetOrigin(float x, float y, float z) { 
-			vOrigin[0] = x; vOrigin[1] = y; vOrigin[2] = z; }
+			vOrigin[0] = x; vOrigin[1] = y; vOrigin[2] = z; OriginChanged(); }
 
 		inline void GetOrigin(M3DVector3f vPoint) {
 			m3dCopyVector3(vPoint, vOrigin); }
@@ -78,20 +147,20 @@ class GLFrame
         /////////////////////////////////////////////////////////////
         // Set Forward Direction
         inline void SetForwardVector(const M3DVector3f vDirection) {
-			m3dCopyVector3(vForward, vDirection); }
+			m3dCopyVector3(vForward, vDirection); bQuaternionStale = true; OrientationChanged(); }
 
         inline void SetForwardVector(float x, float y, float z)
-            { vForward[0] = x; vForward[1] = y; vForward[2] = z; }
+            { vForward[0] = x; vForward[1] = y; vForward[2] = z; bQuaternionStale = true; OrientationChanged(); }
 
         inline void GetForwardVector(M3DVector3f vVector) { m3dCopyVector3(vVector, vForward); }
 
         /////////////////////////////////////////////////////////////
         // Set Up Direction
         inline void SetUpVector(const M3DVector3f vDirection) {
-			m3dCopyVector3(vUp, vDirection); }
+			m3dCopyVector3(vUp, vDirection); bQuaternionStale = true; OrientationChanged(); }
 
         inline void SetUpVector(float x, float y, float z)
-			{ vUp[0] = x; vUp[1] = y; vUp[2] = z; }
+			{ vUp[0] = x; vUp[1] = y; vUp[2] = z; bQuaternionStale = true; OrientationChanged(); }
 
         inline void GetUpVector(M3DVector3f vVector) { m3dCopyVector3(vVector, vUp); }
 
@@ -106,7 +175,7 @@ class GLFrame
 		/////////////////////////////////////////////////////////////
         // Translate along orthonormal axis... world or local
         inline void TranslateWorld(float x, float y, float z)
-			{ vOrigin[0] += x; vOrigin[1] += y; vOrigin[2] += z; }
+			{ vOrigin[0] += x; vOrigin[1] += y; vOrigin[2] += z; OriginChanged(); }
 
         inline void TranslateLocal(float x, float y, float z)
 			{ MoveForward(z); MoveUp(y); MoveRight(x);	}
@@ -120,6 +189,7 @@ class GLFrame
 			vOrigin[0] += vForward[0] * fDelta;
 			vOrigin[1] += vForward[1] * fDelta;
 			vOrigin[2] += vForward[2] * fDelta;
+			OriginChanged();
 			}
 
 		// Move along Y axis
@@ -129,6 +199,7 @@ class GLFrame
 			vOrigin[0] += vUp[0] * fDelta;
 			vOrigin[1] += vUp[1] * fDelta;
 			vOrigin[2] += vUp[2] * fDelta;
+			OriginChanged();
 			}
 
 		// Move along X axis
@@ -141,48 +212,54 @@ class GLFrame
 			vOrigin[0] += vCross[0] * fDelta;
 			vOrigin[1] += vCross[1] * fDelta;
 			vOrigin[2] += vCross[2] * fDelta;
+			OriginChanged();
 			}
 
 
 		///////////////////////////////////////////////////////////////////////
-		// Just assemble the matrix
+		// The frame's matrix, from the cache
         void GetMatrix(M3DMatrix44f matrix, bool bRotationOnly = false)
 			{
-			// Calculate the right side (x) vector, drop it right into the matrix
-			M3DVector3f vXAxis;
-			m3dCrossProduct3(vXAxis, vUp, vForward);
-
-			// Set matrix column does not fill in the fourth value...
-            m3dSetMatrixColumn44(matrix, vXAxis, 0);
-            matrix[3] = 0.0f;
-           
-            // Y Column
-			m3dSetMatrixColumn44(matrix, vUp, 1);
-            matrix[7] = 0.0f;       
-                                    
-            // Z Column
-			m3dSetMatrixColumn44(matrix, vForward, 2);
-            matrix[11] = 0.0f;
-
-            // Translation (already done)
+			m3dCopyMatrix44(matrix, GetMatrix());
+
 			if(bRotationOnly == true)
 				{
 				matrix[12] = 0.0f;
 				matrix[13] = 0.0f;
 				matrix[14] = 0.0f;
 				}
-			else
-				m3dSetMatrixColumn44(matrix, vOrigin, 3);
+			}
+
+		const M3DMatrix44f& GetMatrix(void)
+			{
+			if(bMatrixDirty)
+				BuildMatrix();
+			return mMatrix;
+			}
 
-            matrix[15] = 1.0f;
+		// World to frame coordinates. The frame is rigid, so this is a
+		// transpose and three dot products, done once per change.
+		const M3DMatrix44f& GetInverseMatrix(void)
+			{
+			if(bInverseDirty) {
+				m3dInvertRigid44(mInverse, GetMatrix());
+				bInverseDirty = false;
+				}
+			return mInverse;
 			}
 
+		void GetInverseMatrix(M3DMatrix44f matrix) { m3dCopyMatrix44(matrix, GetInverseMatrix()); }
+
 
 
        ////////////////////////////////////////////////////////////////////////
        // Assemble the camera matrix
+       // The camera matrix is just the inverse of the frame's own matrix (with
+       // forward reversed). That matrix is a pure rotation and translation, so
+       // the inverse is a transpose and three dot products, no multiply needed.
         void GetCameraMatrix(M3DMatrix44f m, bool bRotationOnly = false)
             {
+            M3DMatrix44f mFrame;
             M3DVector3f x, z;
 			
 			// Make rotation matrix
@@ -194,45 +271,31 @@ class GLFrame
 			// X vector = Y cross Z 
 			m3dCrossProduct3(x, vUp, z);
 
-			// Matrix has no translation information and is
-			// transposed.... (rows instead of columns)
-			#define M(row,col)  m[col*4+row]
-			   M(0, 0) = x[0];
-			   M(0, 1) = x[1];
-			   M(0, 2) = x[2];
-			   M(0, 3) = 0.0;
-			   M(1, 0) = vUp[0];
-			   M(1, 1) = vUp[1];
-			   M(1, 2) = vUp[2];
-			   M(1, 3) = 0.0;
-			   M(2, 0) = z[0];
-			   M(2, 1) = z[1];
-			   M(2, 2) = z[2];
-			   M(2, 3) = 0.0;
-			   M(3, 0) = 0.0;
-			   M(3, 1) = 0.0;
-			   M(3, 2) = 0.0;
-			   M(3, 3) = 1.0;
-			#undef M
+            // Only the rotation and translation parts are read by the inverse
+            memcpy(mFrame, x, sizeof(M3DVector3f));
+            memcpy(mFrame + 4, vUp, sizeof(M3DVector3f));
+            memcpy(mFrame + 8, z, sizeof(M3DVector3f));
+            memcpy(mFrame + 12, vOrigin, sizeof(M3DVector3f));
 
-			
-            if(bRotationOnly)
-                return;
-                
-            // Apply translation too
-            M3DMatrix44f trans, M;
-            m3dTranslationMatrix44(trans, -vOrigin[0], -vOrigin[1], -vOrigin[2]);  
-			
-            m3dMatrixMultiply44(M, m, trans);
-        
-            // Copy result back into m
-            memcpy(m, M, sizeof(float)*16);
+            // Inverse is transposed.... (rows instead of columns)
+            m3dInvertRigid44(m, mFrame);
+
+            if(bRotationOnly) {
+                m[12] = 0.0f;
+                m[13] = 0.0f;
+                m[14] = 0.0f;
+                }
             }
 
 
 		// Rotate around local Y
         void RotateLocalY(float fAngle)
 			{
+			if(bQuaternionMode) {
+				RotateQuaternionLocal(fAngle, 0.0f, 1.0f, 0.0f);
+				return;
+				}
+
 	        M3DMatrix44f rotMat;
 
 			// Just Rotate around the up vector
@@ -247,12 +310,18 @@ class GLFrame
 			newVect[1] = rotMat[1] * vForward[0] + rotMat[5] * vForward[1] + rotMat[9] *  vForward[2];	
 			newVect[2] = rotMat[2] * vForward[0] + rotMat[6] * vForward[1] + rotMat[10] * vForward[2];	
 			m3dCopyVector3(vForward, newVect);
+			OrientationChanged();
 			}
 
 
 		// Rotate around local Z
         void RotateLocalZ(float fAngle)
 			{
+			if(bQuaternionMode) {
+				RotateQuaternionLocal(fAngle, 0.0f, 0.0f, 1.0f);
+				return;
+				}
+
 			M3DMatrix44f rotMat;
 
 			// Only the up vector needs to be rotated
@@ -264,10 +333,16 @@ class GLFrame
 			newVect[1] = rotMat[1] * vUp[0] + rotMat[5] * vUp[1] + rotMat[9] *  vUp[2];	
 			newVect[2] = rotMat[2] * vUp[0] + rotMat[6] * vUp[1] + rotMat[10] * vUp[2];	
 			m3dCopyVector3(vUp, newVect);
+			OrientationChanged();
 			}
 
 		void RotateLocalX(float fAngle)
 			{
+			if(bQuaternionMode) {
+				RotateQuaternionLocal(fAngle, 1.0f, 0.0f, 0.0f);
+				return;
+				}
+
 			M3DMatrix33f rotMat;
 			M3DVector3f  localX;
 			M3DVector3f  rotVec;
@@ -284,6 +359,7 @@ class GLFrame
 
 			m3dRotateVector(rotVec, vForward, rotMat);
 			m3dCopyVector3(vForward, rotVec);
+			OrientationChanged();
 			}
 
 
@@ -291,6 +367,13 @@ class GLFrame
 		// if the matrix is long-lived and frequently transformed.
 		void Normalize(void)
 			{
+			if(bQuaternionMode) {
+				SyncQuaternion();
+				m3dQuatNormalize(qOrientation);
+				UpdateVectors();
+				return;
+				}
+
 			M3DVector3f vCross;
 
 			// Calculate cross product of up and forward vectors
@@ -302,12 +385,23 @@ class GLFrame
 			// Also check for unit length...
 			m3dNormalizeVector3(vUp);
 			m3dNormalizeVector3(vForward);
+			OrientationChanged();
 			}
 
 
 		// Rotate in world coordinates...
 		void RotateWorld(float fAngle, float x, float y, float z)
 			{
+			if(bQuaternionMode) {
+				M3DQuaternionf qRot;
+				m3dQuatFromAxisAngle(qRot, fAngle, x, y, z);
+				SyncQuaternion();
+				m3dQuatMultiply(qOrientation, qRot, qOrientation);
+				m3dQuatNormalize(qOrientation);
+				UpdateVectors();
+				return;
+				}
+
             M3DMatrix44f rotMat;
 
 			// Create the Rotation matrix
@@ -326,12 +420,18 @@ class GLFrame
 			newVect[1] = rotMat[1] * vForward[0] + rotMat[5] * vForward[1] + rotMat[9] *  vForward[2];	
 			newVect[2] = rotMat[2] * vForward[0] + rotMat[6] * vForward[1] + rotMat[10] * vForward[2];	
 			m3dCopyVector3(vForward, newVect);
+			OrientationChanged();
             }
 
 
         // Rotate around a local axis
         void RotateLocal(float fAngle, float x, float y, float z) 
             {
+			if(bQuaternionMode) {
+				RotateQuaternionLocal(fAngle, x, y, z);
+				return;
+				}
+
             M3DVector3f vWorldVect;
 			M3DVector3f vLocalVect;
 			m3dLoadVector3(vLocalVect, x, y, z);
@@ -348,10 +448,8 @@ class GLFrame
 		// first, or use the conventions that "sounds" like the function...
         void LocalToWorld(const M3DVector3f vLocal, M3DVector3f vWorld, bool bRotOnly = false)
             {
-             // Create the rotation matrix based on the vectors
-			M3DMatrix44f rotMat;
-
-			GetMatrix(rotMat, true);
+			// The rotation part of the cached matrix
+			const M3DMatrix44f& rotMat = GetMatrix();
 
 			// Do the rotation (inline it, and remove 4th column...)
 			vWorld[0] = rotMat[0] * vLocal[0] + rotMat[4] * vLocal[1] + rotMat[8] *  vLocal[2];	
@@ -376,13 +474,9 @@ class GLFrame
             vNewWorld[1] = vWorld[1] - vOrigin[1];
             vNewWorld[2] = vWorld[2] - vOrigin[2];
 
-            // Create the rotation matrix based on the vectors
-			M3DMatrix44f rotMat;
-            M3DMatrix44f invMat;
-			GetMatrix(rotMat, true);
-
-			// Do the rotation based on inverted matrix
-            m3dInvertMatrix44(invMat, rotMat);
+			// Do the rotation based on the inverted matrix (its rotation part
+			// is the transpose of the frame's)
+            const M3DMatrix44f& invMat = GetInverseMatrix();
 
 			vLocal[0] = invMat[0] * vNewWorld[0] + invMat[4] * vNewWorld[1] + invMat[8] *  vNewWorld[2];	
 			vLocal[1] = invMat[1] * vNewWorld[0] + invMat[5] * vNewWorld[1] + invMat[9] *  vNewWorld[2];	
@@ -393,8 +487,7 @@ class GLFrame
         // Transform a point by frame matrix
         void TransformPoint(M3DVector3f vPointSrc, M3DVector3f vPointDst)
             {
-            M3DMatrix44f m;
-            GetMatrix(m, false);    // Rotate and translate
+            const M3DMatrix44f& m = GetMatrix();    // Rotate and translate
             vPointDst[0] = m[0] * vPointSrc[0] + m[4] * vPointSrc[1] + m[8] *  vPointSrc[2] + m[12];// * v[3];	 
             vPointDst[1] = m[1] * vPointSrc[0] + m[5] * vPointSrc[1] + m[9] *  vPointSrc[2] + m[13];// * v[3];	
             vPointDst[2] = m[2] * vPointSrc[0] + m[6] * vPointSrc[1] + m[10] * vPointSrc[2] + m[14];// * v[3];	
@@ -404,13 +497,74 @@ class GLFrame
         // Rotate a vector by frame matrix
         void RotateVector(M3DVector3f vVectorSrc, M3DVector3f vVectorDst)
             {
-            M3DMatrix44f m;
-            GetMatrix(m, true);    // Rotate only
+            const M3DMatrix44f& m = GetMatrix();    // Rotate only (the translation isn't read)
             
             vVectorDst[0] = m[0] * vVectorSrc[0] + m[4] * vVectorSrc[1] + m[8] *  vVectorSrc[2];	 
             vVectorDst[1] = m[1] * vVectorSrc[0] + m[5] * vVectorSrc[1] + m[9] *  vVectorSrc[2];	
             vVectorDst[2] = m[2] * vVectorSrc[0] + m[6] * vVectorSrc[1] + m[10] * vVectorSrc[2];	
             }
+
+	protected:
+		// Quaternion of the current vectors, orthonormalized first
+		void QuaternionFromVectors(M3DQuaternionf q) const {
+			M3DVector3f vX, vY, vZ;
+			m3dCrossProduct3(vX, vUp, vForward);
+			m3dCrossProduct3(vZ, vX, vUp);
+			m3dCopyVector3(vY, vUp);
+			m3dNormalizeVector3(vX);
+			m3dNormalizeVector3(vY);
+			m3dNormalizeVector3(vZ);
+			m3dQuatFromAxes(q, vX, vY, vZ);
+			}
+
+		// Pick up vectors set directly since the last rotation
+		inline void SyncQuaternion(void) {
+			if(bQuaternionStale) {
+				QuaternionFromVectors(qOrientation);
+				bQuaternionStale = false;
+				}
+			}
+
+		// Up and forward are the y and z columns of the rotation
+		inline void UpdateVectors(void) {
+			m3dQuatGetAxes((float *)NULL, vUp, vForward, qOrientation);
+			OrientationChanged();
+			}
+
+		// Cache upkeep. A clean matrix just takes the new origin.
+		inline void OriginChanged(void) {
+			if(!bMatrixDirty) {
+				mMatrix[12] = vOrigin[0];
+				mMatrix[13] = vOrigin[1];
+				mMatrix[14] = vOrigin[2];
+				}
+			bInverseDirty = true;
+			}
+
+		inline void OrientationChanged(void) {
+			bMatrixDirty = true;
+			bInverseDirty = true;
+			}
+
+		void BuildMatrix(void) {
+			// X column is up cross forward, then up, forward and the origin
+			m3dCrossProduct3(mMatrix, vUp, vForward);
+			mMatrix[3] = 0.0f;
+			mMatrix[4] = vUp[0]; mMatrix[5] = vUp[1]; mMatrix[6] = vUp[2]; mMatrix[7] = 0.0f;
+			mMatrix[8] = vForward[0]; mMatrix[9] = vForward[1]; mMatrix[10] = vForward[2]; mMatrix[11] = 0.0f;
+			mMatrix[12] = vOrigin[0]; mMatrix[13] = vOrigin[1]; mMatrix[14] = vOrigin[2]; mMatrix[15] = 1.0f;
+			bMatrixDirty = false;
+			}
+
+		// Rotation around an axis in frame coordinates applies on the right
+		void RotateQuaternionLocal(float fAngle, float x, float y, float z) {
+			M3DQuaternionf qRot;
+			m3dQuatFromAxisAngle(qRot, fAngle, x, y, z);
+			SyncQuaternion();
+			m3dQuatMultiply(qOrientation, qOrientation, qRot);
+			m3dQuatNormalize(qOrientation);
+			UpdateVectors();
+			}
         };
 
 
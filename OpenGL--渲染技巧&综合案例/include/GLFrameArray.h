@@ -0,0 +1,329 @@
+// GLFrameArray.h
+// Many frames at once.
+//
+// An array of GLFrame builds each matrix on its own: a cross product and four
+// column sets per frame, per call. GLFrameArray keeps the origins, forward
+// and up vectors as nine separate streams (x[], y[], z[] of each), so moving
+// or rotating a range of frames is a plain loop over floats, and GetMatrices
+// builds four matrices per step with SSE2, writing them one after another
+// into the caller's buffer. Optionally the matrices come out already
+// multiplied by a view matrix, ready to draw with.
+//
+// Long runs (GLT_FRAME_ARRAY_MIN_PER_THREAD frames per core or more) are
+// split across cores with gltParallelFor. Every path gives the same result
+// as GLFrame::GetMatrix followed by m3dMatrixMultiply44.
+
+#ifndef __GL_FRAME_ARRAY
+#define __GL_FRAME_ARRAY
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "math3dTypes.h"
+#include "GLFrame.h"
+#include "GLParallel.h"
+#include <vector>
+
+#define GLT_FRAME_ARRAY_MIN_PER_THREAD	8192
+
+// Stream order: origin x y z, forward x y z, up x y z
+enum GLT_FRAME_STREAM { GLT_FRAME_ORIGIN = 0, GLT_FRAME_FORWARD = 3, GLT_FRAME_UP = 6 };
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels. s holds the nine streams, pOut gets 16 floats per frame from
+// iStart to iEnd. mView is NULL, or an affine matrix to put in front.
+inline void gltScalarFrameMatrices(float *pOut, const float * const *s, int iStart, int iEnd, const float *mView)
+	{
+	for(int i = iStart; i < iEnd; i++, pOut += 16) {
+		float ox = s[0][i], oy = s[1][i], oz = s[2][i];
+		float fx = s[3][i], fy = s[4][i], fz = s[5][i];
+		float ux = s[6][i], uy = s[7][i], uz = s[8][i];
+
+		// X axis is up cross forward, as GLFrame::GetMatrix
+		float xx = uy * fz - fy * uz;
+		float xy = -ux * fz + fx * uz;
+		float xz = ux * fy - fx * uy;
+
+		if(mView == NULL) {
+			pOut[0] = xx; pOut[1] = xy; pOut[2] = xz; pOut[3] = 0.0f;
+			pOut[4] = ux; pOut[5] = uy; pOut[6] = uz; pOut[7] = 0.0f;
+			pOut[8] = fx; pOut[9] = fy; pOut[10] = fz; pOut[11] = 0.0f;
+			pOut[12] = ox; pOut[13] = oy; pOut[14] = oz; pOut[15] = 1.0f;
+			continue;
+			}
+
+		const float *v = mView;
+		for(int r = 0; r < 3; r++) {
+			pOut[r] = v[r] * xx + v[4 + r] * xy + v[8 + r] * xz;
+			pOut[4 + r] = v[r] * ux + v[4 + r] * uy + v[8 + r] * uz;
+			pOut[8 + r] = v[r] * fx + v[4 + r] * fy + v[8 + r] * fz;
+			pOut[12 + r] = v[r] * ox + v[4 + r] * oy + v[8 + r] * oz + v[12 + r];
+			}
+		pOut[3] = pOut[7] = pOut[11] = 0.0f;
+		pOut[15] = 1.0f;
+		}
+	}
+
+#if defined(M3D_SIMD_X86)
+// Four frames' worth of one column (x, y, z across the frames, w the same
+// for all) to four matrices
+M3D_TARGET_SSE2 inline void gltSSE2StoreColumns(float *pOut, __m128 x, __m128 y, __m128 z, __m128 w)
+	{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(pOut, x);
+	_mm_storeu_ps(pOut + 16, y);
+	_mm_storeu_ps(pOut + 32, z);
+	_mm_storeu_ps(pOut + 48, w);
+	}
+
+M3D_TARGET_SSE2 inline __m128 gltSSE2Rotate3(const __m128 *v, int r, __m128 x, __m128 y, __m128 z)
+	{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[r], x), _mm_mul_ps(v[4 + r], y)), _mm_mul_ps(v[8 + r], z));
+	}
+
+M3D_TARGET_SSE2 inline void gltSSE2FrameMatrices(float *pOut, const float * const *s, int iStart, int iEnd, const float *mView)
+	{
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 v[16];
+	if(mView != NULL)
+		for(int j = 0; j < 16; j++)
+			v[j] = _mm_set1_ps(mView[j]);
+
+	int i = iStart;
+	for(; i + 4 <= iEnd; i += 4, pOut += 64) {
+		__m128 ox = _mm_loadu_ps(s[0] + i), oy = _mm_loadu_ps(s[1] + i), oz = _mm_loadu_ps(s[2] + i);
+		__m128 fx = _mm_loadu_ps(s[3] + i), fy = _mm_loadu_ps(s[4] + i), fz = _mm_loadu_ps(s[5] + i);
+		__m128 ux = _mm_loadu_ps(s[6] + i), uy = _mm_loadu_ps(s[7] + i), uz = _mm_loadu_ps(s[8] + i);
+
+		__m128 xx = _mm_sub_ps(_mm_mul_ps(uy, fz), _mm_mul_ps(fy, uz));
+		__m128 xy = _mm_add_ps(_mm_xor_ps(_mm_mul_ps(ux, fz), sign), _mm_mul_ps(fx, uz));
+		__m128 xz = _mm_sub_ps(_mm_mul_ps(ux, fy), _mm_mul_ps(fx, uy));
+
+		if(mView == NULL) {
+			gltSSE2StoreColumns(pOut, xx, xy, xz, zero);
+			gltSSE2StoreColumns(pOut + 4, ux, uy, uz, zero);
+			gltSSE2StoreColumns(pOut + 8, fx, fy, fz, zero);
+			gltSSE2StoreColumns(pOut + 12, ox, oy, oz, one);
+			continue;
+			}
+
+		gltSSE2StoreColumns(pOut, gltSSE2Rotate3(v, 0, xx, xy, xz), gltSSE2Rotate3(v, 1, xx, xy, xz),
+							gltSSE2Rotate3(v, 2, xx, xy, xz), zero);
+		gltSSE2StoreColumns(pOut + 4, gltSSE2Rotate3(v, 0, ux, uy, uz), gltSSE2Rotate3(v, 1, ux, uy, uz),
+							gltSSE2Rotate3(v, 2, ux, uy, uz), zero);
+		gltSSE2StoreColumns(pOut + 8, gltSSE2Rotate3(v, 0, fx, fy, fz), gltSSE2Rotate3(v, 1, fx, fy, fz),
+							gltSSE2Rotate3(v, 2, fx, fy, fz), zero);
+		gltSSE2StoreColumns(pOut + 12, _mm_add_ps(gltSSE2Rotate3(v, 0, ox, oy, oz), v[12]),
+							_mm_add_ps(gltSSE2Rotate3(v, 1, ox, oy, oz), v[13]),
+							_mm_add_ps(gltSSE2Rotate3(v, 2, ox, oy, oz), v[14]), one);
+		}
+
+	gltScalarFrameMatrices(pOut, s, i, iEnd, mView);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLFrameArray
+	{
+	public:
+		GLFrameArray(void) : nCount(0) {}
+
+		void Clear(void) {
+			nCount = 0;
+			for(int c = 0; c < 9; c++)
+				stream[c].clear();
+			}
+
+		inline int GetCount(void) const { return nCount; }
+
+		// Room for nFrames without reallocating
+		void Reserve(int nFrames) {
+			for(int c = 0; c < 9; c++)
+				stream[c].reserve(nFrames);
+			}
+
+		// Returns the new frame's index
+		int Add(const M3DVector3f vOrigin, const M3DVector3f vForward, const M3DVector3f vUp) {
+			for(int c = 0; c < 3; c++) {
+				stream[GLT_FRAME_ORIGIN + c].push_back(vOrigin[c]);
+				stream[GLT_FRAME_FORWARD + c].push_back(vForward[c]);
+				stream[GLT_FRAME_UP + c].push_back(vUp[c]);
+				}
+			return nCount++;
+			}
+
+		int Add(GLFrame& frame) {
+			M3DVector3f vOrigin, vForward, vUp;
+			frame.GetOrigin(vOrigin);
+			frame.GetForwardVector(vForward);
+			frame.GetUpVector(vUp);
+			return Add(vOrigin, vForward, vUp);
+			}
+
+		// nFrames default frames (GLFrame's), returning the first index
+		int Add(int nFrames) {
+			GLFrame frame;
+			int iFirst = nCount;
+			for(int i = 0; i < nFrames; i++)
+				Add(frame);
+			return iFirst;
+			}
+
+		void SetFrame(int i, GLFrame& frame) {
+			M3DVector3f vOrigin, vForward, vUp;
+			frame.GetOrigin(vOrigin);
+			frame.GetForwardVector(vForward);
+			frame.GetUpVector(vUp);
+			for(int c = 0; c < 3; c++) {
+				stream[GLT_FRAME_ORIGIN + c][i] = vOrigin[c];
+				stream[GLT_FRAME_FORWARD + c][i] = vForward[c];
+				stream[GLT_FRAME_UP + c][i] = vUp[c];
+				}
+			}
+
+		void GetFrame(int i, GLFrame& frame) const {
+			frame.SetOrigin(stream[0][i], stream[1][i], stream[2][i]);
+			frame.SetForwardVector(stream[3][i], stream[4][i], stream[5][i]);
+			frame.SetUpVector(stream[6][i], stream[7][i], stream[8][i]);
+			}
+
+		inline void SetOrigin(int i, float x, float y, float z) {
+			stream[0][i] = x; stream[1][i] = y; stream[2][i] = z; }
+
+		inline void GetOrigin(int i, M3DVector3f vPoint) const {
+			vPoint[0] = stream[0][i]; vPoint[1] = stream[1][i]; vPoint[2] = stream[2][i]; }
+
+		// Direct access to one stream (GLT_FRAME_STREAM + 0, 1 or 2 for x, y, z)
+		inline float *GetStream(int iStream) { return stream[iStream].empty() ? NULL : &stream[iStream][0]; }
+		inline const float *GetStream(int iStream) const { return stream[iStream].empty() ? NULL : &stream[iStream][0]; }
+
+
+		/////////////////////////////////////////////////////////////
+		// Bulk updates over nFrames frames from iFirst (-1 for all of them
+		// from iFirst on). They do what the GLFrame call of the same name does
+		// to each frame.
+		void TranslateWorld(float x, float y, float z, int iFirst = 0, int nFrames = -1) {
+			int iEnd = RangeEnd(iFirst, nFrames);
+			if(iEnd <= iFirst)
+				return;
+
+			float *o[3] = { Stream(0), Stream(1), Stream(2) };
+			for(int i = iFirst; i < iEnd; i++) {
+				o[0][i] += x;
+				o[1][i] += y;
+				o[2][i] += z;
+				}
+			}
+
+		void MoveForward(float fDelta, int iFirst = 0, int nFrames = -1) { MoveAlong(GLT_FRAME_FORWARD, fDelta, iFirst, nFrames); }
+		void MoveUp(float fDelta, int iFirst = 0, int nFrames = -1) { MoveAlong(GLT_FRAME_UP, fDelta, iFirst, nFrames); }
+
+		void RotateWorld(float fAngle, float x, float y, float z, int iFirst = 0, int nFrames = -1) {
+			int iEnd = RangeEnd(iFirst, nFrames);
+			if(iEnd <= iFirst)
+				return;
+
+			M3DMatrix44f r;
+			m3dRotationMatrix44(r, fAngle, x, y, z);
+
+			for(int v = GLT_FRAME_FORWARD; v <= GLT_FRAME_UP; v += 3) {
+				float *px = Stream(v), *py = Stream(v + 1), *pz = Stream(v + 2);
+				for(int i = iFirst; i < iEnd; i++) {
+					float vx = px[i], vy = py[i], vz = pz[i];
+					px[i] = r[0] * vx + r[4] * vy + r[8] * vz;
+					py[i] = r[1] * vx + r[5] * vy + r[9] * vz;
+					pz[i] = r[2] * vx + r[6] * vy + r[10] * vz;
+					}
+				}
+			}
+
+		// As GLFrame::Normalize, for frames that are rotated a lot
+		void Normalize(int iFirst = 0, int nFrames = -1) {
+			int iEnd = RangeEnd(iFirst, nFrames);
+			for(int i = iFirst; i < iEnd; i++) {
+				M3DVector3f vForward = { stream[3][i], stream[4][i], stream[5][i] };
+				M3DVector3f vUp = { stream[6][i], stream[7][i], stream[8][i] };
+				M3DVector3f vCross;
+				m3dCrossProduct3(vCross, vUp, vForward);
+				m3dCrossProduct3(vForward, vCross, vUp);
+				m3dNormalizeVector3(vUp);
+				m3dNormalizeVector3(vForward);
+				for(int c = 0; c < 3; c++) {
+					stream[GLT_FRAME_FORWARD + c][i] = vForward[c];
+					stream[GLT_FRAME_UP + c][i] = vUp[c];
+					}
+				}
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Model matrices of nFrames frames from iFirst, one after another in
+		// pMatrices. With mView they come out as mView * model; a projective
+		// mView is multiplied in frame by frame.
+		void GetMatrices(M3DMatrix44f *pMatrices, int iFirst = 0, int nFrames = -1, const float *mView = NULL) const {
+			int iEnd = RangeEnd(iFirst, nFrames);
+			if(iEnd <= iFirst)
+				return;
+
+			if(mView != NULL && m3dClassifyMatrix44Quick(mView) == M3D_MATRIX_PROJECTIVE) {
+				GetMatrices(pMatrices, iFirst, iEnd - iFirst);
+				for(int i = 0; i < iEnd - iFirst; i++) {
+					M3DMatrix44f mModel;
+					m3dCopyMatrix44(mModel, pMatrices[i]);
+					m3dMatrixMultiply44(pMatrices[i], mView, mModel);
+					}
+				return;
+				}
+
+			const float *s[9];
+			for(int c = 0; c < 9; c++)
+				s[c] = &stream[c][0];
+
+			gltParallelFor(iEnd - iFirst, GLT_FRAME_ARRAY_MIN_PER_THREAD, [&](int iBegin, int iStop, int) {
+				float *pOut = pMatrices[iBegin];
+#if defined(M3D_SIMD_X86)
+				if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+					gltSSE2FrameMatrices(pOut, s, iFirst + iBegin, iFirst + iStop, mView);
+				else
+#endif
+					gltScalarFrameMatrices(pOut, s, iFirst + iBegin, iFirst + iStop, mView);
+				});
+			}
+
+		// One frame's model matrix, as GLFrame::GetMatrix
+		void GetMatrix(int i, M3DMatrix44f m) const {
+			const float *s[9];
+			for(int c = 0; c < 9; c++)
+				s[c] = &stream[c][0];
+			gltScalarFrameMatrices(m, s, i, i + 1, NULL);
+			}
+
+	protected:
+		inline int RangeEnd(int iFirst, int nFrames) const {
+			return (nFrames < 0 || iFirst + nFrames > nCount) ? nCount : iFirst + nFrames;
+			}
+
+		inline float *Stream(int c) { return &stream[c][0]; }
+
+		void MoveAlong(int iAxis, float fDelta, int iFirst, int nFrames) {
+			int iEnd = RangeEnd(iFirst, nFrames);
+			if(iEnd <= iFirst)
+				return;
+
+			float *o[3] = { Stream(0), Stream(1), Stream(2) };
+			const float *d[3] = { Stream(iAxis), Stream(iAxis + 1), Stream(iAxis + 2) };
+			for(int i = iFirst; i < iEnd; i++) {
+				o[0][i] += d[0][i] * fDelta;
+				o[1][i] += d[1][i] * fDelta;
+				o[2][i] += d[2][i] * fDelta;
+				}
+			}
+
+		int nCount;
+		std::vector<float> stream[9];
+	};
+
+#endif
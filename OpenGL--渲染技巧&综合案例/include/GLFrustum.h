@@ -30,12 +30,170 @@ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
 ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "math3d.h"
+#include "math3dSIMD.h"
 #include "GLFrame.h"
+#include <string.h>
 
 #ifndef __GL_FRAME_CLASS
 #define __GL_FRAME_CLASS
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Batch culling. TestSpheres and TestAABBs take the bounds as separate x[],
+// y[], z[] streams and set one bit per object that may be visible. Objects
+// go in groups of eight, one byte of the mask each: every plane is tested
+// against the whole group and the group stops once all eight are out.
+//
+// The planes in a bit mask (1 << GLT_FRUSTUM_NEAR and so on) can be left out
+// when the caller knows the objects are inside them, as the hierarchical
+// TestSphere and TestAABB report for a parent's bounds. An optional byte per
+// group remembers the plane that last rejected it; that plane is tried first
+// next time, and objects that stay out usually take one plane to cull.
+//
+// The order the planes are tried in doesn't change the result, and the
+// scalar, SSE2 and AVX2 paths do the same float operations, so they set the
+// same bits. The instruction set follows m3dSIMDGetLevel().
+enum GLT_FRUSTUM_PLANE { GLT_FRUSTUM_NEAR = 0, GLT_FRUSTUM_FAR, GLT_FRUSTUM_LEFT,
+						 GLT_FRUSTUM_RIGHT, GLT_FRUSTUM_BOTTOM, GLT_FRUSTUM_TOP, GLT_FRUSTUM_PLANES };
+
+#define GLT_FRUSTUM_ALL_PLANES		0x3F
+#define GLT_FRUSTUM_GROUP			8		// Objects per byte of the visibility mask
+#define GLT_FRUSTUM_NO_PLANE		0xFF	// Plane cache entry with nothing to try first
+
+// One plane as the kernels see it. For boxes x, y and z point at the min or
+// max stream, whichever is further along the normal.
+struct GLFrustumCullPlane
+	{
+	const float *x, *y, *z;
+	float a, b, c, d;
+	};
+
+// Words of visibility mask for nCount objects
+inline int gltFrustumMaskWords(int nCount) { return (nCount + 31) / 32; }
+
+// Bytes of plane cache for nCount objects
+inline int gltFrustumCacheBytes(int nCount) { return (nCount + GLT_FRUSTUM_GROUP - 1) / GLT_FRUSTUM_GROUP; }
+
+// Next plane for a group: the cached one first, then the rest in order
+inline int gltFrustumNextPlane(int k, int iFirst, GLuint nPlaneMask)
+	{
+	for(; k < GLT_FRUSTUM_PLANES; k++) {
+		int p = (k < 0) ? iFirst : k;
+		if(p >= 0 && (k < 0 || p != iFirst) && (nPlaneMask & (1u << p)))
+			return k;
+		}
+	return k;
+	}
+
+// The same steps as the SIMD kernels, a plane at a time over the group
+inline void gltScalarCullGroups(GLuint *pVisible, const GLFrustumCullPlane *planes, const float *r,
+								GLuint nPlaneMask, unsigned char *pLastPlane, int iGroupBegin, int iGroupEnd, int nCount)
+	{
+	for(int g = iGroupBegin; g < iGroupEnd; g++) {
+		int iBase = g * GLT_FRUSTUM_GROUP;
+		int n = (nCount - iBase < GLT_FRUSTUM_GROUP) ? nCount - iBase : GLT_FRUSTUM_GROUP;
+		GLuint visible = (1u << n) - 1;
+		int iFirst = (pLastPlane != NULL && pLastPlane[g] < GLT_FRUSTUM_PLANES) ? pLastPlane[g] : -1;
+
+		for(int k = gltFrustumNextPlane(-1, iFirst, nPlaneMask); k < GLT_FRUSTUM_PLANES; k = gltFrustumNextPlane(k + 1, iFirst, nPlaneMask)) {
+			int p = (k < 0) ? iFirst : k;
+			const float *x = planes[p].x + iBase, *y = planes[p].y + iBase, *z = planes[p].z + iBase;
+			float a = planes[p].a, b = planes[p].b, c = planes[p].c, d = planes[p].d;
+			GLuint out = 0;
+			for(int j = 0; j < n; j++) {
+				float fDist = x[j] * a + y[j] * b + z[j] * c + d;
+				if(r != NULL)
+					fDist = fDist + r[iBase + j];
+				out |= GLuint(fDist <= 0.0f) << j;
+				}
+
+			visible &= ~out;
+			if(visible == 0) {
+				if(pLastPlane != NULL)
+					pLastPlane[g] = (unsigned char)p;
+				break;
+				}
+			}
+
+		pVisible[g >> 2] |= visible << ((g & 3) * 8);
+		}
+	}
+
+
+#if defined(M3D_SIMD_X86)
+// Whole groups only
+M3D_TARGET_SSE2 inline void gltSSE2CullGroups(GLuint *pVisible, const GLFrustumCullPlane *planes, const float *r,
+											  GLuint nPlaneMask, unsigned char *pLastPlane, int iGroupBegin, int iGroupEnd)
+	{
+	__m128 zero = _mm_setzero_ps();
+	for(int g = iGroupBegin; g < iGroupEnd; g++) {
+		int iBase = g * GLT_FRUSTUM_GROUP;
+		GLuint visible = 0xFF;
+		int iFirst = (pLastPlane != NULL && pLastPlane[g] < GLT_FRUSTUM_PLANES) ? pLastPlane[g] : -1;
+
+		for(int k = gltFrustumNextPlane(-1, iFirst, nPlaneMask); k < GLT_FRUSTUM_PLANES; k = gltFrustumNextPlane(k + 1, iFirst, nPlaneMask)) {
+			int p = (k < 0) ? iFirst : k;
+			const GLFrustumCullPlane& pl = planes[p];
+			__m128 a = _mm_set1_ps(pl.a), b = _mm_set1_ps(pl.b), c = _mm_set1_ps(pl.c), d = _mm_set1_ps(pl.d);
+
+			__m128 lo = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pl.x + iBase), a),
+														 _mm_mul_ps(_mm_loadu_ps(pl.y + iBase), b)),
+											  _mm_mul_ps(_mm_loadu_ps(pl.z + iBase), c)), d);
+			__m128 hi = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pl.x + iBase + 4), a),
+														 _mm_mul_ps(_mm_loadu_ps(pl.y + iBase + 4), b)),
+											  _mm_mul_ps(_mm_loadu_ps(pl.z + iBase + 4), c)), d);
+			if(r != NULL) {
+				lo = _mm_add_ps(lo, _mm_loadu_ps(r + iBase));
+				hi = _mm_add_ps(hi, _mm_loadu_ps(r + iBase + 4));
+				}
+
+			GLuint out = GLuint(_mm_movemask_ps(_mm_cmple_ps(lo, zero))) | (GLuint(_mm_movemask_ps(_mm_cmple_ps(hi, zero))) << 4);
+			visible &= ~out;
+			if(visible == 0) {
+				if(pLastPlane != NULL)
+					pLastPlane[g] = (unsigned char)p;
+				break;
+				}
+			}
+
+		pVisible[g >> 2] |= visible << ((g & 3) * 8);
+		}
+	}
+
+M3D_TARGET_AVX2 inline void gltAVX2CullGroups(GLuint *pVisible, const GLFrustumCullPlane *planes, const float *r,
+											  GLuint nPlaneMask, unsigned char *pLastPlane, int iGroupBegin, int iGroupEnd)
+	{
+	__m256 zero = _mm256_setzero_ps();
+	for(int g = iGroupBegin; g < iGroupEnd; g++) {
+		int iBase = g * GLT_FRUSTUM_GROUP;
+		GLuint visible = 0xFF;
+		int iFirst = (pLastPlane != NULL && pLastPlane[g] < GLT_FRUSTUM_PLANES) ? pLastPlane[g] : -1;
+
+		for(int k = gltFrustumNextPlane(-1, iFirst, nPlaneMask); k < GLT_FRUSTUM_PLANES; k = gltFrustumNextPlane(k + 1, iFirst, nPlaneMask)) {
+			int p = (k < 0) ? iFirst : k;
+			const GLFrustumCullPlane& pl = planes[p];
+
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(pl.x + iBase), _mm256_set1_ps(pl.a)),
+																	_mm256_mul_ps(_mm256_loadu_ps(pl.y + iBase), _mm256_set1_ps(pl.b))),
+													  _mm256_mul_ps(_mm256_loadu_ps(pl.z + iBase), _mm256_set1_ps(pl.c))),
+										_mm256_set1_ps(pl.d));
+			if(r != NULL)
+				dist = _mm256_add_ps(dist, _mm256_loadu_ps(r + iBase));
+
+			visible &= ~GLuint(_mm256_movemask_ps(_mm256_cmp_ps(dist, zero, _CMP_LE_OQ)));
+			if(visible == 0) {
+				if(pLastPlane != NULL)
+					pLastPlane[g] = (unsigned char)p;
+				break;
+				}
+			}
+
+		pVisible[g >> 2] |= visible << ((g & 3) * 8);
+		}
+	}
+#endif
+
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -53,7 +211,7 @@ class GLFrustum
 			{ SetOrthographic(xMin, xMax, yMin, yMax, zMin, zMax); }
 
 		// Get the projection matrix for this guy
-		const M3DMatrix44f& GetProjectionMatrix(void) { return projMatrix; }
+		const M3DMatrix44f& GetProjectionMatrix(void) const { return projMatrix; }
 
         // Calculates the corners of the Frustum and sets the projection matrix.
 		// Orthographics Matrix Projection    
@@ -196,38 +354,57 @@ class GLFrustum
             rotMat[14] = vOrigin[2];
             rotMat[15] = 1.0f;
 
-            ////////////////////////////////////////////////////
-            // Transform the frustum corners
-            m3dTransformVector4(nearULT, nearUL, rotMat);
-            m3dTransformVector4(nearLLT, nearLL, rotMat);
-            m3dTransformVector4(nearURT, nearUR, rotMat);
-            m3dTransformVector4(nearLRT, nearLR, rotMat);
-            m3dTransformVector4(farULT, farUL, rotMat);
-            m3dTransformVector4(farLLT, farLL, rotMat);
-            m3dTransformVector4(farURT, farUR, rotMat);
-            m3dTransformVector4(farLRT, farLR, rotMat);
+            TransformCorners(rotMat);
+            }
 
-            ////////////////////////////////////////////////////
-            // Derive Plane Equations from points... Points given in
-            // counter clockwise order to make normals point inside 
-            // the Frustum
-            // Near and Far Planes
-            m3dGetPlaneEquation(nearPlane, nearULT, nearLLT, nearLRT);
-            m3dGetPlaneEquation(farPlane, farULT, farURT, farLRT);
-            
-            // Top and Bottom Planes
-            m3dGetPlaneEquation(topPlane, nearULT, nearURT, farURT);
-            m3dGetPlaneEquation(bottomPlane, nearLLT, farLLT, farLRT);
 
-            // Left and right planes
-            m3dGetPlaneEquation(leftPlane, nearLLT, nearULT, farULT);
-            m3dGetPlaneEquation(rightPlane, nearLRT, farLRT, farURT);
+        // Same as above, but starting from a camera matrix such as the one
+        // GLFrame::GetCameraMatrix() returns. The camera matrix is the inverse of
+        // the matrix we need, and since it is a pure rotation and translation,
+        // getting back is just a transpose.
+        void Transform(const M3DMatrix44f mCamera)
+            {
+            M3DMatrix44f rotMat;
+            m3dInvertRigid44(rotMat, mCamera);
+            TransformCorners(rotMat);
+            }
+
+
+        // Planes straight from a matrix that takes points to clip space
+        // (Gribb and Hartmann). Projection times view, as from
+        // GLGeometryTransform::GetViewProjectionMatrix(), gives world space
+        // planes; the projection alone gives eye space ones. Any projection
+        // works, mirrored and off axis ones included, and no GLFrame is
+        // needed. The corner points are left as they were.
+        void ExtractPlanes(const M3DMatrix44f mClip)
+            {
+            // Inside is -w <= x, y, z <= w, each side a row of the matrix
+            // added to or taken from the w row
+            ExtractPlane(leftPlane, mClip, 0, 1.0f);
+            ExtractPlane(rightPlane, mClip, 0, -1.0f);
+            ExtractPlane(bottomPlane, mClip, 1, 1.0f);
+            ExtractPlane(topPlane, mClip, 1, -1.0f);
+            ExtractPlane(nearPlane, mClip, 2, 1.0f);
+            ExtractPlane(farPlane, mClip, 2, -1.0f);
+            }
+
+        // The same, with the sides narrowed to a window of the screen in
+        // normalized device coordinates (-1 to 1), as for something seen
+        // only through a portal or a mirror covering that part of the view.
+        void ExtractPlanes(const M3DMatrix44f mClip, float fLeft, float fRight, float fBottom, float fTop)
+            {
+            ExtractPlane(leftPlane, mClip, 0, 1.0f, -fLeft);
+            ExtractPlane(rightPlane, mClip, 0, -1.0f, fRight);
+            ExtractPlane(bottomPlane, mClip, 1, 1.0f, -fBottom);
+            ExtractPlane(topPlane, mClip, 1, -1.0f, fTop);
+            ExtractPlane(nearPlane, mClip, 2, 1.0f);
+            ExtractPlane(farPlane, mClip, 2, -1.0f);
             }
 
         
 
         // Allow expanded version of sphere test
-        bool TestSphere(float x, float y, float z, float fRadius)
+        bool TestSphere(float x, float y, float z, float fRadius) const
             {
             M3DVector3f vPoint;
             vPoint[0] = x;
@@ -244,7 +421,7 @@ class GLFrustum
         // zero in this case.
         // Returns false if it is not in the frustum, true if it intersects
         // the Frustum.
-        bool TestSphere(M3DVector3f vPoint, float fRadius)
+        bool TestSphere(M3DVector3f vPoint, float fRadius) const
             {
             float fDist;
 
@@ -277,7 +454,185 @@ class GLFrustum
             return true;
             }
 
+        // Hierarchical form. Only the planes set in nPlaneMask are tested,
+        // and the ones the sphere is wholly inside are cleared from it, so
+        // whatever the sphere bounds needn't test them again.
+        bool TestSphere(const M3DVector3f vPoint, float fRadius, GLuint& nPlaneMask) const
+            {
+            const float *pPlanes[GLT_FRUSTUM_PLANES];
+            GetPlanes(pPlanes);
+
+            for(int p = 0; p < GLT_FRUSTUM_PLANES; p++) {
+                if(!(nPlaneMask & (1u << p)))
+                    continue;
+
+                float fDist = m3dGetDistanceToPlane(vPoint, pPlanes[p]);
+                if(fDist + fRadius <= 0.0f)
+                    return false;
+                if(fDist > fRadius)
+                    nPlaneMask &= ~(1u << p);
+                }
+            return true;
+            }
+
+        // Axis aligned box, tested at the corner furthest along each plane's
+        // normal. False if it is outside the frustum.
+        bool TestAABB(const M3DVector3f vMin, const M3DVector3f vMax) const
+            {
+            GLuint nPlaneMask = GLT_FRUSTUM_ALL_PLANES;
+            return TestAABB(vMin, vMax, nPlaneMask);
+            }
+
+        // Hierarchical form, as for TestSphere. A plane is cleared once the
+        // nearest corner is inside it too.
+        bool TestAABB(const M3DVector3f vMin, const M3DVector3f vMax, GLuint& nPlaneMask) const
+            {
+            const float *pPlanes[GLT_FRUSTUM_PLANES];
+            GetPlanes(pPlanes);
+
+            for(int p = 0; p < GLT_FRUSTUM_PLANES; p++) {
+                if(!(nPlaneMask & (1u << p)))
+                    continue;
+
+                const float *pl = pPlanes[p];
+                M3DVector3f vFar, vNear;
+                for(int i = 0; i < 3; i++) {
+                    vFar[i] = (pl[i] >= 0.0f) ? vMax[i] : vMin[i];
+                    vNear[i] = (pl[i] >= 0.0f) ? vMin[i] : vMax[i];
+                    }
+
+                if(m3dGetDistanceToPlane(vFar, pl) <= 0.0f)
+                    return false;
+                if(m3dGetDistanceToPlane(vNear, pl) > 0.0f)
+                    nPlaneMask &= ~(1u << p);
+                }
+            return true;
+            }
+
+        // Many spheres at once. pVisible needs gltFrustumMaskWords(nCount)
+        // words and pLastPlane, if used, gltFrustumCacheBytes(nCount) bytes
+        // (start them at GLT_FRUSTUM_NO_PLANE).
+        void TestSpheres(const float *x, const float *y, const float *z, const float *r, int nCount,
+                         GLuint *pVisible, GLuint nPlaneMask = GLT_FRUSTUM_ALL_PLANES, unsigned char *pLastPlane = NULL) const
+            {
+            const float *pPlanes[GLT_FRUSTUM_PLANES];
+            GetPlanes(pPlanes);
+
+            GLFrustumCullPlane planes[GLT_FRUSTUM_PLANES];
+            for(int p = 0; p < GLT_FRUSTUM_PLANES; p++) {
+                planes[p].x = x; planes[p].y = y; planes[p].z = z;
+                planes[p].a = pPlanes[p][0]; planes[p].b = pPlanes[p][1];
+                planes[p].c = pPlanes[p][2]; planes[p].d = pPlanes[p][3];
+                }
+            CullGroups(pVisible, planes, r, nPlaneMask, pLastPlane, nCount);
+            }
+
+        // Many axis aligned boxes at once, as for TestSpheres
+        void TestAABBs(const float *minX, const float *minY, const float *minZ,
+                       const float *maxX, const float *maxY, const float *maxZ, int nCount,
+                       GLuint *pVisible, GLuint nPlaneMask = GLT_FRUSTUM_ALL_PLANES, unsigned char *pLastPlane = NULL) const
+            {
+            const float *pPlanes[GLT_FRUSTUM_PLANES];
+            GetPlanes(pPlanes);
+
+            GLFrustumCullPlane planes[GLT_FRUSTUM_PLANES];
+            for(int p = 0; p < GLT_FRUSTUM_PLANES; p++) {
+                planes[p].x = (pPlanes[p][0] >= 0.0f) ? maxX : minX;
+                planes[p].y = (pPlanes[p][1] >= 0.0f) ? maxY : minY;
+                planes[p].z = (pPlanes[p][2] >= 0.0f) ? maxZ : minZ;
+                planes[p].a = pPlanes[p][0]; planes[p].b = pPlanes[p][1];
+                planes[p].c = pPlanes[p][2]; planes[p].d = pPlanes[p][3];
+                }
+            CullGroups(pVisible, planes, NULL, nPlaneMask, pLastPlane, nCount);
+            }
+
     protected:
+        // w row (times fW, for a side at fW rather than 1) plus or minus
+        // another, scaled to a unit normal. An infinite far plane has no
+        // normal and is made one everything is inside.
+        static void ExtractPlane(M3DVector4f vPlane, const M3DMatrix44f m, int iRow, float fSign, float fW = 1.0f)
+            {
+            for(int j = 0; j < 4; j++)
+                vPlane[j] = fW * m[j * 4 + 3] + fSign * m[j * 4 + iRow];
+
+            float fLength = m3dGetVectorLength3(vPlane);
+            if(fLength > 0.0f) {
+                float fScale = 1.0f / fLength;
+                for(int j = 0; j < 4; j++)
+                    vPlane[j] *= fScale;
+                }
+            else {
+                vPlane[0] = vPlane[1] = vPlane[2] = 0.0f;
+                vPlane[3] = 1.0f;
+                }
+            }
+
+        // In GLT_FRUSTUM_PLANE order
+        inline void GetPlanes(const float *pPlanes[GLT_FRUSTUM_PLANES]) const
+            {
+            pPlanes[GLT_FRUSTUM_NEAR] = nearPlane;
+            pPlanes[GLT_FRUSTUM_FAR] = farPlane;
+            pPlanes[GLT_FRUSTUM_LEFT] = leftPlane;
+            pPlanes[GLT_FRUSTUM_RIGHT] = rightPlane;
+            pPlanes[GLT_FRUSTUM_BOTTOM] = bottomPlane;
+            pPlanes[GLT_FRUSTUM_TOP] = topPlane;
+            }
+
+        void CullGroups(GLuint *pVisible, const GLFrustumCullPlane *planes, const float *r,
+                        GLuint nPlaneMask, unsigned char *pLastPlane, int nCount) const
+            {
+            if(nCount <= 0)
+                return;
+
+            memset(pVisible, 0, sizeof(GLuint) * gltFrustumMaskWords(nCount));
+            int nGroups = gltFrustumCacheBytes(nCount);
+            int nWhole = 0;
+#if defined(M3D_SIMD_X86)
+            M3D_SIMD_LEVEL level = m3dSIMDGetLevel();
+            if(level >= M3D_SIMD_SSE2) {
+                nWhole = nCount / GLT_FRUSTUM_GROUP;
+                if(level >= M3D_SIMD_AVX2)
+                    gltAVX2CullGroups(pVisible, planes, r, nPlaneMask, pLastPlane, 0, nWhole);
+                else
+                    gltSSE2CullGroups(pVisible, planes, r, nPlaneMask, pLastPlane, 0, nWhole);
+                }
+#endif
+            gltScalarCullGroups(pVisible, planes, r, nPlaneMask, pLastPlane, nWhole, nGroups, nCount);
+            }
+
+        // Transform the frustum corners by the camera's frame matrix,
+        // then derive the plane equations
+        void TransformCorners(const M3DMatrix44f rotMat)
+            {
+            ////////////////////////////////////////////////////
+            // Transform the frustum corners
+            m3dTransformVector4(nearULT, nearUL, rotMat);
+            m3dTransformVector4(nearLLT, nearLL, rotMat);
+            m3dTransformVector4(nearURT, nearUR, rotMat);
+            m3dTransformVector4(nearLRT, nearLR, rotMat);
+            m3dTransformVector4(farULT, farUL, rotMat);
+            m3dTransformVector4(farLLT, farLL, rotMat);
+            m3dTransformVector4(farURT, farUR, rotMat);
+            m3dTransformVector4(farLRT, farLR, rotMat);
+
+            ////////////////////////////////////////////////////
+            // Derive Plane Equations from points... Points given in
+            // counter clockwise order to make normals point inside 
+            // the Frustum
+            // Near and Far Planes
+            m3dGetPlaneEquation(nearPlane, nearULT, nearLLT, nearLRT);
+            m3dGetPlaneEquation(farPlane, farULT, farURT, farLRT);
+            
+            // Top and Bottom Planes
+            m3dGetPlaneEquation(topPlane, nearULT, nearURT, farURT);
+            m3dGetPlaneEquation(bottomPlane, nearLLT, farLLT, farLRT);
+
+            // Left and right planes
+            m3dGetPlaneEquation(leftPlane, nearLLT, nearULT, farULT);
+            m3dGetPlaneEquation(rightPlane, nearLRT, farLRT, farURT);
+            }
+
+
 		// The projection matrix for this frustum
 		M3DMatrix44f projMatrix;	
 
@@ -33,24 +33,52 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 
 
 #include "GLTools.h"
+#include "math3dSIMD.h"
+#include <string.h>
 
+// How often each cached matrix was worked out or handed back as it was.
+// Reset once a frame to get per frame figures.
+struct GLTransformCounters
+	{
+	unsigned int	nMVPComputed, nMVPReused;
+	unsigned int	nViewProjectionComputed, nViewProjectionReused;
+	unsigned int	nNormalComputed, nNormalReused;
+	};
+
+// The model-view-projection, view-projection and normal matrices are kept
+// and only worked out again when the stack versions they came from (see
+// GLMatrixStack::GetVersion) or the view matrix have moved.
 class GLGeometryTransform
 	{
 	public:
-		GLGeometryTransform(void) {}
+		GLGeometryTransform(void) : _mModelView(NULL), _mProjection(NULL), _viewVersion(1) {
+			Invalidate();
+			ResetCounters();
+			m3dLoadIdentity44(_mView);
+			}
 
-		inline void SetModelViewMatrixStack(GLMatrixStack& mModelView) { _mModelView = &mModelView; }
+		inline void SetModelViewMatrixStack(GLMatrixStack& mModelView) { _mModelView = &mModelView; Invalidate(); }
 
-		inline void SetProjectionMatrixStack(GLMatrixStack& mProjection) { _mProjection = &mProjection; }
+		inline void SetProjectionMatrixStack(GLMatrixStack& mProjection) { _mProjection = &mProjection; Invalidate(); }
 
 		inline void SetMatrixStacks(GLMatrixStack& mModelView, GLMatrixStack& mProjection) {
 			_mModelView = &mModelView;
 			_mProjection = &mProjection;
+			Invalidate();
 			}
 
 		const M3DMatrix44f& GetModelViewProjectionMatrix(void)
 			{
-			m3dMatrixMultiply44(_mModelViewProjection, _mProjection->GetMatrix(), _mModelView->GetMatrix());
+			GLT_STACK_VERSION mv = _mModelView->GetVersion(), proj = _mProjection->GetVersion();
+			if(mv == _mvpModelViewVersion && proj == _mvpProjectionVersion) {
+				_counters.nMVPReused++;
+				return _mModelViewProjection;
+				}
+
+			m3dSIMDMatrixMultiply44(_mModelViewProjection, _mProjection->GetMatrix(), _mModelView->GetMatrix());
+			_mvpModelViewVersion = mv;
+			_mvpProjectionVersion = proj;
+			_counters.nMVPComputed++;
 			return _mModelViewProjection;
 			}
 
@@ -59,23 +87,86 @@ class GLGeometryTransform
 
 		const M3DMatrix33f& GetNormalMatrix(bool bNormalize = false)
 			{
+			GLT_STACK_VERSION mv = _mModelView->GetVersion();
+			if(mv == _normalModelViewVersion && bNormalize == _bNormalNormalized) {
+				_counters.nNormalReused++;
+				return _mNormalMatrix;
+				}
+
 			m3dExtractRotationMatrix33(_mNormalMatrix, GetModelViewMatrix());
 
-			if(bNormalize) {
+			// The columns of a rigid modelview are unit length already
+			if(bNormalize && _mModelView->GetMatrixKind() > M3D_MATRIX_RIGID) {
 				m3dNormalizeVector3(&_mNormalMatrix[0]);
 				m3dNormalizeVector3(&_mNormalMatrix[3]);
 				m3dNormalizeVector3(&_mNormalMatrix[6]);
 				}
 
+			_normalModelViewVersion = mv;
+			_bNormalNormalized = bNormalize;
+			_counters.nNormalComputed++;
 			return _mNormalMatrix;
 			}
 
+		// The camera (world to eye) matrix, for GetViewProjectionMatrix.
+		// Setting the same matrix again keeps the cached product.
+		void SetViewMatrix(const M3DMatrix44f mView)
+			{
+			if(memcmp(mView, _mView, sizeof(M3DMatrix44f)) != 0) {
+				m3dCopyMatrix44(_mView, mView);
+				_viewVersion++;
+				}
+			}
+
+		inline const M3DMatrix44f& GetViewMatrix(void) { return _mView; }
+
+		// Projection times view: world space straight to clip space, as
+		// frustum culling in world space wants
+		const M3DMatrix44f& GetViewProjectionMatrix(void)
+			{
+			GLT_STACK_VERSION proj = _mProjection->GetVersion();
+			if(_viewVersion == _vpViewVersion && proj == _vpProjectionVersion) {
+				_counters.nViewProjectionReused++;
+				return _mViewProjection;
+				}
+
+			m3dSIMDMatrixMultiply44(_mViewProjection, _mProjection->GetMatrix(), _mView);
+			_vpViewVersion = _viewVersion;
+			_vpProjectionVersion = proj;
+			_counters.nViewProjectionComputed++;
+			return _mViewProjection;
+			}
+
+		inline const GLTransformCounters& GetCounters(void) const { return _counters; }
+		inline void ResetCounters(void) { memset(&_counters, 0, sizeof(_counters)); }
+
+		// Forget every cached matrix
+		void Invalidate(void)
+			{
+			// Stack versions start at one, so zero never matches
+			_mvpModelViewVersion = _mvpProjectionVersion = 0;
+			_normalModelViewVersion = 0;
+			_bNormalNormalized = false;
+			_vpViewVersion = _vpProjectionVersion = 0;
+			}
+
 	protected:
 		M3DMatrix44f	_mModelViewProjection;
 		M3DMatrix33f	_mNormalMatrix;
+		M3DMatrix44f	_mView;
+		M3DMatrix44f	_mViewProjection;
 
 		GLMatrixStack*  _mModelView;
 		GLMatrixStack* _mProjection;
+
+		// Versions the cached matrices were made from
+		GLT_STACK_VERSION	_mvpModelViewVersion, _mvpProjectionVersion;
+		GLT_STACK_VERSION	_normalModelViewVersion;
+		bool				_bNormalNormalized;
+		GLT_STACK_VERSION	_viewVersion;
+		GLT_STACK_VERSION	_vpViewVersion, _vpProjectionVersion;
+
+		GLTransformCounters	_counters;
 };
 
 #endif
@@ -0,0 +1,322 @@
+// GLInterleavedBatch.h
+// A GLBatch that keeps all of a vertex's attributes together in one buffer.
+//
+// GLBatch gives every attribute its own buffer object (positions, normals,
+// colors and one per texture unit), so drawing reads up to 3 + N streams.
+// GLInterleavedBatch takes the same calls, Begin, the Copy*Data block copies
+// or the immediate mode emulation, then End, but collects them on the CPU
+// side. End packs each vertex tightly, position first and then whichever
+// of normal, color and texture coordinates were actually supplied, into a
+// single buffer object with one vertex array object over it. An attribute
+// that was never given takes no room.
+//
+// It can replace a GLBatch declaration as it is. Unlike GLBatch the data
+// stays in client memory until End, and no copy of it is kept afterwards.
+
+#ifndef __GL_INTERLEAVED_BATCH
+#define __GL_INTERLEAVED_BATCH
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLShaderManager.h"
+#include <string.h>
+#include <vector>
+
+#define GLT_INTERLEAVED_MAX_TEXTURES	4		// GLT_ATTRIBUTE_TEXTURE0 to 3
+
+class GLInterleavedBatch : public GLBatchBase
+	{
+	public:
+		GLInterleavedBatch(void) : primitiveType(GL_TRIANGLES), uiBuffer(0), vertexArrayObject(0), nNumVerts(0), nVertsBuilding(0),
+								   nNumTextureUnits(0), nStride(0), bBatchDone(false), iNormalOffset(-1), iColorOffset(-1) {
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				iTexCoordOffset[t] = -1;
+			}
+		virtual ~GLInterleavedBatch(void) { FreeBuffers(); }
+
+		// Start populating the array
+		void Begin(GLenum primitive, GLuint nVerts, GLuint nTextureUnits = 0) {
+			FreeBuffers();
+			primitiveType = primitive;
+			nNumVerts = nVerts;
+			nVertsBuilding = 0;
+			nNumTextureUnits = (nTextureUnits > GLT_INTERLEAVED_MAX_TEXTURES) ? GLT_INTERLEAVED_MAX_TEXTURES : nTextureUnits;
+			nStride = 0;
+			bBatchDone = false;
+
+			vVerts.assign(size_t(nVerts) * 3, 0.0f);
+			vNormals.clear();
+			vColors.clear();
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				vTexCoords[t].clear();
+			}
+
+		// Pack what was supplied into the buffer object
+		void End(void) {
+			if(bBatchDone)
+				return;
+
+			const GLfloat *pTexCoords[GLT_INTERLEAVED_MAX_TEXTURES];
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				pTexCoords[t] = vTexCoords[t].empty() ? NULL : &vTexCoords[t][0];
+			SetVertices(primitiveType, nNumVerts, vVerts.empty() ? NULL : &vVerts[0], vNormals.empty() ? NULL : &vNormals[0],
+						vColors.empty() ? NULL : &vColors[0], pTexCoords, nNumTextureUnits);
+			}
+
+		// The whole batch in one go, from an array per attribute (NULL for
+		// those not given; pVerts is needed). Replaces anything built or set
+		// before, and is uploaded once.
+		void SetVertices(GLenum primitive, GLuint nVerts, const GLfloat *pVerts, const GLfloat *pNormals, const GLfloat *pColors,
+						 const GLfloat *const *ppTexCoords = NULL, GLuint nTextureUnits = 0) {
+			FreeBuffers();
+			primitiveType = primitive;
+			nNumVerts = (pVerts != NULL) ? nVerts : 0;
+			nVertsBuilding = 0;
+			nNumTextureUnits = (nTextureUnits > GLT_INTERLEAVED_MAX_TEXTURES) ? GLT_INTERLEAVED_MAX_TEXTURES : nTextureUnits;
+
+			// Offsets in floats; -1 for attributes not given
+			nStride = 3;
+			iNormalOffset = (pNormals == NULL) ? -1 : Claim(3);
+			iColorOffset = (pColors == NULL) ? -1 : Claim(4);
+			for(GLuint t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				iTexCoordOffset[t] = (t >= nNumTextureUnits || ppTexCoords == NULL || ppTexCoords[t] == NULL) ? -1 : Claim(2);
+
+			// Left uninitialized, every float is written
+			GLfloat *pPacked = (nNumVerts != 0) ? new GLfloat[size_t(nNumVerts) * nStride] : NULL;
+			if(pPacked != NULL) {
+				Interleave(pPacked, nStride, pVerts, 3, nNumVerts);
+				if(iNormalOffset >= 0)
+					Interleave(pPacked + iNormalOffset, nStride, pNormals, 3, nNumVerts);
+				if(iColorOffset >= 0)
+					Interleave(pPacked + iColorOffset, nStride, pColors, 4, nNumVerts);
+				for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+					if(iTexCoordOffset[t] >= 0)
+						Interleave(pPacked + iTexCoordOffset[t], nStride, ppTexCoords[t], 2, nNumVerts);
+				}
+
+			glGenBuffers(1, &uiBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+			if(pPacked != NULL)
+				glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nNumVerts * nStride, pPacked, GL_STATIC_DRAW);
+			delete [] pPacked;
+
+#ifndef OPENGL_ES
+			glGenVertexArrays(1, &vertexArrayObject);
+			glBindVertexArray(vertexArrayObject);
+			SetAttributes();
+			glBindVertexArray(0);
+#endif
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			// The client side copies are done with
+			std::vector<GLfloat>().swap(vVerts);
+			std::vector<GLfloat>().swap(vNormals);
+			std::vector<GLfloat>().swap(vColors);
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				std::vector<GLfloat>().swap(vTexCoords[t]);
+			bBatchDone = true;
+			}
+
+		// Copy nVerts runs of nComponents floats from pIn, packed one after
+		// another, to every nStride floats of pOut
+		static void Interleave(GLfloat *pOut, GLuint nStride, const GLfloat *pIn, GLuint nComponents, GLuint nVerts) {
+			switch(nComponents) {
+				case 2:
+					for(GLuint v = 0; v < nVerts; v++, pOut += nStride, pIn += 2) {
+						pOut[0] = pIn[0]; pOut[1] = pIn[1];
+						}
+					break;
+				case 3:
+					for(GLuint v = 0; v < nVerts; v++, pOut += nStride, pIn += 3) {
+						pOut[0] = pIn[0]; pOut[1] = pIn[1]; pOut[2] = pIn[2];
+						}
+					break;
+				case 4:
+					for(GLuint v = 0; v < nVerts; v++, pOut += nStride, pIn += 4) {
+						pOut[0] = pIn[0]; pOut[1] = pIn[1]; pOut[2] = pIn[2]; pOut[3] = pIn[3];
+						}
+					break;
+				default:
+					for(GLuint v = 0; v < nVerts; v++, pOut += nStride, pIn += nComponents)
+						memcpy(pOut, pIn, sizeof(GLfloat) * nComponents);
+					break;
+				}
+			}
+
+		// Block Copy in vertex data
+		void CopyVertexData3f(M3DVector3f *vNewVerts) {
+			if(IsBuilding())
+				memcpy(&vVerts[0], vNewVerts, sizeof(M3DVector3f) * nNumVerts);
+			}
+		void CopyNormalDataf(M3DVector3f *vNewNorms) {
+			if(IsBuilding())
+				memcpy(Stream(vNormals, 3), vNewNorms, sizeof(M3DVector3f) * nNumVerts);
+			}
+		void CopyColorData4f(M3DVector4f *vNewColors) {
+			if(IsBuilding())
+				memcpy(Stream(vColors, 4), vNewColors, sizeof(M3DVector4f) * nNumVerts);
+			}
+		void CopyTexCoordData2f(M3DVector2f *vNewTexCoords, GLuint uiTextureLayer) {
+			if(IsBuilding() && uiTextureLayer < nNumTextureUnits)
+				memcpy(Stream(vTexCoords[uiTextureLayer], 2), vNewTexCoords, sizeof(M3DVector2f) * nNumVerts);
+			}
+
+		inline void CopyVertexData3f(GLfloat *vNewVerts) { CopyVertexData3f((M3DVector3f *)(vNewVerts)); }
+		inline void CopyNormalDataf(GLfloat *vNewNorms) { CopyNormalDataf((M3DVector3f *)(vNewNorms)); }
+		inline void CopyColorData4f(GLfloat *vNewColors) { CopyColorData4f((M3DVector4f *)(vNewColors)); }
+		inline void CopyTexCoordData2f(GLfloat *vNewTex, GLuint uiTextureLayer) { CopyTexCoordData2f((M3DVector2f *)(vNewTex), uiTextureLayer); }
+
+		virtual void Draw(void) {
+			if(uiBuffer == 0 || nNumVerts == 0)
+				return;
+
+#ifdef OPENGL_ES
+			// No vertex array objects, the attributes are set up every draw
+			glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+			SetAttributes();
+			glDrawArrays(primitiveType, 0, nNumVerts);
+			DisableAttributes();
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+#else
+			glBindVertexArray(vertexArrayObject);
+			glDrawArrays(primitiveType, 0, nNumVerts);
+			glBindVertexArray(0);
+#endif
+			}
+
+		// Immediate mode emulation, as GLBatch. Normals, colors and texture
+		// coordinates go to the vertex the next Vertex3f call finishes.
+		// Reset starts the vertices over for another End; what was drawn
+		// before is drawn until then.
+		void Reset(void) {
+			bBatchDone = false;
+			nVertsBuilding = 0;
+			vVerts.assign(size_t(nNumVerts) * 3, 0.0f);
+			}
+
+		void Vertex3f(GLfloat x, GLfloat y, GLfloat z) {
+			if(bBatchDone || nVertsBuilding >= nNumVerts)
+				return;
+			GLfloat *pVertex = &vVerts[size_t(nVertsBuilding) * 3];
+			pVertex[0] = x; pVertex[1] = y; pVertex[2] = z;
+			nVertsBuilding++;
+			}
+		inline void Vertex3fv(M3DVector3f vVertex) { Vertex3f(vVertex[0], vVertex[1], vVertex[2]); }
+
+		void Normal3f(GLfloat x, GLfloat y, GLfloat z) {
+			if(bBatchDone || nVertsBuilding >= nNumVerts)
+				return;
+			GLfloat *pNormal = Stream(vNormals, 3) + size_t(nVertsBuilding) * 3;
+			pNormal[0] = x; pNormal[1] = y; pNormal[2] = z;
+			}
+		inline void Normal3fv(M3DVector3f vNormal) { Normal3f(vNormal[0], vNormal[1], vNormal[2]); }
+
+		void Color4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+			if(bBatchDone || nVertsBuilding >= nNumVerts)
+				return;
+			GLfloat *pColor = Stream(vColors, 4) + size_t(nVertsBuilding) * 4;
+			pColor[0] = r; pColor[1] = g; pColor[2] = b; pColor[3] = a;
+			}
+		inline void Color4fv(M3DVector4f vColor) { Color4f(vColor[0], vColor[1], vColor[2], vColor[3]); }
+
+		void MultiTexCoord2f(GLuint texture, GLclampf s, GLclampf t) {
+			if(bBatchDone || nVertsBuilding >= nNumVerts || texture >= nNumTextureUnits)
+				return;
+			GLfloat *pTexCoord = Stream(vTexCoords[texture], 2) + size_t(nVertsBuilding) * 2;
+			pTexCoord[0] = s; pTexCoord[1] = t;
+			}
+		inline void MultiTexCoord2fv(GLuint texture, M3DVector2f vTexCoord) { MultiTexCoord2f(texture, vTexCoord[0], vTexCoord[1]); }
+
+		// Bytes per vertex in the buffer object, once End has been called
+		inline GLuint GetStride(void) const { return nStride * GLuint(sizeof(GLfloat)); }
+		inline GLuint GetVertexCount(void) const { return nNumVerts; }
+
+	protected:
+		inline bool IsBuilding(void) const { return !bBatchDone && nNumVerts != 0; }
+
+		// An attribute's client side array, made (zeroed) on first use.
+		// Only while building, so never empty.
+		inline GLfloat *Stream(std::vector<GLfloat>& vStream, GLuint nComponents) {
+			if(vStream.empty())
+				vStream.assign(size_t(nNumVerts) * nComponents, 0.0f);
+			return &vStream[0];
+			}
+
+		inline int Claim(GLuint nComponents) {
+			int iOffset = int(nStride);
+			nStride += nComponents;
+			return iOffset;
+			}
+
+		// Attribute pointers into the bound buffer object
+		void SetAttributes(void) {
+			GLsizei nBytes = GLsizei(GetStride());
+			glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+			glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, nBytes, 0);
+			if(iNormalOffset >= 0) {
+				glEnableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+				glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, nBytes, Offset(iNormalOffset));
+				}
+			if(iColorOffset >= 0) {
+				glEnableVertexAttribArray(GLT_ATTRIBUTE_COLOR);
+				glVertexAttribPointer(GLT_ATTRIBUTE_COLOR, 4, GL_FLOAT, GL_FALSE, nBytes, Offset(iColorOffset));
+				}
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				if(iTexCoordOffset[t] >= 0) {
+					glEnableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0 + t);
+					glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0 + t, 2, GL_FLOAT, GL_FALSE, nBytes, Offset(iTexCoordOffset[t]));
+					}
+			}
+
+#ifdef OPENGL_ES
+		void DisableAttributes(void) {
+			glDisableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+			if(iNormalOffset >= 0)
+				glDisableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+			if(iColorOffset >= 0)
+				glDisableVertexAttribArray(GLT_ATTRIBUTE_COLOR);
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				if(iTexCoordOffset[t] >= 0)
+					glDisableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0 + t);
+			}
+#endif
+
+		static inline const GLvoid *Offset(int iFloats) { return (const GLvoid *)(size_t(iFloats) * sizeof(GLfloat)); }
+
+		void FreeBuffers(void) {
+			if(uiBuffer != 0)
+				glDeleteBuffers(1, &uiBuffer);
+#ifndef OPENGL_ES
+			if(vertexArrayObject != 0)
+				glDeleteVertexArrays(1, &vertexArrayObject);
+#endif
+			uiBuffer = 0;
+			vertexArrayObject = 0;
+			}
+
+		// Holds buffer objects, so not to be copied
+		GLInterleavedBatch(const GLInterleavedBatch&);
+		GLInterleavedBatch& operator=(const GLInterleavedBatch&);
+
+		GLenum		primitiveType;
+		GLuint		uiBuffer;
+		GLuint		vertexArrayObject;
+
+		GLuint		nNumVerts;
+		GLuint		nVertsBuilding;		// Immediate mode emulator
+		GLuint		nNumTextureUnits;
+		GLuint		nStride;			// Floats per vertex
+		bool		bBatchDone;
+
+		int			iNormalOffset;		// Floats into the vertex, -1 for none
+		int			iColorOffset;
+		int			iTexCoordOffset[GLT_INTERLEAVED_MAX_TEXTURES];
+
+		// Client side arrays until End
+		std::vector<GLfloat>	vVerts;
+		std::vector<GLfloat>	vNormals;
+		std::vector<GLfloat>	vColors;
+		std::vector<GLfloat>	vTexCoords[GLT_INTERLEAVED_MAX_TEXTURES];
+	};
+
+#endif
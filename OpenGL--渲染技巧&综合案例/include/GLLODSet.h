@@ -0,0 +1,236 @@
+// GLLODSet.h
+// Discrete levels of detail for one mesh, chosen by its size on screen.
+//
+// Level 0 is the full mesh and each level after it is coarser. Every level
+// has a projected radius, in pixels, from which down it is used; the last
+// level is used for anything smaller. Levels are either filled by the
+// caller (AddLevel, then gltMakeSphere and friends with fewer slices and
+// stacks) or simplified from an earlier level's client side mesh
+// (AddSimplifiedLevel, by vertex clustering).
+//
+// Select() takes an object's projected radius and the level it had last
+// frame. It only moves to another level once the radius is past that
+// level's switching point by the hysteresis fraction, so an object sitting
+// on a threshold doesn't flicker between two meshes. Each object keeps its
+// own level, starting at -1 (none yet).
+//
+// Select also counts the triangles drawn and those the full mesh would have
+// cost, so GetTrianglesSaved() reports what the LOD chain is worth.
+
+#ifndef __GL_LOD_SET
+#define __GL_LOD_SET
+
+#include "math3d.h"
+#include "GLMeshBatch.h"
+#include <float.h>
+#include <math.h>
+#include <vector>
+#include <unordered_map>
+
+#define GLT_LOD_HYSTERESIS		0.15f		// Default, as a fraction of the switching radius
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex clustering (Rossignac and Borrel). The mesh's bounds are cut into
+// nGrid cells along the longest side, every vertex is moved to the average
+// of its cell's, and triangles that lose a corner that way are dropped.
+// Normals are averaged and renormalized; texture coordinates are those of
+// the first vertex in each cell, so seams may smear a little at coarse
+// levels. pNorms and pTexCoords may be NULL, and their outputs are then left
+// empty. The output has at most as many vertices as the input.
+inline void gltSimplifyMesh(std::vector<GLfloat>& vOutVerts, std::vector<GLfloat>& vOutNorms, std::vector<GLfloat>& vOutTexCoords,
+							std::vector<GLushort>& vOutIndexes, const M3DVector3f *pVerts, const M3DVector3f *pNorms,
+							const M3DVector2f *pTexCoords, int nVerts, const GLushort *pIndexes, int nIndexes, int nGrid)
+	{
+	vOutVerts.clear();
+	vOutNorms.clear();
+	vOutTexCoords.clear();
+	vOutIndexes.clear();
+	if(nVerts == 0)
+		return;
+
+	M3DVector3f vMin, vMax;
+	m3dCopyVector3(vMin, pVerts[0]);
+	m3dCopyVector3(vMax, pVerts[0]);
+	for(int i = 1; i < nVerts; i++)
+		for(int j = 0; j < 3; j++) {
+			vMin[j] = (pVerts[i][j] < vMin[j]) ? pVerts[i][j] : vMin[j];
+			vMax[j] = (pVerts[i][j] > vMax[j]) ? pVerts[i][j] : vMax[j];
+			}
+
+	float fExtent = vMax[0] - vMin[0];
+	fExtent = (vMax[1] - vMin[1] > fExtent) ? vMax[1] - vMin[1] : fExtent;
+	fExtent = (vMax[2] - vMin[2] > fExtent) ? vMax[2] - vMin[2] : fExtent;
+	nGrid = (nGrid < 1) ? 1 : ((nGrid > 1024) ? 1024 : nGrid);
+	float fScale = (fExtent > 0.0f) ? float(nGrid) / fExtent : 0.0f;
+
+	// Cell of every vertex, numbering the cells as they are first met
+	std::unordered_map<GLuint, int> cells;
+	std::vector<int> vCell(nVerts);
+	std::vector<int> vCount;
+	for(int i = 0; i < nVerts; i++) {
+		GLuint c[3];
+		for(int j = 0; j < 3; j++) {
+			int k = int((pVerts[i][j] - vMin[j]) * fScale);
+			c[j] = GLuint((k >= nGrid) ? nGrid - 1 : k);
+			}
+		GLuint nKey = (c[2] * GLuint(nGrid) + c[1]) * GLuint(nGrid) + c[0];
+
+		std::pair<std::unordered_map<GLuint, int>::iterator, bool> found = cells.insert(std::make_pair(nKey, int(vCount.size())));
+		int iCell = found.first->second;
+		if(found.second) {
+			vCount.push_back(0);
+			vOutVerts.insert(vOutVerts.end(), 3, 0.0f);
+			if(pNorms != NULL)
+				vOutNorms.insert(vOutNorms.end(), 3, 0.0f);
+			if(pTexCoords != NULL) {
+				vOutTexCoords.push_back(pTexCoords[i][0]);
+				vOutTexCoords.push_back(pTexCoords[i][1]);
+				}
+			}
+		vCell[i] = iCell;
+		vCount[iCell]++;
+		for(int j = 0; j < 3; j++)
+			vOutVerts[iCell * 3 + j] += pVerts[i][j];
+		if(pNorms != NULL)
+			for(int j = 0; j < 3; j++)
+				vOutNorms[iCell * 3 + j] += pNorms[i][j];
+		}
+
+	for(size_t c = 0; c < vCount.size(); c++) {
+		float fInvCount = 1.0f / float(vCount[c]);
+		for(int j = 0; j < 3; j++)
+			vOutVerts[c * 3 + j] *= fInvCount;
+		if(pNorms != NULL)
+			m3dNormalizeVector3(&vOutNorms[c * 3]);
+		}
+
+	for(int i = 0; i + 2 < nIndexes; i += 3) {
+		int a = vCell[pIndexes[i]], b = vCell[pIndexes[i + 1]], c = vCell[pIndexes[i + 2]];
+		if(a == b || b == c || a == c)
+			continue;
+		vOutIndexes.push_back(GLushort(a));
+		vOutIndexes.push_back(GLushort(b));
+		vOutIndexes.push_back(GLushort(c));
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLLODSet
+	{
+	public:
+		GLLODSet(void) : fHysteresis(GLT_LOD_HYSTERESIS) { ResetStats(); }
+		~GLLODSet(void) { Clear(); }
+
+		void Clear(void) {
+			for(size_t i = 0; i < vLevels.size(); i++)
+				delete vLevels[i].pBatch;
+			vLevels.clear();
+			}
+
+		// The next coarser level, used from a projected radius of fMinRadius
+		// pixels down to the next level's. Fill the batch it returns.
+		GLMeshBatch& AddLevel(float fMinRadius) {
+			GLLODLevel level;
+			level.pBatch = new GLMeshBatch;
+			level.fMinRadius = fMinRadius;
+			vLevels.push_back(level);
+			return *level.pBatch;
+			}
+
+		// A level made by simplifying the client side mesh of iSource (see
+		// GLMeshBatch::ReadBack) on a grid of nGrid cells. False, and no level
+		// added, if that has no client data.
+		bool AddSimplifiedLevel(int iSource, int nGrid, float fMinRadius) {
+			const GLMeshBatch& source = *vLevels[iSource].pBatch;
+			if(!source.HasClientData())
+				return false;
+
+			std::vector<GLfloat> vVerts, vNorms, vTexCoords;
+			std::vector<GLushort> vIndexes;
+			gltSimplifyMesh(vVerts, vNorms, vTexCoords, vIndexes, source.GetVertices(), source.GetNormals(), source.GetTexCoords(),
+							int(source.GetClientVertexCount()), source.GetIndexes(), int(source.GetClientIndexCount()), nGrid);
+			if(vIndexes.empty())
+				return false;
+
+			AddLevel(fMinRadius).SetMesh((const M3DVector3f *)&vVerts[0], vNorms.empty() ? NULL : (const M3DVector3f *)&vNorms[0],
+										 vTexCoords.empty() ? NULL : (const M3DVector2f *)&vTexCoords[0],
+										 GLuint(vVerts.size() / 3), &vIndexes[0], GLuint(vIndexes.size()));
+			return true;
+			}
+
+		inline int GetLevelCount(void) const { return int(vLevels.size()); }
+		inline GLMeshBatch& GetLevel(int iLevel) { return *vLevels[iLevel].pBatch; }
+		inline float GetMinRadius(int iLevel) const { return vLevels[iLevel].fMinRadius; }
+		inline GLuint GetTriangleCount(int iLevel) const { return vLevels[iLevel].pBatch->GetIndexCount() / 3; }
+
+		// How far past a switching radius, as a fraction of it, an object
+		// must go before it changes level
+		inline void SetHysteresis(float fFraction) { fHysteresis = fFraction; }
+
+
+		/////////////////////////////////////////////////////////////
+		// Radius in pixels of a sphere of radius fRadius at the origin of
+		// mModelView (a rigid one; mirrored is fine), seen through a
+		// perspective projection onto a viewport fViewportHeight high.
+		// Anything the eye is inside of counts as huge.
+		static float ProjectedRadius(const M3DMatrix44f mModelView, float fRadius, const M3DMatrix44f mProjection, float fViewportHeight) {
+			float fDistance = m3dGetVectorLength3(&mModelView[12]);
+			if(fDistance <= fRadius)
+				return FLT_MAX;
+			return fRadius * mProjection[5] * 0.5f * fViewportHeight / fDistance;
+			}
+
+		// The level for an object of fScreenRadius pixels that had iCurrent
+		// last time (-1 for none)
+		int SelectLevel(float fScreenRadius, int iCurrent) const {
+			int nLevels = GetLevelCount();
+			if(iCurrent < 0 || iCurrent >= nLevels) {
+				int i = 0;
+				while(i + 1 < nLevels && fScreenRadius < vLevels[i].fMinRadius)
+					i++;
+				return i;
+				}
+
+			int i = iCurrent;
+			while(i > 0 && fScreenRadius >= vLevels[i - 1].fMinRadius * (1.0f + fHysteresis))
+				i--;
+			while(i + 1 < nLevels && fScreenRadius < vLevels[i].fMinRadius * (1.0f - fHysteresis))
+				i++;
+			return i;
+			}
+
+		// Update an object's level and return the batch to draw it with,
+		// counting it in the statistics
+		GLMeshBatch& Select(float fScreenRadius, int& iLevel) {
+			iLevel = SelectLevel(fScreenRadius, iLevel);
+			nTrianglesDrawn += GetTriangleCount(iLevel);
+			nTrianglesFull += GetTriangleCount(0);
+			return GetLevel(iLevel);
+			}
+
+		// Triangles drawn through Select since ResetStats, and how many
+		// fewer than the full mesh every time
+		inline void ResetStats(void) { nTrianglesDrawn = nTrianglesFull = 0; }
+		inline GLuint GetTrianglesDrawn(void) const { return nTrianglesDrawn; }
+		inline GLuint GetTrianglesSaved(void) const { return nTrianglesFull - nTrianglesDrawn; }
+
+	protected:
+		struct GLLODLevel
+			{
+			GLMeshBatch		*pBatch;
+			float			fMinRadius;		// Pixels
+			};
+
+		// Batches hold buffer objects, so the set is not to be copied
+		GLLODSet(const GLLODSet&);
+		GLLODSet& operator=(const GLLODSet&);
+
+		std::vector<GLLODLevel>	vLevels;		// Finest first
+		float					fHysteresis;
+		GLuint					nTrianglesDrawn;
+		GLuint					nTrianglesFull;
+	};
+
+#endif
@@ -34,59 +34,137 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 
 #include "GLTools.h"
 #include "math3d.h"
+#include "math3dSIMD.h"
+#include "math3dTypes.h"
 #include "GLFrame.h"
+#include "GLTransformBuffer.h"
 
 
 
 enum GLT_STACK_ERROR { GLT_STACK_NOERROR = 0, GLT_STACK_OVERFLOW, GLT_STACK_UNDERFLOW }; 
 
+// Every change to the top of a stack gives it a new version number. Pushing
+// copies the version along with the matrix and popping brings the old one
+// back, so anything worked out from a level's matrix (see GLGeometryTransform)
+// is still good once the levels above it are popped.
+typedef unsigned long long GLT_STACK_VERSION;
+
+// Each level also records what kind of matrix it holds (M3D_MATRIX_KIND), so
+// MultMatrix can skip the parts of the product that are known to be zero or
+// one, and users of the matrix (normal matrices, inverses) can take short
+// cuts. Matrices loaded without a kind, and levels changed through Top(), are
+// classified when the kind is next asked for.
+//
+// While recording into a GLTransformBuffer, RecordMatrix() appends the top of
+// the stack to it and returns the index to draw with, so a frame's matrices
+// can be uploaded together (see GLTransformBuffer.h).
+
 class GLMatrixStack
 	{
 	public:
 		GLMatrixStack(int iStackDepth = 64) {
 			stackDepth = iStackDepth;
 			pStack = new M3DMatrix44f[iStackDepth];
+			pVersion = new GLT_STACK_VERSION[iStackDepth];
+			pKind = new signed char[iStackDepth];
+			pRecording = NULL;
 			stackPointer = 0;
+			lastVersion = 0;
 			m3dLoadIdentity44(pStack[0]);
+			Changed(M3D_MATRIX_IDENTITY);
 			lastError = GLT_STACK_NOERROR;
 			}
 		
 		
 		~GLMatrixStack(void) {
 			delete [] pStack;
+			delete [] pVersion;
+			delete [] pKind;
 			}
 
 		
 		inline void LoadIdentity(void) { 
 			m3dLoadIdentity44(pStack[stackPointer]); 
+			Changed(M3D_MATRIX_IDENTITY);
 			}
 		
 		inline void LoadMatrix(const M3DMatrix44f mMatrix) { 
 			m3dCopyMatrix44(pStack[stackPointer], mMatrix); 
+			Changed();
+			pKind[stackPointer] = -1;
+			}
+
+		// When the caller already knows what kind of matrix it is
+		inline void LoadMatrix(const M3DMatrix44f mMatrix, M3D_MATRIX_KIND kind) { 
+			m3dCopyMatrix44(pStack[stackPointer], mMatrix); 
+			Changed(kind);
 			}
             
+        // A frame's axes are only as orthonormal as its user keeps them
+        // (SetForwardVector and SetUpVector take them as given), so the
+        // frame overloads don't call its matrix rigid; the quick classify
+        // makes it affine, which still gets the cheap product
         inline void LoadMatrix(GLFrame& frame) {
             M3DMatrix44f m;
             frame.GetMatrix(m);
-            LoadMatrix(m);
+            LoadMatrix(m, m3dClassifyMatrix44Quick(m));
             }
             
+		// A top that hasn't been classified gets the general product and stays
+		// unclassified. The SIMD multiply may write over its source, so no copy
+		// of the top is needed.
 		inline void MultMatrix(const M3DMatrix44f mMatrix) {
-			M3DMatrix44f mTemp;
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mMatrix);
+			if(pKind[stackPointer] < 0) {
+				m3dSIMDMatrixMultiply44(pStack[stackPointer], pStack[stackPointer], mMatrix);
+				Changed();
+				}
+			else
+				MultMatrix(mMatrix, m3dClassifyMatrix44Quick(mMatrix));
+			}
+
+		// Otherwise the product is picked by the kinds of the two matrices
+		void MultMatrix(const M3DMatrix44f mMatrix, M3D_MATRIX_KIND kind) {
+			if(kind == M3D_MATRIX_IDENTITY)
+				return;
+
+			float *m = pStack[stackPointer];
+			if(pKind[stackPointer] < 0) {
+				m3dSIMDMatrixMultiply44(m, m, mMatrix);
+				Changed();
+				return;
+				}
+
+			M3D_MATRIX_KIND topKind = M3D_MATRIX_KIND(pKind[stackPointer]);
+			if(topKind == M3D_MATRIX_IDENTITY)
+				m3dCopyMatrix44(m, mMatrix);
+			else if(kind == M3D_MATRIX_TRANSLATION)
+				M3DTranslate<float>(mMatrix[12], mMatrix[13], mMatrix[14]).MultiplyInto(m);
+			else if(topKind == M3D_MATRIX_TRANSLATION && kind != M3D_MATRIX_PROJECTIVE) {
+				M3DVector3f vTranslate = { m[12], m[13], m[14] };
+				m3dCopyMatrix44(m, mMatrix);
+				m[12] += vTranslate[0];
+				m[13] += vTranslate[1];
+				m[14] += vTranslate[2];
+				}
+			else if(topKind != M3D_MATRIX_PROJECTIVE && kind != M3D_MATRIX_PROJECTIVE && m3dSIMDGetLevel() == M3D_SIMD_SCALAR)
+				m3dMultiplyAffine44(m, m, mMatrix);
+			else
+				m3dSIMDMatrixMultiply44(m, m, mMatrix);
+			Changed(m3dCombineMatrixKinds(topKind, kind));
 			}
             
         inline void MultMatrix(GLFrame& frame) {
             M3DMatrix44f m;
             frame.GetMatrix(m);
-            MultMatrix(m);
+            MultMatrix(m, m3dClassifyMatrix44Quick(m));
             }
             				
 		inline void PushMatrix(void) {
 			if(stackPointer < stackDepth) {
 				stackPointer++;
 				m3dCopyMatrix44(pStack[stackPointer], pStack[stackPointer-1]);
+				pVersion[stackPointer] = pVersion[stackPointer-1];
+				pKind[stackPointer] = pKind[stackPointer-1];
 				}
 			else
 				lastError = GLT_STACK_OVERFLOW;
@@ -99,59 +177,63 @@ class GLMatrixStack
 				lastError = GLT_STACK_UNDERFLOW;
 			}
 			
+		// Transforms are applied in place on the top of the stack, touching only
+		// the columns they change (see math3dTypes.h)
 		void Scale(GLfloat x, GLfloat y, GLfloat z) {
-			M3DMatrix44f mTemp, mScale;
-			m3dScaleMatrix44(mScale, x, y, z);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mScale);
+			MultMatrix(M3DScale<float>(x, y, z));
 			}
 			
 			
 		void Translate(GLfloat x, GLfloat y, GLfloat z) {
-			M3DMatrix44f mTemp, mScale;
-			m3dTranslationMatrix44(mScale, x, y, z);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mScale);			
+			MultMatrix(M3DTranslate<float>(x, y, z));
 			}
             			
 		void Rotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
-			M3DMatrix44f mTemp, mRotate;
-			m3dRotationMatrix44(mRotate, float(m3dDegToRad(angle)), x, y, z);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mRotate);
+			MultMatrix(M3DRotate<float>(float(m3dDegToRad(angle)), x, y, z));
 			}
 		
 		
 		// I've always wanted vector versions of these
 		void Scalev(const M3DVector3f vScale) {
-			M3DMatrix44f mTemp, mScale;
-			m3dScaleMatrix44(mScale, vScale);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mScale);
+			MultMatrix(M3DScale<float>(vScale));
 			}
 			
         void Translatev(const M3DVector3f vTranslate) {
-			M3DMatrix44f mTemp, mTranslate;
-			m3dLoadIdentity44(mTranslate);
-            memcpy(&mTranslate[12], vTranslate, sizeof(M3DVector3f));
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mTranslate);
+			MultMatrix(M3DTranslate<float>(vTranslate));
             }
         
 			
 		void Rotatev(GLfloat angle, M3DVector3f vAxis) {
-			M3DMatrix44f mTemp, mRotation;
-			m3dRotationMatrix44(mRotation, float(m3dDegToRad(angle)), vAxis[0], vAxis[1], vAxis[2]);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mRotation);
+			MultMatrix(M3DRotate<float>(float(m3dDegToRad(angle)), vAxis[0], vAxis[1], vAxis[2]));
+			}
+			
+		// Any transform expression, e.g. MultMatrix(M3DTranslate<float>(x, y, z) * M3DScale<float>(s, s, s)).
+		// The expression already touches only what it changes; the kind is
+		// carried along if the top has one.
+		template <typename E>
+		void MultMatrix(const M3DTransformExpr<E>& transform) {
+			M3DMat4Ref<float>(pStack[stackPointer]) *= transform;
+			signed char topKind = pKind[stackPointer];
+			Changed();
+			if(topKind >= 0)
+				pKind[stackPointer] = (signed char)m3dCombineMatrixKinds(M3D_MATRIX_KIND(topKind), transform.Derived().Kind());
 			}
 			
+		// Direct view of the top of the stack. Counts as a change, of a kind
+		// that is worked out again when next needed.
+		M3DMat4Ref<float> Top(void) {
+			Changed();
+			pKind[stackPointer] = -1;
+			return M3DMat4Ref<float>(pStack[stackPointer]);
+			}
 		
 		// I've also always wanted to be able to do this
 		void PushMatrix(const M3DMatrix44f mMatrix) {
 		 	if(stackPointer < stackDepth) {
 				stackPointer++;
 				m3dCopyMatrix44(pStack[stackPointer], mMatrix);
+				Changed();
+				pKind[stackPointer] = -1;
 				}
 			else
 				lastError = GLT_STACK_OVERFLOW;
@@ -160,13 +242,40 @@ class GLMatrixStack
         void PushMatrix(GLFrame& frame) {
             M3DMatrix44f m;
             frame.GetMatrix(m);
-            PushMatrix(m);
+		 	if(stackPointer < stackDepth) {
+				stackPointer++;
+				LoadMatrix(m, m3dClassifyMatrix44Quick(m));
+				}
+			else
+				lastError = GLT_STACK_OVERFLOW;
             }
             
 		// Two different ways to get the matrix
 		const M3DMatrix44f& GetMatrix(void) { return pStack[stackPointer]; }
 		void GetMatrix(M3DMatrix44f mMatrix) { m3dCopyMatrix44(mMatrix, pStack[stackPointer]); }
 
+		// Version of the matrix on top of the stack. Equal versions mean the
+		// same matrix.
+		inline GLT_STACK_VERSION GetVersion(void) const { return pVersion[stackPointer]; }
+
+		// Kind of the matrix on top of the stack
+		inline M3D_MATRIX_KIND GetMatrixKind(void) {
+			if(pKind[stackPointer] < 0)
+				pKind[stackPointer] = (signed char)m3dClassifyMatrix44(pStack[stackPointer]);
+			return M3D_MATRIX_KIND(pKind[stackPointer]);
+			}
+
+
+		// Recording mode
+		inline void BeginRecording(GLTransformBuffer& buffer) { pRecording = &buffer; }
+		inline void EndRecording(void) { pRecording = NULL; }
+		inline bool IsRecording(void) const { return pRecording != NULL; }
+
+		// Index of the top of the stack in the transform buffer, -1 when not recording
+		inline GLint RecordMatrix(void) {
+			return (pRecording != NULL) ? pRecording->Append(pStack[stackPointer]) : -1;
+			}
+
 
 		inline GLT_STACK_ERROR GetLastError(void) {
 			GLT_STACK_ERROR retval = lastError;
@@ -175,10 +284,21 @@ class GLMatrixStack
 			}
 	
 	protected:
+		inline void Changed(void) { pVersion[stackPointer] = ++lastVersion; }
+
+		inline void Changed(M3D_MATRIX_KIND kind) {
+			Changed();
+			pKind[stackPointer] = (signed char)kind;
+			}
+
 		GLT_STACK_ERROR		lastError;
 		int					stackDepth;
 		int					stackPointer;
 		M3DMatrix44f		*pStack;
+		GLT_STACK_VERSION	*pVersion;
+		signed char			*pKind;		// M3D_MATRIX_KIND, or -1 to be classified
+		GLTransformBuffer	*pRecording;
+		GLT_STACK_VERSION	lastVersion;
 	};
 
 #endif
@@ -0,0 +1,382 @@
+// GLMeshBatch.h
+// A GLTriangleBatch that keeps its geometry on the CPU side.
+//
+// GLTriangleBatch::End() uploads the mesh to buffer objects and frees the
+// client side arrays, which is what you want for drawing but leaves nothing
+// for picking, culling volumes or generating extra attributes. GLMeshBatch
+// keeps a copy. Meshes built with BeginMesh/AddTriangle/End on a GLMeshBatch
+// keep theirs automatically; meshes filled by gltMakeSphere and friends (which
+// call GLTriangleBatch::End directly) can be read back from the buffer objects
+// with ReadBack().
+//
+// A GLMeshBatch can also carry per vertex tangents for normal mapping, as the
+// extra attribute GLT_ATTRIBUTE_TANGENT (x, y, z and the handedness of the
+// bitangent in w). Call SetTangentGeneration(true) before End(), or
+// GenerateTangents() after ReadBack().
+//
+// The buffer objects can hold a packed vertex format instead of floats (see
+// math3dPack.h and SetVertexPacking). Positions, normals and texture
+// coordinates then take 16 bytes a vertex rather than 32. The client side
+// copy stays in floats.
+
+#ifndef __GL_MESH_BATCH
+#define __GL_MESH_BATCH
+
+#include "GLTriangleBatch.h"
+#include "GLParallel.h"
+#include "math3dPack.h"
+#include <string.h>
+#include <vector>
+
+// The first attribute index GLShaderManager leaves free
+#define GLT_ATTRIBUTE_TANGENT	GLT_ATTRIBUTE_LAST
+
+// Triangles per thread below which tangents are worked out on one thread
+#define GLT_TANGENT_MIN_TRIANGLES	2048
+
+// Packed vertex formats, for SetVertexPacking. Choose at most one normal
+// format.
+//
+//	GLT_PACK_POSITION_SHORT		Four normalized shorts relative to the mesh's
+//								bounds. Multiply GetPositionMatrix() into the
+//								modelview to draw.
+//	GLT_PACK_NORMAL_OCT			Two normalized shorts; needs the shaders in
+//								GLPackedShaders.h.
+//	GLT_PACK_NORMAL_10_10_10_2	GL_INT_2_10_10_10_REV, read by the stock
+//								shaders as is. Needs GL 3.3.
+//	GLT_PACK_TEXCOORD_HALF		Two half floats. Needs GL 3.0.
+enum GLT_VERTEX_PACKING { GLT_PACK_NONE = 0, GLT_PACK_POSITION_SHORT = 0x01, GLT_PACK_NORMAL_OCT = 0x02,
+						  GLT_PACK_NORMAL_10_10_10_2 = 0x04, GLT_PACK_TEXCOORD_HALF = 0x08 };
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Per vertex tangents for a whole indexed mesh. Each triangle's tangent and
+// bitangent (as m3dCalculateTangentBasis finds them) are summed into its three
+// vertices; each vertex's sum is then made perpendicular to its normal and
+// unit length. w is 1 or -1, the bitangent being cross(N, T) * w.
+//
+// Triangles are split over threads, each summing into its own copy of the
+// per vertex totals; the vertices are then split over threads to add the
+// copies up and finish them. Triangles with no texture mapping (zero area in
+// texture space) add nothing. A vertex none of whose triangles add anything
+// gets some tangent perpendicular to its normal.
+inline void gltCalculateTangents(M3DVector4f *pTangents, const M3DVector3f *pVerts, const M3DVector3f *pNorms,
+								 const M3DVector2f *pTexCoords, int nVerts, const GLushort *pIndexes, int nIndexes)
+	{
+	int nTriangles = nIndexes / 3;
+	int nThreads = gltParallelThreadCount(nTriangles, GLT_TANGENT_MIN_TRIANGLES);
+
+	// Tangent x y z, bitangent x y z, per vertex, per thread
+	std::vector<float> vSums(size_t(nThreads) * nVerts * 6, 0.0f);
+
+	gltParallelFor(nTriangles, GLT_TANGENT_MIN_TRIANGLES, [&](int iBegin, int iEnd, int iThread) {
+		float *pSum = &vSums[size_t(iThread) * nVerts * 6];
+		for(int t = iBegin; t < iEnd; t++) {
+			const GLushort *tri = pIndexes + t * 3;
+			const float *v0 = pVerts[tri[0]], *v1 = pVerts[tri[1]], *v2 = pVerts[tri[2]];
+			const float *c0 = pTexCoords[tri[0]], *c1 = pTexCoords[tri[1]], *c2 = pTexCoords[tri[2]];
+
+			float ds1 = c1[0] - c0[0], dt1 = c1[1] - c0[1];
+			float ds2 = c2[0] - c0[0], dt2 = c2[1] - c0[1];
+			float det = ds1 * dt2 - ds2 * dt1;
+			if(det == 0.0f)
+				continue;
+			float r = 1.0f / det;
+
+			float tb[6];
+			for(int i = 0; i < 3; i++) {
+				float e1 = v1[i] - v0[i], e2 = v2[i] - v0[i];
+				tb[i] = (e1 * dt2 - e2 * dt1) * r;
+				tb[3 + i] = (e2 * ds1 - e1 * ds2) * r;
+				}
+
+			for(int j = 0; j < 3; j++) {
+				float *pVert = pSum + tri[j] * 6;
+				for(int i = 0; i < 6; i++)
+					pVert[i] += tb[i];
+				}
+			}
+		});
+
+	gltParallelFor(nVerts, GLT_TANGENT_MIN_TRIANGLES, [&](int iBegin, int iEnd, int) {
+		for(int v = iBegin; v < iEnd; v++) {
+			float tb[6];
+			for(int i = 0; i < 6; i++)
+				tb[i] = vSums[size_t(v) * 6 + i];
+			for(int t = 1; t < nThreads; t++)
+				for(int i = 0; i < 6; i++)
+					tb[i] += vSums[(size_t(t) * nVerts + v) * 6 + i];
+
+			// Gram-Schmidt against the normal
+			const float *n = pNorms[v];
+			M3DVector3f vTangent;
+			float d = m3dDotProduct3(n, tb);
+			for(int i = 0; i < 3; i++)
+				vTangent[i] = tb[i] - n[i] * d;
+
+			float fLength2 = m3dGetVectorLengthSquared3(vTangent);
+			if(!(fLength2 > 1e-20f)) {
+				// Anything perpendicular to the normal
+				M3DVector3f vAxis = { 1.0f, 0.0f, 0.0f };
+				if(fabsf(n[0]) > 0.9f)
+					m3dLoadVector3(vAxis, 0.0f, 1.0f, 0.0f);
+				m3dCrossProduct3(vTangent, vAxis, n);
+				fLength2 = m3dGetVectorLengthSquared3(vTangent);
+				}
+			m3dScaleVector3(vTangent, 1.0f / sqrtf(fLength2));
+
+			M3DVector3f vBitangent;
+			m3dCrossProduct3(vBitangent, n, vTangent);
+			pTangents[v][0] = vTangent[0];
+			pTangents[v][1] = vTangent[1];
+			pTangents[v][2] = vTangent[2];
+			pTangents[v][3] = (m3dDotProduct3(vBitangent, tb + 3) < 0.0f) ? -1.0f : 1.0f;
+			}
+		});
+	}
+
+
+class GLMeshBatch : public GLTriangleBatch
+	{
+	public:
+		GLMeshBatch(void) : bGenerateTangents(false), tangentBuffer(0), nPacking(GLT_PACK_NONE), nPacked(GLT_PACK_NONE),
+							fPositionScale(1.0f) { vPositionBias[0] = vPositionBias[1] = vPositionBias[2] = 0.0f; }
+		virtual ~GLMeshBatch(void) {
+			if(tangentBuffer != 0)
+				glDeleteBuffers(1, &tangentBuffer);
+			}
+
+		// Same as GLTriangleBatch::End, keeping a copy of the mesh first
+		void End(void) {
+			CopyClientArrays();
+			GLTriangleBatch::End();
+			if(nPacking != GLT_PACK_NONE)
+				PackVertices();
+			if(bGenerateTangents)
+				GenerateTangents();
+			}
+
+		// Build the whole batch from indexed arrays and End() it. Vertices
+		// are taken as they are, with none of AddTriangle's welding. The
+		// batch always has normals and texture coordinates; pass NULL for
+		// either to have them zero.
+		void SetMesh(const M3DVector3f *pNewVerts, const M3DVector3f *pNewNorms, const M3DVector2f *pNewTexCoords,
+					 GLuint nVerts, const GLushort *pNewIndexes, GLuint nIndexes) {
+			BeginMesh((nVerts > nIndexes) ? nVerts : nIndexes);
+			memcpy(pVerts, pNewVerts, sizeof(M3DVector3f) * nVerts);
+			if(pNewNorms != NULL)
+				memcpy(pNorms, pNewNorms, sizeof(M3DVector3f) * nVerts);
+			else
+				memset(pNorms, 0, sizeof(M3DVector3f) * nVerts);
+			if(pNewTexCoords != NULL)
+				memcpy(pTexCoords, pNewTexCoords, sizeof(M3DVector2f) * nVerts);
+			else
+				memset(pTexCoords, 0, sizeof(M3DVector2f) * nVerts);
+			memcpy(pIndexes, pNewIndexes, sizeof(GLushort) * nIndexes);
+			nNumVerts = nVerts;
+			nNumIndexes = nIndexes;
+			End();
+			}
+
+		// GLT_VERTEX_PACKING flags for End() to apply
+		inline void SetVertexPacking(GLuint nFlags) { nPacking = nFlags; }
+
+		// Replace the float buffers with the packed format chosen by
+		// SetVertexPacking. Called by End(); call it after ReadBack() for
+		// gltMakeSphere and friends.
+		bool PackVertices(void) {
+#ifndef OPENGL_ES
+			if(!HasClientData() || nNumVerts == 0 || nPacked != GLT_PACK_NONE)
+				return false;
+
+			int nVerts = int(GetClientVertexCount());
+			glBindVertexArray(vertexArrayBufferObject);
+
+			if(nPacking & GLT_PACK_POSITION_SHORT) {
+				std::vector<GLshort> vPacked(nVerts * 4);
+				m3dPositionQuantizeRange(vPositionBias, &fPositionScale, GetVertices(), nVerts);
+				m3dQuantizePositions(&vPacked[0], GetVertices(), nVerts, vPositionBias, fPositionScale);
+				glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[VERTEX_DATA]);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(GLshort) * vPacked.size(), &vPacked[0], GL_STATIC_DRAW);
+				glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 4, GL_SHORT, GL_TRUE, 0, 0);
+				}
+
+			if(nPacking & GLT_PACK_NORMAL_OCT) {
+				std::vector<GLshort> vPacked(nVerts * 2);
+				m3dOctEncodeNormals(&vPacked[0], GetNormals(), nVerts);
+				glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[NORMAL_DATA]);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(GLshort) * vPacked.size(), &vPacked[0], GL_STATIC_DRAW);
+				glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 2, GL_SHORT, GL_TRUE, 0, 0);
+				}
+			else if(nPacking & GLT_PACK_NORMAL_10_10_10_2) {
+				std::vector<GLuint> vPacked(nVerts);
+				m3dPackNormals1010102(&vPacked[0], GetNormals(), nVerts);
+				glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[NORMAL_DATA]);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * vPacked.size(), &vPacked[0], GL_STATIC_DRAW);
+				glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0, 0);
+				}
+
+			if(nPacking & GLT_PACK_TEXCOORD_HALF) {
+				std::vector<GLushort> vPacked(nVerts * 2);
+				m3dFloatsToHalves(&vPacked[0], &vTexCoords[0], nVerts * 2);
+				glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[TEXTURE_DATA]);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(GLushort) * vPacked.size(), &vPacked[0], GL_STATIC_DRAW);
+				glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0, 2, GL_HALF_FLOAT, GL_FALSE, 0, 0);
+				}
+
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			nPacked = nPacking;
+			return true;
+#else
+			return false;
+#endif
+			}
+
+		// The format the buffer objects are in
+		inline GLuint GetVertexPacking(void) const { return nPacked; }
+
+		// Bytes per vertex in the buffer objects, tangents aside
+		GLuint GetVertexSize(void) const {
+			GLuint nSize = (nPacked & GLT_PACK_POSITION_SHORT) ? 8 : 12;
+			nSize += (nPacked & (GLT_PACK_NORMAL_OCT | GLT_PACK_NORMAL_10_10_10_2)) ? 4 : 12;
+			nSize += (nPacked & GLT_PACK_TEXCOORD_HALF) ? 4 : 8;
+			return nSize;
+			}
+
+		// Model matrix taking quantized positions back to the mesh's own
+		// coordinates, to multiply onto the modelview before Draw(). The
+		// identity unless positions are packed.
+		void GetPositionMatrix(M3DMatrix44f m) const {
+			if(nPacked & GLT_PACK_POSITION_SHORT)
+				m3dPositionDequantizeMatrix(m, vPositionBias, fPositionScale);
+			else
+				m3dLoadIdentity44(m);
+			}
+
+		// Whether End() works out tangents
+		inline void SetTangentGeneration(bool bEnable) { bGenerateTangents = bEnable; }
+
+		// Work out tangents from the client side copy and attach them to the
+		// batch. Needs a batch that has been through End() (or ReadBack()).
+		bool GenerateTangents(void) {
+			if(!HasClientData() || nNumVerts == 0)
+				return false;
+
+			vTangents.resize(GetClientVertexCount() * 4);
+			gltCalculateTangents((M3DVector4f *)&vTangents[0], GetVertices(), GetNormals(), GetTexCoords(),
+								 int(GetClientVertexCount()), GetIndexes(), int(GetClientIndexCount()));
+
+			if(tangentBuffer == 0)
+				glGenBuffers(1, &tangentBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vTangents.size(), &vTangents[0], GL_STATIC_DRAW);
+
+#ifndef OPENGL_ES
+			// Part of the vertex array object from now on, so the base Draw
+			// binds it along with the rest
+			glBindVertexArray(vertexArrayBufferObject);
+			glEnableVertexAttribArray(GLT_ATTRIBUTE_TANGENT);
+			glVertexAttribPointer(GLT_ATTRIBUTE_TANGENT, 4, GL_FLOAT, GL_FALSE, 0, 0);
+			glBindVertexArray(0);
+#endif
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			return true;
+			}
+
+		inline bool HasTangents(void) const { return tangentBuffer != 0; }
+		inline const M3DVector4f *GetTangents(void) const { return vTangents.empty() ? NULL : (const M3DVector4f *)&vTangents[0]; }
+
+		virtual void Draw(void) {
+#ifdef OPENGL_ES
+			// No vertex array objects, the attribute is set up every draw
+			if(tangentBuffer != 0) {
+				glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
+				glEnableVertexAttribArray(GLT_ATTRIBUTE_TANGENT);
+				glVertexAttribPointer(GLT_ATTRIBUTE_TANGENT, 4, GL_FLOAT, GL_FALSE, 0, 0);
+				}
+			GLTriangleBatch::Draw();
+			if(tangentBuffer != 0)
+				glDisableVertexAttribArray(GLT_ATTRIBUTE_TANGENT);
+#else
+			GLTriangleBatch::Draw();
+#endif
+			}
+
+		// Fetch the mesh back from the buffer objects, for batches built with
+		// gltMakeSphere etc. Needs the GL context the batch was made in.
+		bool ReadBack(void) {
+#ifndef OPENGL_ES
+			// Nothing uploaded yet (the arrays are only freed by End), or no
+			// longer in floats
+			if(nNumVerts == 0 || pVerts != NULL || nPacked != GLT_PACK_NONE)
+				return false;
+
+			vVerts.resize(nNumVerts * 3);
+			vNorms.resize(nNumVerts * 3);
+			vTexCoords.resize(nNumVerts * 2);
+			vIndexes.resize(nNumIndexes);
+
+			glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[VERTEX_DATA]);
+			glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * nNumVerts * 3, &vVerts[0]);
+			glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[NORMAL_DATA]);
+			glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * nNumVerts * 3, &vNorms[0]);
+			glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[TEXTURE_DATA]);
+			glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * nNumVerts * 2, &vTexCoords[0]);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			// The index buffer is part of the vertex array object's state
+			glBindVertexArray(vertexArrayBufferObject);
+			glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * nNumIndexes, &vIndexes[0]);
+			glBindVertexArray(0);
+			return true;
+#else
+			return false;
+#endif
+			}
+
+		// Client side copy. NULL until End() or ReadBack().
+		inline bool HasClientData(void) const { return !vVerts.empty(); }
+		inline const M3DVector3f *GetVertices(void) const { return vVerts.empty() ? NULL : (const M3DVector3f *)&vVerts[0]; }
+		inline const M3DVector3f *GetNormals(void) const { return vNorms.empty() ? NULL : (const M3DVector3f *)&vNorms[0]; }
+		inline const M3DVector2f *GetTexCoords(void) const { return vTexCoords.empty() ? NULL : (const M3DVector2f *)&vTexCoords[0]; }
+		inline const GLushort *GetIndexes(void) const { return vIndexes.empty() ? NULL : &vIndexes[0]; }
+		inline GLuint GetClientVertexCount(void) const { return GLuint(vVerts.size() / 3); }
+		inline GLuint GetClientIndexCount(void) const { return GLuint(vIndexes.size()); }
+
+		// Drop the client side copy
+		void FreeClientData(void) {
+			std::vector<GLfloat>().swap(vVerts);
+			std::vector<GLfloat>().swap(vNorms);
+			std::vector<GLfloat>().swap(vTexCoords);
+			std::vector<GLushort>().swap(vIndexes);
+			std::vector<GLfloat>().swap(vTangents);
+			}
+
+	protected:
+		void CopyClientArrays(void) {
+			if(pVerts == NULL)
+				return;
+
+			vVerts.assign(pVerts[0], pVerts[0] + nNumVerts * 3);
+			vNorms.assign(pNorms[0], pNorms[0] + nNumVerts * 3);
+			vTexCoords.assign(pTexCoords[0], pTexCoords[0] + nNumVerts * 2);
+			vIndexes.assign(pIndexes, pIndexes + nNumIndexes);
+			}
+
+		std::vector<GLfloat>	vVerts;			// x, y, z per vertex
+		std::vector<GLfloat>	vNorms;
+		std::vector<GLfloat>	vTexCoords;		// s, t per vertex
+		std::vector<GLushort>	vIndexes;
+		std::vector<GLfloat>	vTangents;		// x, y, z, w per vertex
+
+		bool					bGenerateTangents;
+		GLuint					tangentBuffer;
+
+		GLuint					nPacking;		// Asked for
+		GLuint					nPacked;		// In the buffer objects
+		M3DVector3f				vPositionBias;
+		float					fPositionScale;
+	};
+
+#endif
@@ -0,0 +1,362 @@
+// GLOcclusionBuffer.h
+// CPU occlusion culling against a small depth buffer.
+//
+// A few large occluders (low poly proxies, see GLMeshBatch::ReadBack) are
+// rasterized into a low resolution depth buffer, and object bounds are then
+// tested against it before anything is sent to GL. Objects entirely behind
+// the occluders are reported hidden.
+//
+// The buffer is conservative: a pixel only takes an occluder's depth when
+// the triangle covers all of it, and then the furthest depth the triangle
+// has over the pixel. Triangles crossing the near plane are left out, and so
+// are objects with a corner in front of it. Leaving something out never hides
+// an object that could be seen, it only culls less.
+//
+// Depths are normalized device z, cleared to 1. After End() a pyramid is
+// built, each level holding the furthest depth of four pixels below it, so
+// testing a box reads at most four values wherever it is on screen.
+//
+// Rows are rasterized in bands on gltParallelFor threads when there are
+// enough triangles (GLT_OCCLUSION_PARALLEL_TRIANGLES), and four pixels at a
+// time with SSE2. The scalar and SSE2 paths do the same float operations and
+// leave the same depths. The instruction set follows m3dSIMDGetLevel().
+
+#ifndef __GL_OCCLUSION_BUFFER
+#define __GL_OCCLUSION_BUFFER
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "GLParallel.h"
+#include "GLMeshBatch.h"
+#include "GLBVH.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#define GLT_OCCLUSION_WIDTH					256
+#define GLT_OCCLUSION_HEIGHT				128
+#define GLT_OCCLUSION_MIN_W					1e-5f	// Clip w below this counts as behind the eye
+#define GLT_OCCLUSION_PARALLEL_TRIANGLES	256		// Fewer are rasterized on the calling thread
+#define GLT_OCCLUSION_MIN_ROWS				16		// Rows per thread at least
+
+// A triangle ready to rasterize. Each edge function is A * x + B * y + C,
+// already moved in by half a pixel so it is not negative only where the
+// whole pixel is inside, and the depth plane is moved to the pixel's far
+// corner. The box is in pixels, end exclusive.
+struct GLOcclusionTriangle
+	{
+	float	eA[3], eB[3], eC[3];
+	float	zA, zB, zC;
+	int		x0, y0, x1, y1;
+	};
+
+inline void gltScalarRasterizeOcclusionRow(float *pDepth, const GLOcclusionTriangle& tri, int y, int x0, int x1)
+	{
+	float py = float(y) + 0.5f;
+	float r0 = tri.eB[0] * py + tri.eC[0];
+	float r1 = tri.eB[1] * py + tri.eC[1];
+	float r2 = tri.eB[2] * py + tri.eC[2];
+	float rz = tri.zB * py + tri.zC;
+	for(int x = x0; x < x1; x++) {
+		float px = float(x) + 0.5f;
+		if(tri.eA[0] * px + r0 >= 0.0f && tri.eA[1] * px + r1 >= 0.0f && tri.eA[2] * px + r2 >= 0.0f) {
+			float z = tri.zA * px + rz;
+			pDepth[x] = (z < pDepth[x]) ? z : pDepth[x];
+			}
+		}
+	}
+
+#if defined(M3D_SIMD_X86)
+// x0 and x1 multiples of four
+M3D_TARGET_SSE2 inline void gltSSE2RasterizeOcclusionRow(float *pDepth, const GLOcclusionTriangle& tri, int y, int x0, int x1)
+	{
+	float py = float(y) + 0.5f;
+	__m128 r0 = _mm_set1_ps(tri.eB[0] * py + tri.eC[0]);
+	__m128 r1 = _mm_set1_ps(tri.eB[1] * py + tri.eC[1]);
+	__m128 r2 = _mm_set1_ps(tri.eB[2] * py + tri.eC[2]);
+	__m128 rz = _mm_set1_ps(tri.zB * py + tri.zC);
+	__m128 a0 = _mm_set1_ps(tri.eA[0]), a1 = _mm_set1_ps(tri.eA[1]), a2 = _mm_set1_ps(tri.eA[2]), az = _mm_set1_ps(tri.zA);
+	__m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+	__m128i ix = _mm_setr_epi32(x0, x0 + 1, x0 + 2, x0 + 3);
+
+	for(int x = x0; x < x1; x += 4) {
+		__m128 px = _mm_add_ps(_mm_cvtepi32_ps(ix), half);
+		__m128 mask = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+		if(_mm_movemask_ps(mask) != 0) {
+			__m128 d = _mm_loadu_ps(pDepth + x);
+			__m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(az, px), rz), d);
+			_mm_storeu_ps(pDepth + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, d)));
+			}
+		ix = _mm_add_epi32(ix, _mm_set1_epi32(4));
+		}
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLOcclusionBuffer
+	{
+	public:
+		GLOcclusionBuffer(int nWidth = GLT_OCCLUSION_WIDTH, int nHeight = GLT_OCCLUSION_HEIGHT) {
+			m3dLoadIdentity44(mViewProjection);
+			SetSize(nWidth, nHeight);
+			}
+
+		// The width is rounded up to a multiple of four
+		void SetSize(int nWidth, int nHeight) {
+			nWidth = (nWidth < 4) ? 4 : nWidth;
+			nHeight = (nHeight < 1) ? 1 : nHeight;
+			nLevelWidth.clear();
+			nLevelHeight.clear();
+			vLevels.clear();
+
+			int w = (nWidth + 3) & ~3, h = nHeight;
+			for(;;) {
+				nLevelWidth.push_back(w);
+				nLevelHeight.push_back(h);
+				vLevels.push_back(std::vector<float>(size_t(w) * h, 1.0f));
+				if(w == 1 && h == 1)
+					break;
+				w = (w + 1) / 2;
+				h = (h + 1) / 2;
+				}
+			}
+
+		inline int GetWidth(void) const { return nLevelWidth[0]; }
+		inline int GetHeight(void) const { return nLevelHeight[0]; }
+		inline int GetLevelCount(void) const { return int(vLevels.size()); }
+		inline int GetLevelWidth(int iLevel) const { return nLevelWidth[iLevel]; }
+		inline int GetLevelHeight(int iLevel) const { return nLevelHeight[iLevel]; }
+		inline const float *GetDepth(int iLevel = 0) const { return &vLevels[iLevel][0]; }
+
+		// Triangles set up since Begin (those left out are not counted)
+		inline int GetTriangleCount(void) const { return int(vTriangles.size()); }
+
+		// Start a frame. mViewProjection takes world space to clip space.
+		void Begin(const M3DMatrix44f mViewProj) {
+			m3dCopyMatrix44(mViewProjection, mViewProj);
+			vTriangles.clear();
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Queue an occluder's triangles. mModel places the mesh in world
+		// space (NULL for none). The mesh must be closed or lie inside what
+		// it stands for, as a proxy with its vertices on the real surface of
+		// a convex object does.
+		void AddOccluder(const M3DVector3f *pVerts, int nVerts, const GLushort *pIndexes, int nIndexes, const float *mModel = NULL) {
+			M3DMatrix44f m;
+			if(mModel != NULL)
+				m3dMatrixMultiply44(m, mViewProjection, mModel);
+			else
+				m3dCopyMatrix44(m, mViewProjection);
+
+			float fWidth = float(GetWidth()), fHeight = float(GetHeight());
+			vScreen.resize(size_t(nVerts) * 4);
+			for(int i = 0; i < nVerts; i++) {
+				M3DVector4f vIn = { pVerts[i][0], pVerts[i][1], pVerts[i][2], 1.0f }, vClip;
+				m3dTransformVector4(vClip, vIn, m);
+				float *s = &vScreen[size_t(i) * 4];
+				if(vClip[3] < GLT_OCCLUSION_MIN_W || vClip[2] < -vClip[3]) {
+					s[3] = 0.0f;		// In front of the near plane
+					continue;
+					}
+				float fInvW = 1.0f / vClip[3];
+				s[0] = (vClip[0] * fInvW * 0.5f + 0.5f) * fWidth;
+				s[1] = (vClip[1] * fInvW * 0.5f + 0.5f) * fHeight;
+				s[2] = vClip[2] * fInvW;
+				s[3] = 1.0f;
+				}
+
+			for(int i = 0; i + 2 < nIndexes; i += 3) {
+				const float *v0 = &vScreen[size_t(pIndexes[i]) * 4];
+				const float *v1 = &vScreen[size_t(pIndexes[i + 1]) * 4];
+				const float *v2 = &vScreen[size_t(pIndexes[i + 2]) * 4];
+				if(v0[3] == 0.0f || v1[3] == 0.0f || v2[3] == 0.0f)
+					continue;
+
+				GLOcclusionTriangle tri;
+				if(SetupTriangle(tri, v0, v1, v2))
+					vTriangles.push_back(tri);
+				}
+			}
+
+		// A mesh batch's client side copy
+		void AddOccluder(const GLMeshBatch& mesh, const float *mModel = NULL) {
+			if(mesh.HasClientData())
+				AddOccluder(mesh.GetVertices(), int(mesh.GetClientVertexCount()), mesh.GetIndexes(), int(mesh.GetClientIndexCount()), mModel);
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Rasterize the queued triangles and build the pyramid
+		void End(void) {
+			std::vector<float>& depth = vLevels[0];
+			std::fill(depth.begin(), depth.end(), 1.0f);
+
+			int nRows = GetHeight();
+			int nMinRows = (int(vTriangles.size()) < GLT_OCCLUSION_PARALLEL_TRIANGLES) ? nRows : GLT_OCCLUSION_MIN_ROWS;
+			gltParallelFor(nRows, nMinRows, [this](int iBegin, int iEnd, int) {
+				RasterizeRows(iBegin, iEnd);
+				});
+
+			for(int l = 1; l < GetLevelCount(); l++)
+				BuildLevel(l);
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// False when the box is certainly behind the occluders
+		bool TestAABB(const M3DVector3f vMin, const M3DVector3f vMax) const {
+			float xMin = FLT_MAX, yMin = FLT_MAX, xMax = -FLT_MAX, yMax = -FLT_MAX, zMin = FLT_MAX;
+			for(int c = 0; c < 8; c++) {
+				M3DVector4f vIn = { (c & 1) ? vMax[0] : vMin[0], (c & 2) ? vMax[1] : vMin[1], (c & 4) ? vMax[2] : vMin[2], 1.0f }, vClip;
+				m3dTransformVector4(vClip, vIn, mViewProjection);
+				if(vClip[3] < GLT_OCCLUSION_MIN_W || vClip[2] < -vClip[3])
+					return true;
+
+				float fInvW = 1.0f / vClip[3];
+				float x = vClip[0] * fInvW, y = vClip[1] * fInvW, z = vClip[2] * fInvW;
+				xMin = (x < xMin) ? x : xMin; xMax = (x > xMax) ? x : xMax;
+				yMin = (y < yMin) ? y : yMin; yMax = (y > yMax) ? y : yMax;
+				zMin = (z < zMin) ? z : zMin;
+				}
+
+			// Pixels the box touches, clamped to the buffer
+			int w = GetWidth(), h = GetHeight();
+			int px0 = ClampPixel(floorf((xMin * 0.5f + 0.5f) * w), w);
+			int px1 = ClampPixel(floorf((xMax * 0.5f + 0.5f) * w), w);
+			int py0 = ClampPixel(floorf((yMin * 0.5f + 0.5f) * h), h);
+			int py1 = ClampPixel(floorf((yMax * 0.5f + 0.5f) * h), h);
+
+			// The level where the box spans at most two by two
+			int l = 0;
+			while(l + 1 < GetLevelCount() && ((px1 >> l) - (px0 >> l) > 1 || (py1 >> l) - (py0 >> l) > 1))
+				l++;
+
+			const float *pDepth = GetDepth(l);
+			int lw = nLevelWidth[l];
+			for(int y = py0 >> l; y <= (py1 >> l); y++)
+				for(int x = px0 >> l; x <= (px1 >> l); x++)
+					if(zMin < pDepth[y * lw + x])
+						return true;
+			return false;
+			}
+
+		bool TestSphere(const M3DVector3f vCenter, float fRadius) const {
+			M3DVector3f vMin = { vCenter[0] - fRadius, vCenter[1] - fRadius, vCenter[2] - fRadius };
+			M3DVector3f vMax = { vCenter[0] + fRadius, vCenter[1] + fRadius, vCenter[2] + fRadius };
+			return TestAABB(vMin, vMax);
+			}
+
+		// Clear the bits in pVisible (as GLBVH::Cull sets them) of objects
+		// behind the occluders. Returns how many were cleared.
+		int CullHidden(const GLBVH& bvh, GLuint *pVisible) const {
+			int nHidden = 0;
+			for(int i = 0; i < bvh.GetObjectCount(); i++) {
+				GLuint bit = 1u << (i & 31);
+				if(!(pVisible[i >> 5] & bit))
+					continue;
+
+				const GLBVHBounds& b = bvh.GetObjectBounds(i);
+				if(!TestAABB(b.vMin, b.vMax)) {
+					pVisible[i >> 5] &= ~bit;
+					nHidden++;
+					}
+				}
+			return nHidden;
+			}
+
+	protected:
+		static inline int ClampPixel(float f, int n) {
+			return (f < 0.0f) ? 0 : ((f >= float(n)) ? n - 1 : int(f));
+			}
+
+		// Screen space vertices, x y in pixels and normalized z. False for
+		// triangles with no area or no pixels.
+		bool SetupTriangle(GLOcclusionTriangle& tri, const float *v0, const float *v1, const float *v2) const {
+			float fArea = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+			if(!(fArea != 0.0f))
+				return false;
+			if(fArea < 0.0f) {
+				// Either winding is drawn; make it counter clockwise
+				const float *t = v1; v1 = v2; v2 = t;
+				fArea = -fArea;
+				}
+
+			const float *v[3] = { v0, v1, v2 };
+			for(int e = 0; e < 3; e++) {
+				const float *a = v[e], *b = v[(e + 1) % 3];
+				tri.eA[e] = a[1] - b[1];
+				tri.eB[e] = b[0] - a[0];
+				tri.eC[e] = a[0] * b[1] - b[0] * a[1] - 0.5f * (fabsf(tri.eA[e]) + fabsf(tri.eB[e]));
+				}
+
+			float dz1 = v1[2] - v0[2], dz2 = v2[2] - v0[2];
+			tri.zA = (dz1 * (v2[1] - v0[1]) - dz2 * (v1[1] - v0[1])) / fArea;
+			tri.zB = (dz2 * (v1[0] - v0[0]) - dz1 * (v2[0] - v0[0])) / fArea;
+			tri.zC = v0[2] - tri.zA * v0[0] - tri.zB * v0[1] + 0.5f * (fabsf(tri.zA) + fabsf(tri.zB));
+
+			float xMin = fminf(v0[0], fminf(v1[0], v2[0])), xMax = fmaxf(v0[0], fmaxf(v1[0], v2[0]));
+			float yMin = fminf(v0[1], fminf(v1[1], v2[1])), yMax = fmaxf(v0[1], fmaxf(v1[1], v2[1]));
+			float fWidth = float(GetWidth()), fHeight = float(GetHeight());
+			if(xMax <= 0.0f || yMax <= 0.0f || xMin >= fWidth || yMin >= fHeight)
+				return false;
+
+			tri.x0 = (xMin > 0.0f) ? int(xMin) : 0;
+			tri.y0 = (yMin > 0.0f) ? int(yMin) : 0;
+			tri.x1 = (xMax < fWidth) ? int(ceilf(xMax)) : GetWidth();
+			tri.y1 = (yMax < fHeight) ? int(ceilf(yMax)) : GetHeight();
+			return tri.x0 < tri.x1 && tri.y0 < tri.y1;
+			}
+
+		void RasterizeRows(int iBegin, int iEnd) {
+			float *pDepth = &vLevels[0][0];
+			int w = GetWidth();
+#if defined(M3D_SIMD_X86)
+			bool bSSE2 = m3dSIMDGetLevel() >= M3D_SIMD_SSE2;
+#endif
+			for(size_t t = 0; t < vTriangles.size(); t++) {
+				const GLOcclusionTriangle& tri = vTriangles[t];
+				int y0 = (tri.y0 > iBegin) ? tri.y0 : iBegin;
+				int y1 = (tri.y1 < iEnd) ? tri.y1 : iEnd;
+				for(int y = y0; y < y1; y++) {
+#if defined(M3D_SIMD_X86)
+					if(bSSE2) {
+						// Pixels outside the triangle's box fail its edges
+						gltSSE2RasterizeOcclusionRow(pDepth + y * w, tri, y, tri.x0 & ~3, (tri.x1 + 3) & ~3);
+						continue;
+						}
+#endif
+					gltScalarRasterizeOcclusionRow(pDepth + y * w, tri, y, tri.x0, tri.x1);
+					}
+				}
+			}
+
+		void BuildLevel(int l) {
+			const float *pSrc = &vLevels[l - 1][0];
+			float *pDst = &vLevels[l][0];
+			int sw = nLevelWidth[l - 1], sh = nLevelHeight[l - 1];
+			int w = nLevelWidth[l], h = nLevelHeight[l];
+			for(int y = 0; y < h; y++) {
+				int sy0 = 2 * y, sy1 = (2 * y + 1 < sh) ? 2 * y + 1 : 2 * y;
+				for(int x = 0; x < w; x++) {
+					int sx0 = 2 * x, sx1 = (2 * x + 1 < sw) ? 2 * x + 1 : 2 * x;
+					float a = fmaxf(pSrc[sy0 * sw + sx0], pSrc[sy0 * sw + sx1]);
+					float b = fmaxf(pSrc[sy1 * sw + sx0], pSrc[sy1 * sw + sx1]);
+					pDst[y * w + x] = fmaxf(a, b);
+					}
+				}
+			}
+
+		M3DMatrix44f						mViewProjection;
+		std::vector<int>					nLevelWidth, nLevelHeight;
+		std::vector<std::vector<float> >	vLevels;		// Level 0 is the full buffer
+		std::vector<GLOcclusionTriangle>	vTriangles;
+		std::vector<float>					vScreen;		// Scratch for AddOccluder
+	};
+
+#endif
@@ -0,0 +1,170 @@
+// GLPackedShaders.h
+// The lit stock shaders for meshes with octahedral normals.
+//
+// Quantized positions, half float texture coordinates and 10_10_10_2 normals
+// are expanded by the vertex fetch hardware, so the stock shaders draw them
+// as they are. Octahedral normals (GLT_PACK_NORMAL_OCT) arrive as two numbers
+// and have to be unfolded in the shader. GLPackedShaders has versions of the
+// three stock shaders that take a normal, doing that first and otherwise
+// matching the stock ones. UseStockShader takes the same arguments as
+// GLShaderManager::UseStockShader:
+//
+//	GLT_SHADER_DEFAULT_LIGHT				modelview, projection, color
+//	GLT_SHADER_POINT_LIGHT_DIFF				modelview, projection, light position, color
+//	GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF		modelview, projection, light position, color, texture unit
+//
+// Other stock shaders don't read the normal; use GLShaderManager's.
+
+#ifndef __GL_PACKED_SHADERS
+#define __GL_PACKED_SHADERS
+
+#include "GLTools.h"
+#include "GLShaderManager.h"
+#include <stdarg.h>
+
+// Shared vertex shader start: the declarations, and eyeNormal() giving the
+// unfolded normal in eye space
+#define GLT_OCT_NORMAL_VP_HEAD \
+	"uniform mat4 mvMatrix;" \
+	"uniform mat4 pMatrix;" \
+	"uniform vec4 vColor;" \
+	"attribute vec4 vVertex;" \
+	"attribute vec2 vNormal;" \
+	"varying vec4 vFluffyColor;" \
+	"vec3 octDecode(vec2 e) {" \
+	"  vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));" \
+	"  if(n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);" \
+	"  return normalize(n); }" \
+	"vec3 eyeNormal(void) {" \
+	"  mat3 mNormalMatrix;" \
+	"  mNormalMatrix[0] = normalize(mvMatrix[0].xyz);" \
+	"  mNormalMatrix[1] = normalize(mvMatrix[1].xyz);" \
+	"  mNormalMatrix[2] = normalize(mvMatrix[2].xyz);" \
+	"  return normalize(mNormalMatrix * octDecode(vNormal)); }"
+
+static const char szOctDefaultLightVP[] =
+	GLT_OCT_NORMAL_VP_HEAD
+	"void main(void) {"
+	"  vec3 vLightDir = vec3(0.0, 0.0, 1.0);"
+	"  float fDot = max(0.0, dot(eyeNormal(), vLightDir));"
+	"  vFluffyColor.rgb = vColor.rgb * fDot;"
+	"  vFluffyColor.a = vColor.a;"
+	"  gl_Position = pMatrix * mvMatrix * vVertex; }";
+
+static const char szOctPointLightDiffVP[] =
+	"uniform vec3 vLightPos;"
+	GLT_OCT_NORMAL_VP_HEAD
+	"void main(void) {"
+	"  vec4 ecPosition = mvMatrix * vVertex;"
+	"  vec3 vLightDir = normalize(vLightPos - ecPosition.xyz / ecPosition.w);"
+	"  float fDot = max(0.0, dot(eyeNormal(), vLightDir));"
+	"  vFluffyColor.rgb = vColor.rgb * fDot;"
+	"  vFluffyColor.a = vColor.a;"
+	"  gl_Position = pMatrix * ecPosition; }";
+
+static const char szOctTexturePointLightDiffVP[] =
+	"uniform vec3 vLightPos;"
+	"attribute vec2 vTexture0;"
+	"varying vec2 vTex;"
+	GLT_OCT_NORMAL_VP_HEAD
+	"void main(void) {"
+	"  vec4 ecPosition = mvMatrix * vVertex;"
+	"  vec3 vLightDir = normalize(vLightPos - ecPosition.xyz / ecPosition.w);"
+	"  float fDot = max(0.0, dot(eyeNormal(), vLightDir));"
+	"  vFluffyColor.rgb = vColor.rgb * fDot;"
+	"  vFluffyColor.a = vColor.a;"
+	"  vTex = vTexture0;"
+	"  gl_Position = pMatrix * ecPosition; }";
+
+static const char szOctLightFP[] =
+#ifdef OPENGL_ES
+	"varying lowp vec4 vFluffyColor;"
+#else
+	"varying vec4 vFluffyColor;"
+#endif
+	"void main(void) { gl_FragColor = vFluffyColor; }";
+
+static const char szOctTextureLightFP[] =
+#ifdef OPENGL_ES
+	"varying lowp vec4 vFluffyColor;"
+	"varying mediump vec2 vTex;"
+#else
+	"varying vec4 vFluffyColor;"
+	"varying vec2 vTex;"
+#endif
+	"uniform sampler2D textureUnit0;"
+	"void main(void) { gl_FragColor = texture2D(textureUnit0, vTex) * vFluffyColor; }";
+
+
+class GLPackedShaders
+	{
+	public:
+		GLPackedShaders(void) : uiDefaultLight(0), uiPointLightDiff(0), uiTexturePointLightDiff(0) {}
+		~GLPackedShaders(void) {
+			if(uiDefaultLight != 0) glDeleteProgram(uiDefaultLight);
+			if(uiPointLightDiff != 0) glDeleteProgram(uiPointLightDiff);
+			if(uiTexturePointLightDiff != 0) glDeleteProgram(uiTexturePointLightDiff);
+			}
+
+		// Call once there is a GL context, as InitializeStockShaders
+		bool InitializeShaders(void) {
+			uiDefaultLight = gltLoadShaderPairSrcWithAttributes(szOctDefaultLightVP, szOctLightFP, 2,
+										GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal");
+			uiPointLightDiff = gltLoadShaderPairSrcWithAttributes(szOctPointLightDiffVP, szOctLightFP, 2,
+										GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal");
+			uiTexturePointLightDiff = gltLoadShaderPairSrcWithAttributes(szOctTexturePointLightDiffVP, szOctTextureLightFP, 3,
+										GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal",
+										GLT_ATTRIBUTE_TEXTURE0, "vTexture0");
+			return uiDefaultLight != 0 && uiPointLightDiff != 0 && uiTexturePointLightDiff != 0;
+			}
+
+		// Program for a stock shader ID, 0 for ones with no octahedral version
+		GLuint GetShader(GLT_STOCK_SHADER nShaderID) const {
+			switch(nShaderID) {
+				case GLT_SHADER_DEFAULT_LIGHT: return uiDefaultLight;
+				case GLT_SHADER_POINT_LIGHT_DIFF: return uiPointLightDiff;
+				case GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF: return uiTexturePointLightDiff;
+				default: return 0;
+				}
+			}
+
+		// Bind and set uniforms as GLShaderManager::UseStockShader does.
+		// Returns the program, or -1 for a shader with no octahedral version.
+		GLint UseStockShader(GLT_STOCK_SHADER nShaderID, ...) {
+			GLuint uiProgram = GetShader(nShaderID);
+			if(uiProgram == 0)
+				return -1;
+
+			va_list uniformList;
+			va_start(uniformList, nShaderID);
+			glUseProgram(uiProgram);
+
+			M3DMatrix44f *mvMatrix = va_arg(uniformList, M3DMatrix44f *);
+			glUniformMatrix4fv(glGetUniformLocation(uiProgram, "mvMatrix"), 1, GL_FALSE, *mvMatrix);
+			M3DMatrix44f *pMatrix = va_arg(uniformList, M3DMatrix44f *);
+			glUniformMatrix4fv(glGetUniformLocation(uiProgram, "pMatrix"), 1, GL_FALSE, *pMatrix);
+
+			if(nShaderID != GLT_SHADER_DEFAULT_LIGHT) {
+				M3DVector3f *vLightPos = va_arg(uniformList, M3DVector3f *);
+				glUniform3fv(glGetUniformLocation(uiProgram, "vLightPos"), 1, *vLightPos);
+				}
+
+			M3DVector4f *vColor = va_arg(uniformList, M3DVector4f *);
+			glUniform4fv(glGetUniformLocation(uiProgram, "vColor"), 1, *vColor);
+
+			if(nShaderID == GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF) {
+				GLint iTextureUnit = va_arg(uniformList, GLint);
+				glUniform1i(glGetUniformLocation(uiProgram, "textureUnit0"), iTextureUnit);
+				}
+
+			va_end(uniformList);
+			return GLint(uiProgram);
+			}
+
+	protected:
+		GLuint	uiDefaultLight;
+		GLuint	uiPointLightDiff;
+		GLuint	uiTexturePointLightDiff;
+	};
+
+#endif
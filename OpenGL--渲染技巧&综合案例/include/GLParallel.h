@@ -0,0 +1,74 @@
+// GLParallel.h
+// Splitting a loop over the available cores.
+//
+// gltParallelFor(nCount, nMinPerThread, fn) runs fn(iBegin, iEnd, iThread)
+// over contiguous pieces of [0, nCount), one per thread, and returns when all
+// of them are done. The calling thread takes the first piece. Loops too short
+// to give every thread nMinPerThread items use fewer threads, down to just
+// the caller, so small meshes don't pay for starting threads.
+//
+// iThread runs from 0 to the thread count less one, so per thread scratch
+// space can be sized with gltParallelThreadCount() beforehand.
+
+#ifndef __GL_PARALLEL
+#define __GL_PARALLEL
+
+#include <thread>
+#include <vector>
+
+// Upper limit on worker threads, 0 for one per core. Set to 1 to run
+// everything on the calling thread.
+inline int& gltParallelMaxThreads(void)
+	{
+	static int nMax = 0;
+	return nMax;
+	}
+
+inline int gltParallelHardwareThreads(void)
+	{
+	static int nCores = int(std::thread::hardware_concurrency());
+	return (nCores > 0) ? nCores : 1;
+	}
+
+// Threads a loop of nCount items will be split over
+inline int gltParallelThreadCount(int nCount, int nMinPerThread)
+	{
+	int nThreads = gltParallelHardwareThreads();
+	if(gltParallelMaxThreads() > 0 && gltParallelMaxThreads() < nThreads)
+		nThreads = gltParallelMaxThreads();
+
+	if(nMinPerThread < 1)
+		nMinPerThread = 1;
+	int nUseful = nCount / nMinPerThread;
+	if(nUseful < nThreads)
+		nThreads = nUseful;
+	return (nThreads > 0) ? nThreads : 1;
+	}
+
+template <class Function>
+inline void gltParallelFor(int nCount, int nMinPerThread, Function fn)
+	{
+	if(nCount <= 0)
+		return;
+
+	int nThreads = gltParallelThreadCount(nCount, nMinPerThread);
+	if(nThreads == 1) {
+		fn(0, nCount, 0);
+		return;
+		}
+
+	std::vector<std::thread> workers;
+	workers.reserve(nThreads - 1);
+	for(int i = 1; i < nThreads; i++) {
+		int iBegin = int((long long)nCount * i / nThreads);
+		int iEnd = int((long long)nCount * (i + 1) / nThreads);
+		workers.push_back(std::thread(fn, iBegin, iEnd, i));
+		}
+
+	fn(0, int((long long)nCount / nThreads), 0);
+
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	}
+
+#endif
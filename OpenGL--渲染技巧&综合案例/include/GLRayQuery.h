@@ -0,0 +1,512 @@
+// GLRayQuery.h
+// Nearest hit ray queries against many spheres or triangles at once, for
+// picking.
+//
+// m3dRaySphereTest checks one ray against one sphere. GLSphereSet and
+// GLTriangleSoup keep their primitives as separate x[], y[], z[] streams,
+// padded to a multiple of eight with entries that can never be hit, so a ray
+// is tested against four (SSE2) or eight (AVX2) of them per step with no
+// branches. Each query returns the nearest hit. A packet of rays is run as
+// one query per ray.
+//
+// The scalar, SSE2 and AVX2 paths do the same float operations and return
+// the same hit. The instruction set follows m3dSIMDGetLevel().
+
+#ifndef __GL_RAY_QUERY
+#define __GL_RAY_QUERY
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "GLFrame.h"
+#include "GLMeshBatch.h"
+#include <float.h>
+#include <vector>
+
+#define GLT_RAY_QUERY_PAD		8
+
+// Result of a query. iIndex is -1 on a miss. For triangles fU and fV are the
+// barycentric coordinates of the hit (weights of the second and third
+// vertex); for spheres they are zero.
+struct GLRayHit
+	{
+	int		iIndex;
+	float	fDistance;
+	float	fU, fV;
+	};
+
+inline void gltRayHitReset(GLRayHit& hit)
+	{
+	hit.iIndex = -1;
+	hit.fDistance = FLT_MAX;
+	hit.fU = hit.fV = 0.0f;
+	}
+
+// Keep the nearer of two hits, the lower index on a tie
+inline void gltRayHitMerge(GLRayHit& hit, int iIndex, float fDistance, float fU, float fV)
+	{
+	if(iIndex < 0)
+		return;
+
+	if(fDistance < hit.fDistance || (fDistance == hit.fDistance && (hit.iIndex < 0 || iIndex < hit.iIndex))) {
+		hit.iIndex = iIndex;
+		hit.fDistance = fDistance;
+		hit.fU = fU;
+		hit.fV = fV;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels. The sphere test follows m3dRaySphereTest (unit direction, distance
+// to the near side, or the far side when the ray starts inside). Triangles
+// use Moller-Trumbore on precomputed edges, two sided.
+#define GLT_RAY_TRIANGLE_EPSILON	1e-12f
+#define GLT_RAY_MIN_DISTANCE		1e-6f
+
+inline void gltScalarRaySpheres(GLRayHit& hit, const float *o, const float *d,
+								const float *cx, const float *cy, const float *cz, const float *r2,
+								int iStart, int iEnd)
+	{
+	for(int i = iStart; i < iEnd; i++) {
+		float lx = cx[i] - o[0], ly = cy[i] - o[1], lz = cz[i] - o[2];
+		float tca = lx * d[0] + ly * d[1] + lz * d[2];
+		float h = r2[i] - ((lx * lx + ly * ly + lz * lz) - tca * tca);
+		if(!(h >= 0.0f))
+			continue;
+
+		float thc = sqrtf(h);
+		float t = tca - thc;
+		if(!(t >= 0.0f))
+			t = tca + thc;
+		if(t >= 0.0f && t < hit.fDistance) {
+			hit.iIndex = i;
+			hit.fDistance = t;
+			}
+		}
+	}
+
+inline void gltScalarRayTriangles(GLRayHit& hit, const float *o, const float *d, const float * const *tri,
+								  int iStart, int iEnd)
+	{
+	const float *v0x = tri[0], *v0y = tri[1], *v0z = tri[2];
+	const float *e1x = tri[3], *e1y = tri[4], *e1z = tri[5];
+	const float *e2x = tri[6], *e2y = tri[7], *e2z = tri[8];
+
+	for(int i = iStart; i < iEnd; i++) {
+		float px = d[1] * e2z[i] - d[2] * e2y[i];
+		float py = d[2] * e2x[i] - d[0] * e2z[i];
+		float pz = d[0] * e2y[i] - d[1] * e2x[i];
+		float det = e1x[i] * px + e1y[i] * py + e1z[i] * pz;
+		if(!(fabsf(det) > GLT_RAY_TRIANGLE_EPSILON))
+			continue;
+
+		float inv = 1.0f / det;
+		float sx = o[0] - v0x[i], sy = o[1] - v0y[i], sz = o[2] - v0z[i];
+		float u = (sx * px + sy * py + sz * pz) * inv;
+		float qx = sy * e1z[i] - sz * e1y[i];
+		float qy = sz * e1x[i] - sx * e1z[i];
+		float qz = sx * e1y[i] - sy * e1x[i];
+		float v = (d[0] * qx + d[1] * qy + d[2] * qz) * inv;
+		float t = (e2x[i] * qx + e2y[i] * qy + e2z[i] * qz) * inv;
+
+		if(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > GLT_RAY_MIN_DISTANCE && t < hit.fDistance) {
+			hit.iIndex = i;
+			hit.fDistance = t;
+			hit.fU = u;
+			hit.fV = v;
+			}
+		}
+	}
+
+
+#if defined(M3D_SIMD_X86)
+// Lane results to a single hit
+inline void gltRayHitReduce(GLRayHit& hit, const float *t, const int *idx, const float *u, const float *v, int nLanes)
+	{
+	for(int l = 0; l < nLanes; l++)
+		gltRayHitMerge(hit, idx[l], t[l], u[l], v[l]);
+	}
+
+M3D_TARGET_SSE2 inline __m128 gltSSE2Select(__m128 mask, __m128 a, __m128 b)
+	{ return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+M3D_TARGET_SSE2 inline void gltSSE2RaySpheres(GLRayHit& hit, const float *o, const float *d,
+											  const float *cx, const float *cy, const float *cz, const float *r2, int nCount)
+	{
+	__m128 ox = _mm_set1_ps(o[0]), oy = _mm_set1_ps(o[1]), oz = _mm_set1_ps(o[2]);
+	__m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+	__m128 zero = _mm_setzero_ps();
+	__m128 bestT = _mm_set1_ps(FLT_MAX);
+	__m128i bestI = _mm_set1_epi32(-1);
+	__m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+
+	for(int i = 0; i < nCount; i += 4) {
+		__m128 lx = _mm_sub_ps(_mm_loadu_ps(cx + i), ox);
+		__m128 ly = _mm_sub_ps(_mm_loadu_ps(cy + i), oy);
+		__m128 lz = _mm_sub_ps(_mm_loadu_ps(cz + i), oz);
+		__m128 tca = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, dx), _mm_mul_ps(ly, dy)), _mm_mul_ps(lz, dz));
+		__m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+		__m128 h = _mm_sub_ps(_mm_loadu_ps(r2 + i), _mm_sub_ps(l2, _mm_mul_ps(tca, tca)));
+		__m128 mask = _mm_cmpge_ps(h, zero);
+
+		__m128 thc = _mm_sqrt_ps(_mm_max_ps(h, zero));
+		__m128 t0 = _mm_sub_ps(tca, thc);
+		__m128 t = gltSSE2Select(_mm_cmpge_ps(t0, zero), t0, _mm_add_ps(tca, thc));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, bestT)));
+
+		bestT = gltSSE2Select(mask, t, bestT);
+		bestI = _mm_castps_si128(gltSSE2Select(mask, _mm_castsi128_ps(idx), _mm_castsi128_ps(bestI)));
+		idx = _mm_add_epi32(idx, _mm_set1_epi32(4));
+		}
+
+	float t[4], u[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	int index[4];
+	_mm_storeu_ps(t, bestT);
+	_mm_storeu_si128((__m128i *)index, bestI);
+	gltRayHitReduce(hit, t, index, u, u, 4);
+	}
+
+M3D_TARGET_SSE2 inline void gltSSE2RayTriangles(GLRayHit& hit, const float *o, const float *d, const float * const *tri, int nCount)
+	{
+	__m128 ox = _mm_set1_ps(o[0]), oy = _mm_set1_ps(o[1]), oz = _mm_set1_ps(o[2]);
+	__m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	__m128 eps = _mm_set1_ps(GLT_RAY_TRIANGLE_EPSILON), tMin = _mm_set1_ps(GLT_RAY_MIN_DISTANCE);
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 bestT = _mm_set1_ps(FLT_MAX), bestU = zero, bestV = zero;
+	__m128i bestI = _mm_set1_epi32(-1);
+	__m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+
+	for(int i = 0; i < nCount; i += 4) {
+		__m128 e1x = _mm_loadu_ps(tri[3] + i), e1y = _mm_loadu_ps(tri[4] + i), e1z = _mm_loadu_ps(tri[5] + i);
+		__m128 e2x = _mm_loadu_ps(tri[6] + i), e2y = _mm_loadu_ps(tri[7] + i), e2z = _mm_loadu_ps(tri[8] + i);
+
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 mask = _mm_cmpgt_ps(_mm_and_ps(det, absMask), eps);
+		__m128 inv = _mm_div_ps(one, det);
+
+		__m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(tri[0] + i));
+		__m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(tri[1] + i));
+		__m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(tri[2] + i));
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, tMin), _mm_cmplt_ps(t, bestT)));
+
+		bestT = gltSSE2Select(mask, t, bestT);
+		bestU = gltSSE2Select(mask, u, bestU);
+		bestV = gltSSE2Select(mask, v, bestV);
+		bestI = _mm_castps_si128(gltSSE2Select(mask, _mm_castsi128_ps(idx), _mm_castsi128_ps(bestI)));
+		idx = _mm_add_epi32(idx, _mm_set1_epi32(4));
+		}
+
+	float t[4], u[4], v[4];
+	int index[4];
+	_mm_storeu_ps(t, bestT);
+	_mm_storeu_ps(u, bestU);
+	_mm_storeu_ps(v, bestV);
+	_mm_storeu_si128((__m128i *)index, bestI);
+	gltRayHitReduce(hit, t, index, u, v, 4);
+	}
+
+M3D_TARGET_AVX2 inline void gltAVX2RaySpheres(GLRayHit& hit, const float *o, const float *d,
+											  const float *cx, const float *cy, const float *cz, const float *r2, int nCount)
+	{
+	__m256 ox = _mm256_set1_ps(o[0]), oy = _mm256_set1_ps(o[1]), oz = _mm256_set1_ps(o[2]);
+	__m256 dx = _mm256_set1_ps(d[0]), dy = _mm256_set1_ps(d[1]), dz = _mm256_set1_ps(d[2]);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 bestT = _mm256_set1_ps(FLT_MAX);
+	__m256i bestI = _mm256_set1_epi32(-1);
+	__m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for(int i = 0; i < nCount; i += 8) {
+		__m256 lx = _mm256_sub_ps(_mm256_loadu_ps(cx + i), ox);
+		__m256 ly = _mm256_sub_ps(_mm256_loadu_ps(cy + i), oy);
+		__m256 lz = _mm256_sub_ps(_mm256_loadu_ps(cz + i), oz);
+		__m256 tca = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, dx), _mm256_mul_ps(ly, dy)), _mm256_mul_ps(lz, dz));
+		__m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+		__m256 h = _mm256_sub_ps(_mm256_loadu_ps(r2 + i), _mm256_sub_ps(l2, _mm256_mul_ps(tca, tca)));
+		__m256 mask = _mm256_cmp_ps(h, zero, _CMP_GE_OQ);
+
+		__m256 thc = _mm256_sqrt_ps(_mm256_max_ps(h, zero));
+		__m256 t0 = _mm256_sub_ps(tca, thc);
+		__m256 t = _mm256_blendv_ps(_mm256_add_ps(tca, thc), t0, _mm256_cmp_ps(t0, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+
+		bestT = _mm256_blendv_ps(bestT, t, mask);
+		bestI = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestI), _mm256_castsi256_ps(idx), mask));
+		idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+		}
+
+	float t[8], u[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	int index[8];
+	_mm256_storeu_ps(t, bestT);
+	_mm256_storeu_si256((__m256i *)index, bestI);
+	gltRayHitReduce(hit, t, index, u, u, 8);
+	}
+
+M3D_TARGET_AVX2 inline void gltAVX2RayTriangles(GLRayHit& hit, const float *o, const float *d, const float * const *tri, int nCount)
+	{
+	__m256 ox = _mm256_set1_ps(o[0]), oy = _mm256_set1_ps(o[1]), oz = _mm256_set1_ps(o[2]);
+	__m256 dx = _mm256_set1_ps(d[0]), dy = _mm256_set1_ps(d[1]), dz = _mm256_set1_ps(d[2]);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	__m256 eps = _mm256_set1_ps(GLT_RAY_TRIANGLE_EPSILON), tMin = _mm256_set1_ps(GLT_RAY_MIN_DISTANCE);
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 bestT = _mm256_set1_ps(FLT_MAX), bestU = zero, bestV = zero;
+	__m256i bestI = _mm256_set1_epi32(-1);
+	__m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for(int i = 0; i < nCount; i += 8) {
+		__m256 e1x = _mm256_loadu_ps(tri[3] + i), e1y = _mm256_loadu_ps(tri[4] + i), e1z = _mm256_loadu_ps(tri[5] + i);
+		__m256 e2x = _mm256_loadu_ps(tri[6] + i), e2y = _mm256_loadu_ps(tri[7] + i), e2z = _mm256_loadu_ps(tri[8] + i);
+
+		__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+		__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+		__m256 mask = _mm256_cmp_ps(_mm256_and_ps(det, absMask), eps, _CMP_GT_OQ);
+		__m256 inv = _mm256_div_ps(one, det);
+
+		__m256 sx = _mm256_sub_ps(ox, _mm256_loadu_ps(tri[0] + i));
+		__m256 sy = _mm256_sub_ps(oy, _mm256_loadu_ps(tri[1] + i));
+		__m256 sz = _mm256_sub_ps(oz, _mm256_loadu_ps(tri[2] + i));
+		__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inv);
+
+		__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+		__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+		__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+		__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv);
+
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GT_OQ), _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+
+		bestT = _mm256_blendv_ps(bestT, t, mask);
+		bestU = _mm256_blendv_ps(bestU, u, mask);
+		bestV = _mm256_blendv_ps(bestV, v, mask);
+		bestI = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestI), _mm256_castsi256_ps(idx), mask));
+		idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+		}
+
+	float t[8], u[8], v[8];
+	int index[8];
+	_mm256_storeu_ps(t, bestT);
+	_mm256_storeu_ps(u, bestU);
+	_mm256_storeu_ps(v, bestV);
+	_mm256_storeu_si256((__m256i *)index, bestI);
+	gltRayHitReduce(hit, t, index, u, v, 8);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// A set of spheres to pick from
+class GLSphereSet
+	{
+	public:
+		GLSphereSet(void) : nCount(0) {}
+
+		void Clear(void) {
+			nCount = 0;
+			x.clear(); y.clear(); z.clear(); r2.clear();
+			}
+
+		inline int GetCount(void) const { return nCount; }
+
+		// Returns the index the sphere will be reported with
+		int Add(float fX, float fY, float fZ, float fRadius) {
+			int i = nCount++;
+			if(i == int(x.size()))
+				Grow();
+			Set(i, fX, fY, fZ, fRadius);
+			return i;
+			}
+
+		inline int Add(const M3DVector3f vCenter, float fRadius) { return Add(vCenter[0], vCenter[1], vCenter[2], fRadius); }
+
+		// Move or resize an existing sphere
+		inline void Set(int i, float fX, float fY, float fZ, float fRadius) {
+			x[i] = fX; y[i] = fY; z[i] = fZ; r2[i] = fRadius * fRadius;
+			}
+
+		// One sphere per frame origin, all the same size. Index i is pFrames[i].
+		void SetFromFrames(GLFrame *pFrames, int nFrames, float fRadius) {
+			Clear();
+			for(int i = 0; i < nFrames; i++)
+				Add(pFrames[i].GetOriginX(), pFrames[i].GetOriginY(), pFrames[i].GetOriginZ(), fRadius);
+			}
+
+		// Nearest sphere along the ray. vDirection need not be unit length,
+		// the distance is measured in world units either way.
+		GLRayHit Intersect(const M3DVector3f vOrigin, const M3DVector3f vDirection) const {
+			GLRayHit hit;
+			gltRayHitReset(hit);
+			if(nCount == 0)
+				return hit;
+
+			M3DVector3f vDir;
+			m3dCopyVector3(vDir, vDirection);
+			m3dNormalizeVector3(vDir);
+
+			int nPadded = int(x.size());
+#if defined(M3D_SIMD_X86)
+			M3D_SIMD_LEVEL level = m3dSIMDGetLevel();
+			if(level >= M3D_SIMD_AVX2)
+				gltAVX2RaySpheres(hit, vOrigin, vDir, &x[0], &y[0], &z[0], &r2[0], nPadded);
+			else if(level >= M3D_SIMD_SSE2)
+				gltSSE2RaySpheres(hit, vOrigin, vDir, &x[0], &y[0], &z[0], &r2[0], nPadded);
+			else
+#endif
+				gltScalarRaySpheres(hit, vOrigin, vDir, &x[0], &y[0], &z[0], &r2[0], 0, nPadded);
+			return hit;
+			}
+
+		// A packet of rays, one hit each
+		void Intersect(const M3DVector3f *pOrigins, const M3DVector3f *pDirections, int nRays, GLRayHit *pHits) const {
+			for(int i = 0; i < nRays; i++)
+				pHits[i] = Intersect(pOrigins[i], pDirections[i]);
+			}
+
+	protected:
+		// Padding spheres have a negative squared radius, so never hit
+		void Grow(void) {
+			size_t n = x.size() + GLT_RAY_QUERY_PAD;
+			x.resize(n, 0.0f); y.resize(n, 0.0f); z.resize(n, 0.0f); r2.resize(n, -1.0f);
+			}
+
+		int nCount;
+		std::vector<float> x, y, z, r2;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// A triangle soup to pick from. Each triangle is stored as its first vertex
+// and two edges, so transformed copies of a mesh can be added in world space.
+class GLTriangleSoup
+	{
+	public:
+		GLTriangleSoup(void) : nCount(0) {}
+
+		void Clear(void) {
+			nCount = 0;
+			for(int c = 0; c < 9; c++)
+				stream[c].clear();
+			}
+
+		inline int GetCount(void) const { return nCount; }
+
+		// Returns the index the triangle will be reported with
+		int AddTriangle(const M3DVector3f v0, const M3DVector3f v1, const M3DVector3f v2) {
+			int i = nCount++;
+			if(i == int(stream[0].size())) {
+				// Padding triangles are degenerate, so never hit
+				for(int c = 0; c < 9; c++)
+					stream[c].resize(stream[c].size() + GLT_RAY_QUERY_PAD, 0.0f);
+				}
+
+			for(int c = 0; c < 3; c++) {
+				stream[c][i] = v0[c];
+				stream[3 + c][i] = v1[c] - v0[c];
+				stream[6 + c][i] = v2[c] - v0[c];
+				}
+			return i;
+			}
+
+		// Indexed triangles, optionally transformed (a modelview or a
+		// GLFrame matrix). Returns the index of the first one added.
+		int AddMesh(const M3DVector3f *pVerts, const GLushort *pIndexes, int nIndexes, const float *mTransform = NULL) {
+			int iFirst = nCount;
+			for(int i = 0; i + 2 < nIndexes; i += 3) {
+				M3DVector3f v[3];
+				for(int j = 0; j < 3; j++) {
+					if(mTransform != NULL)
+						m3dTransformVector3(v[j], pVerts[pIndexes[i + j]], mTransform);
+					else
+						m3dCopyVector3(v[j], pVerts[pIndexes[i + j]]);
+					}
+				AddTriangle(v[0], v[1], v[2]);
+				}
+			return iFirst;
+			}
+
+		// A mesh batch's client side copy (see GLMeshBatch::ReadBack)
+		int AddMesh(const GLMeshBatch& mesh, const float *mTransform = NULL) {
+			if(!mesh.HasClientData())
+				return nCount;
+			return AddMesh(mesh.GetVertices(), mesh.GetIndexes(), int(mesh.GetClientIndexCount()), mTransform);
+			}
+
+		// Nearest triangle along the ray. The distance is in units of
+		// vDirection's length.
+		GLRayHit Intersect(const M3DVector3f vOrigin, const M3DVector3f vDirection) const {
+			GLRayHit hit;
+			gltRayHitReset(hit);
+			if(nCount == 0)
+				return hit;
+
+			const float *tri[9];
+			for(int c = 0; c < 9; c++)
+				tri[c] = &stream[c][0];
+
+			int nPadded = int(stream[0].size());
+#if defined(M3D_SIMD_X86)
+			M3D_SIMD_LEVEL level = m3dSIMDGetLevel();
+			if(level >= M3D_SIMD_AVX2)
+				gltAVX2RayTriangles(hit, vOrigin, vDirection, tri, nPadded);
+			else if(level >= M3D_SIMD_SSE2)
+				gltSSE2RayTriangles(hit, vOrigin, vDirection, tri, nPadded);
+			else
+#endif
+				gltScalarRayTriangles(hit, vOrigin, vDirection, tri, 0, nPadded);
+			return hit;
+			}
+
+		void Intersect(const M3DVector3f *pOrigins, const M3DVector3f *pDirections, int nRays, GLRayHit *pHits) const {
+			for(int i = 0; i < nRays; i++)
+				pHits[i] = Intersect(pOrigins[i], pDirections[i]);
+			}
+
+	protected:
+		int nCount;
+		std::vector<float> stream[9];	// v0 x y z, edge1 x y z, edge2 x y z
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The pick ray through a window position. x and y are in window coordinates
+// with the origin at the top left (as mouse positions are); mModelView is the
+// camera matrix and mProjection the projection used to draw.
+inline void gltMakePickRay(M3DVector3f vOrigin, M3DVector3f vDirection, float x, float y,
+						   const M3DMatrix44f mModelView, const M3DMatrix44f mProjection, const int iViewport[4])
+	{
+	M3DMatrix44f mMVP, mInverse;
+	m3dMatrixMultiply44(mMVP, mProjection, mModelView);
+	m3dInvertMatrix44(mInverse, mMVP);
+
+	float ndcX = 2.0f * (x - float(iViewport[0])) / float(iViewport[2]) - 1.0f;
+	float ndcY = 1.0f - 2.0f * (y - float(iViewport[1])) / float(iViewport[3]);
+
+	M3DVector4f vNear = { ndcX, ndcY, -1.0f, 1.0f }, vFar = { ndcX, ndcY, 1.0f, 1.0f };
+	M3DVector4f vNearW, vFarW;
+	m3dTransformVector4(vNearW, vNear, mInverse);
+	m3dTransformVector4(vFarW, vFar, mInverse);
+
+	for(int i = 0; i < 3; i++) {
+		vOrigin[i] = vNearW[i] / vNearW[3];
+		vDirection[i] = vFarW[i] / vFarW[3] - vOrigin[i];
+		}
+	m3dNormalizeVector3(vDirection);
+	}
+
+#endif
@@ -0,0 +1,202 @@
+// GLSceneGraph.h
+// A hierarchy of frames, each placed relative to its parent.
+//
+// Every node has a local GLFrame and a world matrix, the parent's world
+// matrix times the local one. Getting a node's frame to change it marks the
+// node dirty (as GLMatrixStack::Top() counts as a change), and Update()
+// recomputes world matrices for the dirty nodes and everything below them,
+// nothing else. A large hierarchy that doesn't move costs nothing per frame.
+//
+// Dirty subtrees don't depend on each other, so when there are enough nodes
+// (GLT_SCENE_PARALLEL_NODES) Update spreads them over the cores with
+// gltParallelFor. A single dirty subtree is split at its first levels so it
+// still has pieces to share out.
+//
+// Nodes are referred to by index, and the root nodes have a parent of -1. A
+// new node's frame is the identity (origin at zero, forward +Z, up +Y), not
+// GLFrame's default, which looks down -Z.
+
+#ifndef __GL_SCENE_GRAPH
+#define __GL_SCENE_GRAPH
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "GLFrame.h"
+#include "GLParallel.h"
+#include <vector>
+
+#define GLT_SCENE_PARALLEL_NODES	4096	// Fewer nodes than this are updated on the calling thread
+
+struct GLSceneNode
+	{
+	GLFrame			frame;			// Relative to the parent
+	M3DMatrix44f	mWorld;
+	int				iParent;
+	int				iFirstChild;
+	int				iNextSibling;
+	bool			bDirty;			// The frame changed since the last Update
+	};
+
+class GLSceneGraph
+	{
+	public:
+		GLSceneGraph(void) {}
+
+		void Clear(void) {
+			vNodes.clear();
+			vDirty.clear();
+			}
+
+		inline int GetNodeCount(void) const { return int(vNodes.size()); }
+
+		// Returns the new node's index
+		int AddNode(int iParent = -1) {
+			GLSceneNode node;
+			node.frame.SetForwardVector(0.0f, 0.0f, 1.0f);
+			m3dLoadIdentity44(node.mWorld);
+			node.iParent = -1;
+			node.iFirstChild = -1;
+			node.iNextSibling = -1;
+			node.bDirty = false;
+
+			int i = int(vNodes.size());
+			vNodes.push_back(node);
+			Link(i, iParent);
+			MarkDirty(i);
+			return i;
+			}
+
+		inline int GetParent(int i) const { return vNodes[i].iParent; }
+		inline int GetFirstChild(int i) const { return vNodes[i].iFirstChild; }
+		inline int GetNextSibling(int i) const { return vNodes[i].iNextSibling; }
+
+		// Move a node (with its subtree) under another parent, or to the top
+		// with -1. Fails if iParent is in the node's own subtree.
+		bool SetParent(int i, int iParent) {
+			for(int p = iParent; p >= 0; p = vNodes[p].iParent)
+				if(p == i)
+					return false;
+
+			Unlink(i);
+			Link(i, iParent);
+			MarkDirty(i);
+			return true;
+			}
+
+		// The node's frame, to read or change. Counts as a change.
+		GLFrame& GetFrame(int i) {
+			MarkDirty(i);
+			return vNodes[i].frame;
+			}
+
+		// As of the last Update
+		inline const M3DMatrix44f& GetWorldMatrix(int i) const { return vNodes[i].mWorld; }
+
+		inline bool NeedsUpdate(void) const { return !vDirty.empty(); }
+
+
+		/////////////////////////////////////////////////////////////
+		// Bring the world matrices of every dirty subtree up to date
+		void Update(void) {
+			if(vDirty.empty())
+				return;
+
+			// A dirty node under another dirty node is updated with it
+			vRoots.clear();
+			for(size_t d = 0; d < vDirty.size(); d++) {
+				int i = vDirty[d];
+				int p = vNodes[i].iParent;
+				while(p >= 0 && !vNodes[p].bDirty)
+					p = vNodes[p].iParent;
+				if(p < 0)
+					vRoots.push_back(i);
+				}
+
+			if(GetNodeCount() < GLT_SCENE_PARALLEL_NODES) {
+				for(size_t r = 0; r < vRoots.size(); r++)
+					UpdateSubtree(vRoots[r]);
+				}
+			else {
+				// Split the top few levels until every core has some to do
+				int nWanted = gltParallelThreadCount(GetNodeCount(), 1) * 4;
+				for(int nLevel = 0; nLevel < 4 && int(vRoots.size()) < nWanted; nLevel++) {
+					vSplit.clear();
+					for(size_t r = 0; r < vRoots.size(); r++) {
+						int i = vRoots[r];
+						UpdateNode(i);
+						for(int c = vNodes[i].iFirstChild; c >= 0; c = vNodes[c].iNextSibling)
+							vSplit.push_back(c);
+						}
+					vRoots.swap(vSplit);
+					}
+
+				gltParallelFor(int(vRoots.size()), 1, [this](int iBegin, int iEnd, int) {
+					std::vector<int> vStack;
+					for(int r = iBegin; r < iEnd; r++)
+						UpdateSubtree(vRoots[r], vStack);
+					});
+				}
+
+			vDirty.clear();
+			}
+
+	protected:
+		inline void MarkDirty(int i) {
+			if(!vNodes[i].bDirty) {
+				vNodes[i].bDirty = true;
+				vDirty.push_back(i);
+				}
+			}
+
+		void Link(int i, int iParent) {
+			vNodes[i].iParent = iParent;
+			if(iParent >= 0) {
+				vNodes[i].iNextSibling = vNodes[iParent].iFirstChild;
+				vNodes[iParent].iFirstChild = i;
+				}
+			}
+
+		void Unlink(int i) {
+			int iParent = vNodes[i].iParent;
+			if(iParent >= 0) {
+				int *pLink = &vNodes[iParent].iFirstChild;
+				while(*pLink != i)
+					pLink = &vNodes[*pLink].iNextSibling;
+				*pLink = vNodes[i].iNextSibling;
+				}
+			vNodes[i].iParent = -1;
+			vNodes[i].iNextSibling = -1;
+			}
+
+		// World matrix of one node whose parent is up to date
+		inline void UpdateNode(int i) {
+			GLSceneNode& node = vNodes[i];
+			if(node.iParent < 0)
+				m3dCopyMatrix44(node.mWorld, node.frame.GetMatrix());
+			else
+				m3dSIMDMatrixMultiply44(node.mWorld, vNodes[node.iParent].mWorld, node.frame.GetMatrix());
+			node.bDirty = false;
+			}
+
+		void UpdateSubtree(int iRoot, std::vector<int>& vStack) {
+			vStack.clear();
+			vStack.push_back(iRoot);
+			while(!vStack.empty()) {
+				int i = vStack.back();
+				vStack.pop_back();
+				UpdateNode(i);
+				for(int c = vNodes[i].iFirstChild; c >= 0; c = vNodes[c].iNextSibling)
+					vStack.push_back(c);
+				}
+			}
+
+		inline void UpdateSubtree(int iRoot) { UpdateSubtree(iRoot, vStack); }
+
+		std::vector<GLSceneNode>	vNodes;
+		std::vector<int>			vDirty;		// Nodes whose frames changed, each once
+		std::vector<int>			vRoots;		// Scratch for Update
+		std::vector<int>			vSplit;
+		std::vector<int>			vStack;
+	};
+
+#endif
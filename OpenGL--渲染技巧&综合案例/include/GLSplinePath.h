@@ -0,0 +1,325 @@
+// GLSplinePath.h
+// A Catmull-Rom path through a list of points, for camera fly-throughs and
+// objects following a track.
+//
+// m3dCatmullRom works out the basis for every point it is asked for. A
+// GLSplinePath does that once per segment when the points are set and keeps
+// each segment as a cubic p(t) = ((a * t + b) * t + c) * t + d, so a sample
+// costs three multiply-adds per component. The curve is the same one
+// m3dCatmullRom gives.
+//
+// A path position u runs from 0 to GetSegmentCount(); segment i is the piece
+// between point i and point i + 1. u does not move at a constant speed
+// (segments are as long as their points are far apart), so for even spacing
+// use the distance based calls. They work from a table of lengths built when
+// the points are set.
+
+#ifndef __GL_SPLINE_PATH
+#define __GL_SPLINE_PATH
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "GLFrame.h"
+#include <vector>
+
+// Steps per segment in the arc length table
+#define GLT_SPLINE_ARC_STEPS	16
+
+
+#if defined(M3D_SIMD_X86)
+// One point, x y z in the first three lanes. Writes four floats.
+M3D_TARGET_SSE2 inline void gltSSE2SplineEvaluate(float *pOut4, const float *pCoeffs, float t)
+	{
+	__m128 vt = _mm_set1_ps(t);
+	__m128 p = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pCoeffs), vt), _mm_loadu_ps(pCoeffs + 4));
+	p = _mm_add_ps(_mm_mul_ps(p, vt), _mm_loadu_ps(pCoeffs + 8));
+	p = _mm_add_ps(_mm_mul_ps(p, vt), _mm_loadu_ps(pCoeffs + 12));
+	_mm_storeu_ps(pOut4, p);
+	}
+#endif
+
+inline void gltSplineEvaluate(M3DVector3f vOut, const float *pCoeffs, float t)
+	{
+	for(int i = 0; i < 3; i++)
+		vOut[i] = ((pCoeffs[i] * t + pCoeffs[4 + i]) * t + pCoeffs[8 + i]) * t + pCoeffs[12 + i];
+	}
+
+
+class GLSplinePath
+	{
+	public:
+		GLSplinePath(void) : nSegments(0), bClosed(false), fLength(0.0f) {}
+
+		// The path passes through every point. An open path starts at the
+		// first and ends at the last; a closed one runs back to the first.
+		void SetPoints(const M3DVector3f *pPoints, int nPoints, bool bClosedLoop = false) {
+			bClosed = bClosedLoop;
+			nSegments = 0;
+			fLength = 0.0f;
+			vCoeffs.clear();
+			vArcLength.clear();
+			if(nPoints < 2)
+				return;
+
+			nSegments = bClosed ? nPoints : nPoints - 1;
+			vCoeffs.resize(nSegments * 16);
+			for(int i = 0; i < nSegments; i++) {
+				const float *p0 = pPoints[Wrap(i - 1, nPoints)];
+				const float *p1 = pPoints[Wrap(i, nPoints)];
+				const float *p2 = pPoints[Wrap(i + 1, nPoints)];
+				const float *p3 = pPoints[Wrap(i + 2, nPoints)];
+
+				float *c = &vCoeffs[i * 16];
+				for(int j = 0; j < 3; j++) {
+					c[j] = 0.5f * (-p0[j] + 3.0f * p1[j] - 3.0f * p2[j] + p3[j]);
+					c[4 + j] = 0.5f * (2.0f * p0[j] - 5.0f * p1[j] + 4.0f * p2[j] - p3[j]);
+					c[8 + j] = 0.5f * (-p0[j] + p2[j]);
+					c[12 + j] = p1[j];
+					}
+				c[3] = c[7] = c[11] = c[15] = 0.0f;
+				}
+
+			BuildArcLengthTable();
+			}
+
+		inline int GetSegmentCount(void) const { return nSegments; }
+		inline bool IsClosed(void) const { return bClosed; }
+
+		// Length along the curve, measured over GLT_SPLINE_ARC_STEPS chords
+		// per segment
+		inline float GetLength(void) const { return fLength; }
+
+		// Position at path position u (0 to GetSegmentCount())
+		void GetPoint(M3DVector3f vOut, float u) const {
+			if(nSegments == 0) {
+				m3dLoadVector3(vOut, 0.0f, 0.0f, 0.0f);
+				return;
+				}
+			float t;
+			int iSeg = Locate(u, t);
+			gltSplineEvaluate(vOut, &vCoeffs[iSeg * 16], t);
+			}
+
+		// Direction of travel at u, unit length. Zero where the path stands
+		// still (two control points the same), as there is no direction to
+		// normalize.
+		void GetTangent(M3DVector3f vOut, float u) const {
+			m3dLoadVector3(vOut, 0.0f, 0.0f, 0.0f);
+			if(nSegments == 0)
+				return;
+
+			float t;
+			const float *c = &vCoeffs[Locate(u, t) * 16];
+			for(int i = 0; i < 3; i++)
+				vOut[i] = (3.0f * c[i] * t + 2.0f * c[4 + i]) * t + c[8 + i];
+			if(m3dGetVectorLengthSquared3(vOut) < 1e-12f)
+				m3dLoadVector3(vOut, 0.0f, 0.0f, 0.0f);
+			else
+				m3dNormalizeVector3(vOut);
+			}
+
+		// nSamples points evenly spaced in u over the whole path, both ends
+		// included (for a closed path the last sample is the first point).
+		void Sample(M3DVector3f *pOut, int nSamples) const {
+			if(nSamples <= 0 || nSegments == 0)
+				return;
+			float du = (nSamples > 1) ? float(nSegments) / float(nSamples - 1) : 0.0f;
+
+#if defined(M3D_SIMD_X86)
+			if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2) {
+				// Each store spills one float into the next point, which is
+				// then written over, so the last point goes the scalar way.
+				float t;
+				for(int i = 0; i < nSamples - 1; i++) {
+					int iSeg = Locate(float(i) * du, t);
+					gltSSE2SplineEvaluate(pOut[i], &vCoeffs[iSeg * 16], t);
+					}
+				GetPoint(pOut[nSamples - 1], float(nSamples - 1) * du);
+				return;
+				}
+#endif
+			for(int i = 0; i < nSamples; i++)
+				GetPoint(pOut[i], float(i) * du);
+			}
+
+		// Positions at the given path positions
+		void Sample(M3DVector3f *pOut, const float *pParams, int nSamples) const {
+			if(nSamples <= 0 || nSegments == 0)
+				return;
+
+#if defined(M3D_SIMD_X86)
+			if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2) {
+				float t;
+				for(int i = 0; i < nSamples - 1; i++) {
+					int iSeg = Locate(pParams[i], t);
+					gltSSE2SplineEvaluate(pOut[i], &vCoeffs[iSeg * 16], t);
+					}
+				GetPoint(pOut[nSamples - 1], pParams[nSamples - 1]);
+				return;
+				}
+#endif
+			for(int i = 0; i < nSamples; i++)
+				GetPoint(pOut[i], pParams[i]);
+			}
+
+		// Path position fDistance along the curve from the start. Closed
+		// paths wrap around, open ones stop at the ends.
+		float GetParameterAtDistance(float fDistance) const {
+			if(nSegments == 0 || fLength <= 0.0f)
+				return 0.0f;
+
+			fDistance = ClampDistance(fDistance);
+
+			// Binary search for the step the distance falls in
+			int lo = 0, hi = int(vArcLength.size()) - 1;
+			while(hi - lo > 1) {
+				int mid = (lo + hi) / 2;
+				if(vArcLength[mid] <= fDistance)
+					lo = mid;
+				else
+					hi = mid;
+				}
+			return StepToParameter(lo, fDistance);
+			}
+
+		inline void GetPointAtDistance(M3DVector3f vOut, float fDistance) const
+			{ GetPoint(vOut, GetParameterAtDistance(fDistance)); }
+
+		// nSamples points evenly spaced along the curve, both ends included.
+		// The distances only go up, so the table is walked rather than searched.
+		void SampleArcLength(M3DVector3f *pOut, int nSamples) const {
+			if(nSamples <= 0 || nSegments == 0)
+				return;
+
+			std::vector<float> vParams(nSamples);
+			float ds = (nSamples > 1) ? fLength / float(nSamples - 1) : 0.0f;
+			int iStep = 0, nLast = int(vArcLength.size()) - 2;
+			for(int i = 0; i < nSamples; i++) {
+				float s = (i == nSamples - 1) ? fLength : float(i) * ds;
+				while(iStep < nLast && vArcLength[iStep + 1] <= s)
+					iStep++;
+				vParams[i] = StepToParameter(iStep, s);
+				}
+			Sample(pOut, &vParams[0], nSamples);
+			}
+
+		// Put a frame on the path at u. With bOrient the frame also faces
+		// along the path, keeping its up vector as near to where it was as
+		// it can.
+		void SetFrame(GLFrame& frame, float u, bool bOrient = false) const {
+			M3DVector3f vPoint;
+			GetPoint(vPoint, u);
+			frame.SetOrigin(vPoint);
+			if(bOrient)
+				OrientFrame(frame, u);
+			}
+
+		// Frames spaced fSpacing apart along the curve, the first fStart from
+		// the start of the path, for a convoy of objects or a camera and the
+		// things following it.
+		void SetFrameOrigins(GLFrame *pFrames, int nFrames, float fStart, float fSpacing, bool bOrient = false) const {
+			if(nFrames <= 0 || nSegments == 0)
+				return;
+
+			std::vector<float> vParams(nFrames);
+			std::vector<float> vPoints(nFrames * 3);
+			for(int i = 0; i < nFrames; i++)
+				vParams[i] = GetParameterAtDistance(fStart + float(i) * fSpacing);
+			Sample((M3DVector3f *)&vPoints[0], &vParams[0], nFrames);
+
+			for(int i = 0; i < nFrames; i++) {
+				pFrames[i].SetOrigin(&vPoints[i * 3]);
+				if(bOrient)
+					OrientFrame(pFrames[i], vParams[i]);
+				}
+			}
+
+	protected:
+		// Point index for segment neighbours. Open paths repeat the end
+		// points, closed ones go round.
+		inline int Wrap(int i, int n) const {
+			if(bClosed)
+				return (i < 0) ? i + n : ((i >= n) ? i - n : i);
+			return (i < 0) ? 0 : ((i >= n) ? n - 1 : i);
+			}
+
+		// Segment and local t for path position u
+		inline int Locate(float u, float& t) const {
+			if(bClosed && (u < 0.0f || u >= float(nSegments))) {
+				u = fmodf(u, float(nSegments));
+				if(u < 0.0f)
+					u += float(nSegments);
+				}
+			else if(u < 0.0f)
+				u = 0.0f;
+
+			int iSeg = int(u);
+			if(iSeg >= nSegments)
+				iSeg = nSegments - 1;
+			t = u - float(iSeg);
+			if(t > 1.0f)
+				t = 1.0f;
+			return iSeg;
+			}
+
+		inline float ClampDistance(float fDistance) const {
+			if(bClosed) {
+				fDistance = fmodf(fDistance, fLength);
+				if(fDistance < 0.0f)
+					fDistance += fLength;
+				return fDistance;
+				}
+			return (fDistance < 0.0f) ? 0.0f : ((fDistance > fLength) ? fLength : fDistance);
+			}
+
+		// Path position within table step iStep, linear between its ends
+		inline float StepToParameter(int iStep, float fDistance) const {
+			float s0 = vArcLength[iStep], s1 = vArcLength[iStep + 1];
+			float f = (s1 > s0) ? (fDistance - s0) / (s1 - s0) : 0.0f;
+			if(f > 1.0f)
+				f = 1.0f;
+			return (float(iStep) + f) / float(GLT_SPLINE_ARC_STEPS);
+			}
+
+		void BuildArcLengthTable(void) {
+			int nSteps = nSegments * GLT_SPLINE_ARC_STEPS;
+			vArcLength.resize(nSteps + 1);
+			vArcLength[0] = 0.0f;
+
+			M3DVector3f vLast, vPoint;
+			gltSplineEvaluate(vLast, &vCoeffs[0], 0.0f);
+			for(int i = 1; i <= nSteps; i++) {
+				int iSeg = (i - 1) / GLT_SPLINE_ARC_STEPS;
+				float t = float(i - iSeg * GLT_SPLINE_ARC_STEPS) / float(GLT_SPLINE_ARC_STEPS);
+				gltSplineEvaluate(vPoint, &vCoeffs[iSeg * 16], t);
+				vArcLength[i] = vArcLength[i - 1] + m3dGetDistance3(vLast, vPoint);
+				m3dCopyVector3(vLast, vPoint);
+				}
+			fLength = vArcLength[nSteps];
+			}
+
+		void OrientFrame(GLFrame& frame, float u) const {
+			M3DVector3f vForward, vUp, vRight;
+			GetTangent(vForward, u);
+			if(!(m3dGetVectorLengthSquared3(vForward) > 0.5f))
+				return;		// Standing still, keep the last orientation
+
+			frame.GetUpVector(vUp);
+			m3dCrossProduct3(vRight, vForward, vUp);
+			if(m3dGetVectorLengthSquared3(vRight) < 1e-12f)
+				return;		// Heading straight up or down, leave it be
+			m3dCrossProduct3(vUp, vRight, vForward);
+			m3dNormalizeVector3(vUp);
+
+			frame.SetForwardVector(vForward);
+			frame.SetUpVector(vUp);
+			}
+
+		int					nSegments;
+		bool				bClosed;
+		float				fLength;
+		std::vector<float>	vCoeffs;		// a, b, c, d per segment, padded to 4 floats each
+		std::vector<float>	vArcLength;		// Distance at each table step
+	};
+
+#endif
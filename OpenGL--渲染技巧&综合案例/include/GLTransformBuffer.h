@@ -0,0 +1,314 @@
+// GLTransformBuffer.h
+// Every modelview matrix of a frame, uploaded in one go.
+//
+// Passing each object's matrix to UseStockShader uploads a uniform per draw.
+// With many objects it is cheaper to work out all of the frame's matrices
+// first, copy them into one uniform buffer, and then only tell each draw
+// which one is its own. GLTransformBuffer keeps the frame's matrices in one
+// contiguous, 16 byte aligned array (GLMatrixStack::RecordMatrix appends the
+// top of the stack and returns its index), and Upload sends the lot.
+//
+// A uniform block is only sure to hold 16KB, so the buffer is split into
+// pages of GLT_TRANSFORM_PAGE_MATRICES matrices and a draw binds the page its
+// matrix is in; consecutive draws mostly share a page, so that is rare.
+// GLTransformShaders has versions of the lit stock shaders that take the
+// modelview from the bound page.
+//
+// Uniform buffers need OpenGL 3.1 or GL_ARB_uniform_buffer_object. Where
+// IsSupported() says no (OpenGL ES 2, the legacy Mac context) the recorded
+// matrices can still be passed to UseStockShader one at a time.
+
+#ifndef __GL_TRANSFORM_BUFFER
+#define __GL_TRANSFORM_BUFFER
+
+#include "GLTools.h"
+#include "GLShaderManager.h"
+#include <stdarg.h>
+#include <vector>
+
+// 256 mat4s are 16KB, the least GL_MAX_UNIFORM_BLOCK_SIZE can be. The
+// shaders' TransformPage block below is the same size.
+#define GLT_TRANSFORM_PAGE_MATRICES		256
+#define GLT_TRANSFORM_PAGE_BYTES		(GLT_TRANSFORM_PAGE_MATRICES * 16 * sizeof(GLfloat))
+#define GLT_TRANSFORM_BINDING			0		// Uniform buffer binding point the pages go to
+
+// One matrix of the frame. The alignment keeps every matrix on a 16 byte
+// boundary for SSE loads and stores.
+struct alignas(16) GLTransformEntry
+	{
+	M3DMatrix44f	m;
+	};
+
+class GLTransformBuffer
+	{
+	public:
+		GLTransformBuffer(void) : uiBuffer(0), nCapacityPages(0), iBoundPage(-1) {}
+		~GLTransformBuffer(void) {
+#ifndef OPENGL_ES
+			if(uiBuffer != 0)
+				glDeleteBuffers(1, &uiBuffer);
+#endif
+			}
+
+		static bool IsSupported(void) {
+#ifdef OPENGL_ES
+			return false;
+#else
+			return GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object;
+#endif
+			}
+
+		// Start a new frame. The storage is kept for the next one.
+		inline void Reset(void) {
+			vMatrices.clear();
+			iBoundPage = -1;
+			}
+
+		// Add a matrix, returning its index
+		inline GLint Append(const M3DMatrix44f m) {
+			vMatrices.push_back(GLTransformEntry());
+			m3dCopyMatrix44(vMatrices.back().m, m);
+			return GLint(vMatrices.size()) - 1;
+			}
+
+		inline GLint GetCount(void) const { return GLint(vMatrices.size()); }
+		inline const M3DMatrix44f& GetMatrix(GLint iIndex) const { return vMatrices[iIndex].m; }
+		inline const GLfloat *GetMatrices(void) const { return vMatrices.empty() ? NULL : vMatrices[0].m; }
+
+		// Copy the whole frame to the uniform buffer. The buffer is orphaned
+		// first, so the driver doesn't wait for last frame's draws to finish.
+		bool Upload(void) {
+#ifdef OPENGL_ES
+			return false;
+#else
+			if(!IsSupported())
+				return false;
+
+			if(uiBuffer == 0)
+				glGenBuffers(1, &uiBuffer);
+
+			// Whole pages, so the last page's range is as big as the block
+			GLint nPages = (GetCount() + GLT_TRANSFORM_PAGE_MATRICES - 1) / GLT_TRANSFORM_PAGE_MATRICES;
+			if(nPages > nCapacityPages)
+				nCapacityPages = nPages;
+
+			glBindBuffer(GL_UNIFORM_BUFFER, uiBuffer);
+			glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(nCapacityPages) * GLT_TRANSFORM_PAGE_BYTES, NULL, GL_STREAM_DRAW);
+			if(GetCount() > 0)
+				glBufferSubData(GL_UNIFORM_BUFFER, 0, GLsizeiptr(GetCount()) * sizeof(GLTransformEntry), GetMatrices());
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+			iBoundPage = -1;
+			return true;
+#endif
+			}
+
+		// Bind the page holding matrix iIndex, if it isn't bound already, and
+		// return the matrix's index within the page. A page is 16KB, which
+		// any GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT divides.
+		GLint BindPage(GLint iIndex) {
+			GLint iPage = iIndex / GLT_TRANSFORM_PAGE_MATRICES;
+#ifndef OPENGL_ES
+			if(iPage != iBoundPage) {
+				glBindBufferRange(GL_UNIFORM_BUFFER, GLT_TRANSFORM_BINDING, uiBuffer,
+								  GLintptr(iPage) * GLT_TRANSFORM_PAGE_BYTES, GLT_TRANSFORM_PAGE_BYTES);
+				iBoundPage = iPage;
+				}
+#endif
+			return iIndex - iPage * GLT_TRANSFORM_PAGE_MATRICES;
+			}
+
+	protected:
+		std::vector<GLTransformEntry>	vMatrices;
+		GLuint							uiBuffer;
+		GLint							nCapacityPages;
+		GLint							iBoundPage;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The lit stock shaders, reading the modelview from the transform buffer.
+// UseStockShader takes GLShaderManager::UseStockShader's arguments less the
+// modelview, once per frame (or whenever they change); SetTransform then
+// picks the matrix for each draw.
+//
+//	GLT_SHADER_DEFAULT_LIGHT				projection, color
+//	GLT_SHADER_POINT_LIGHT_DIFF				projection, light position, color
+//	GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF		projection, light position, color, texture unit
+
+#define GLT_TRANSFORM_VP_HEAD \
+	"#version 140\n" \
+	"layout(std140) uniform TransformPage { mat4 mvMatrices[256]; };" \
+	"uniform int iTransform;" \
+	"uniform mat4 pMatrix;" \
+	"uniform vec4 vColor;" \
+	"in vec4 vVertex;" \
+	"in vec3 vNormal;" \
+	"out vec4 vFluffyColor;" \
+	"vec3 eyeNormal(mat4 mvMatrix) {" \
+	"  mat3 mNormalMatrix;" \
+	"  mNormalMatrix[0] = normalize(mvMatrix[0].xyz);" \
+	"  mNormalMatrix[1] = normalize(mvMatrix[1].xyz);" \
+	"  mNormalMatrix[2] = normalize(mvMatrix[2].xyz);" \
+	"  return normalize(mNormalMatrix * vNormal); }"
+
+static const char szTransformDefaultLightVP[] =
+	GLT_TRANSFORM_VP_HEAD
+	"void main(void) {"
+	"  mat4 mvMatrix = mvMatrices[iTransform];"
+	"  vec3 vLightDir = vec3(0.0, 0.0, 1.0);"
+	"  float fDot = max(0.0, dot(eyeNormal(mvMatrix), vLightDir));"
+	"  vFluffyColor.rgb = vColor.rgb * fDot;"
+	"  vFluffyColor.a = vColor.a;"
+	"  gl_Position = pMatrix * mvMatrix * vVertex; }";
+
+static const char szTransformPointLightDiffVP[] =
+	GLT_TRANSFORM_VP_HEAD
+	"uniform vec3 vLightPos;"
+	"void main(void) {"
+	"  mat4 mvMatrix = mvMatrices[iTransform];"
+	"  vec4 ecPosition = mvMatrix * vVertex;"
+	"  vec3 vLightDir = normalize(vLightPos - ecPosition.xyz / ecPosition.w);"
+	"  float fDot = max(0.0, dot(eyeNormal(mvMatrix), vLightDir));"
+	"  vFluffyColor.rgb = vColor.rgb * fDot;"
+	"  vFluffyColor.a = vColor.a;"
+	"  gl_Position = pMatrix * ecPosition; }";
+
+static const char szTransformTexturePointLightDiffVP[] =
+	GLT_TRANSFORM_VP_HEAD
+	"uniform vec3 vLightPos;"
+	"in vec2 vTexture0;"
+	"out vec2 vTex;"
+	"void main(void) {"
+	"  mat4 mvMatrix = mvMatrices[iTransform];"
+	"  vec4 ecPosition = mvMatrix * vVertex;"
+	"  vec3 vLightDir = normalize(vLightPos - ecPosition.xyz / ecPosition.w);"
+	"  float fDot = max(0.0, dot(eyeNormal(mvMatrix), vLightDir));"
+	"  vFluffyColor.rgb = vColor.rgb * fDot;"
+	"  vFluffyColor.a = vColor.a;"
+	"  vTex = vTexture0;"
+	"  gl_Position = pMatrix * ecPosition; }";
+
+static const char szTransformLightFP[] =
+	"#version 140\n"
+	"in vec4 vFluffyColor;"
+	"out vec4 vFragColor;"
+	"void main(void) { vFragColor = vFluffyColor; }";
+
+static const char szTransformTextureLightFP[] =
+	"#version 140\n"
+	"in vec4 vFluffyColor;"
+	"in vec2 vTex;"
+	"uniform sampler2D textureUnit0;"
+	"out vec4 vFragColor;"
+	"void main(void) { vFragColor = texture(textureUnit0, vTex) * vFluffyColor; }";
+
+
+class GLTransformShaders
+	{
+	public:
+		GLTransformShaders(void) : uiCurrent(0), iCurrentIndexLocation(-1) {
+			for(int i = 0; i < 3; i++) {
+				uiProgram[i] = 0;
+				iIndexLocation[i] = -1;
+				}
+			}
+		~GLTransformShaders(void) {
+#ifndef OPENGL_ES
+			for(int i = 0; i < 3; i++)
+				if(uiProgram[i] != 0) glDeleteProgram(uiProgram[i]);
+#endif
+			}
+
+		// Call once there is a GL context. Fails where uniform buffers don't
+		// exist; stay with GLShaderManager then.
+		bool InitializeShaders(void) {
+#ifdef OPENGL_ES
+			return false;
+#else
+			if(!GLTransformBuffer::IsSupported())
+				return false;
+
+			uiProgram[0] = gltLoadShaderPairSrcWithAttributes(szTransformDefaultLightVP, szTransformLightFP, 2,
+										GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal");
+			uiProgram[1] = gltLoadShaderPairSrcWithAttributes(szTransformPointLightDiffVP, szTransformLightFP, 2,
+										GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal");
+			uiProgram[2] = gltLoadShaderPairSrcWithAttributes(szTransformTexturePointLightDiffVP, szTransformTextureLightFP, 3,
+										GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal",
+										GLT_ATTRIBUTE_TEXTURE0, "vTexture0");
+
+			for(int i = 0; i < 3; i++) {
+				if(uiProgram[i] == 0)
+					return false;
+				glUniformBlockBinding(uiProgram[i], glGetUniformBlockIndex(uiProgram[i], "TransformPage"), GLT_TRANSFORM_BINDING);
+				iIndexLocation[i] = glGetUniformLocation(uiProgram[i], "iTransform");
+				}
+			return true;
+#endif
+			}
+
+		// Program for a stock shader ID, 0 for ones with no version here
+		GLuint GetShader(GLT_STOCK_SHADER nShaderID) const {
+			int iSlot = Slot(nShaderID);
+			return (iSlot < 0) ? 0 : uiProgram[iSlot];
+			}
+
+		// Bind and set the per frame uniforms. Returns the program, or -1 for
+		// a shader with no version here.
+		GLint UseStockShader(GLT_STOCK_SHADER nShaderID, ...) {
+			int iSlot = Slot(nShaderID);
+			if(iSlot < 0 || uiProgram[iSlot] == 0)
+				return -1;
+
+			GLuint uiShader = uiProgram[iSlot];
+			va_list uniformList;
+			va_start(uniformList, nShaderID);
+			glUseProgram(uiShader);
+
+			M3DMatrix44f *pMatrix = va_arg(uniformList, M3DMatrix44f *);
+			glUniformMatrix4fv(glGetUniformLocation(uiShader, "pMatrix"), 1, GL_FALSE, *pMatrix);
+
+			if(nShaderID != GLT_SHADER_DEFAULT_LIGHT) {
+				M3DVector3f *vLightPos = va_arg(uniformList, M3DVector3f *);
+				glUniform3fv(glGetUniformLocation(uiShader, "vLightPos"), 1, *vLightPos);
+				}
+
+			M3DVector4f *vColor = va_arg(uniformList, M3DVector4f *);
+			glUniform4fv(glGetUniformLocation(uiShader, "vColor"), 1, *vColor);
+
+			if(nShaderID == GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF) {
+				GLint iTextureUnit = va_arg(uniformList, GLint);
+				glUniform1i(glGetUniformLocation(uiShader, "textureUnit0"), iTextureUnit);
+				}
+
+			va_end(uniformList);
+			uiCurrent = uiShader;
+			iCurrentIndexLocation = iIndexLocation[iSlot];
+			return GLint(uiShader);
+			}
+
+		// Point the shader last passed to UseStockShader at matrix iIndex of
+		// an uploaded buffer. One int uniform per draw instead of a mat4.
+		void SetTransform(GLTransformBuffer& buffer, GLint iIndex) {
+			GLint iInPage = buffer.BindPage(iIndex);
+			if(uiCurrent != 0)
+				glUniform1i(iCurrentIndexLocation, iInPage);
+			}
+
+	protected:
+		static int Slot(GLT_STOCK_SHADER nShaderID) {
+			switch(nShaderID) {
+				case GLT_SHADER_DEFAULT_LIGHT: return 0;
+				case GLT_SHADER_POINT_LIGHT_DIFF: return 1;
+				case GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF: return 2;
+				default: return -1;
+				}
+			}
+
+		GLuint	uiProgram[3];
+		GLint	iIndexLocation[3];
+		GLuint	uiCurrent;
+		GLint	iCurrentIndexLocation;
+	};
+
+#endif
@@ -0,0 +1,171 @@
+// GLVertexBuilder.h
+// Builds large batches on the CPU without going through GLBatch's one call
+// per attribute per vertex.
+//
+// Each attribute has its own typed stream (positions and normals of three
+// floats, colors of four, texture coordinates of two) that grows by
+// doubling, so appending is amortized constant time and Reserve() up front
+// makes it a plain store. Streams take whole spans at a time (Append), or
+// hand out room for n more vertices to be written in place (Extend) so a
+// generator can fill them without an intermediate copy; Add() is the one
+// vertex at a time form.
+//
+// Nothing touches GL until End(), which interleaves the streams and uploads
+// them once into a GLInterleavedBatch. The builder keeps its memory after
+// End, so building the next batch of similar size allocates nothing.
+
+#ifndef __GL_VERTEX_BUILDER
+#define __GL_VERTEX_BUILDER
+
+#include "GLInterleavedBatch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#define GLT_VERTEX_STREAM_MIN_CAPACITY		64		// Vertices, on first growth
+
+
+///////////////////////////////////////////////////////////////////////////////
+// N floats per vertex. The storage is not initialized; Extend leaves what it
+// returns for the caller to write.
+template <int N> class GLVertexStream
+	{
+	public:
+		enum { COMPONENTS = N };
+
+		GLVertexStream(void) : pData(NULL), nCount(0), nCapacity(0) { }
+		~GLVertexStream(void) { free(pData); }
+
+		// Empty, keeping the memory
+		inline void Clear(void) { nCount = 0; }
+
+		// Room for at least nVerts vertices in all
+		void Reserve(GLuint nVerts) {
+			if(nVerts <= nCapacity)
+				return;
+			GLfloat *pNew = (GLfloat *)realloc(pData, sizeof(GLfloat) * N * size_t(nVerts));
+			if(pNew == NULL)
+				throw std::bad_alloc();
+			pData = pNew;
+			nCapacity = nVerts;
+			}
+
+		// nVerts more vertices, returning the first of them to be written
+		inline GLfloat *Extend(GLuint nVerts) {
+			if(nCount + nVerts > nCapacity)
+				Grow(nCount + nVerts);
+			GLfloat *pOut = pData + size_t(nCount) * N;
+			nCount += nVerts;
+			return pOut;
+			}
+
+		inline void Append(const GLfloat *pVerts, GLuint nVerts) {
+			if(nVerts != 0)
+				memcpy(Extend(nVerts), pVerts, sizeof(GLfloat) * N * size_t(nVerts));
+			}
+
+		// One vertex; components past N are ignored
+		inline void Add(GLfloat a, GLfloat b, GLfloat c = 0.0f, GLfloat d = 0.0f) {
+			if(nCount == nCapacity)
+				Grow(nCount + 1);
+			GLfloat v[4] = { a, b, c, d };
+			memcpy(pData + size_t(nCount++) * N, v, sizeof(GLfloat) * N);
+			}
+
+		inline GLuint GetCount(void) const { return nCount; }
+		inline GLuint GetCapacity(void) const { return nCapacity; }
+		inline bool IsEmpty(void) const { return nCount == 0; }
+		inline GLfloat *GetData(void) { return pData; }
+		inline const GLfloat *GetData(void) const { return pData; }
+
+	protected:
+		void Grow(GLuint nNeeded) {
+			GLuint nNew = (nCapacity < GLT_VERTEX_STREAM_MIN_CAPACITY / 2) ? GLT_VERTEX_STREAM_MIN_CAPACITY : nCapacity * 2;
+			Reserve((nNew < nNeeded) ? nNeeded : nNew);
+			}
+
+		// Owns its storage, so not to be copied
+		GLVertexStream(const GLVertexStream&);
+		GLVertexStream& operator=(const GLVertexStream&);
+
+		GLfloat		*pData;
+		GLuint		nCount;			// Vertices
+		GLuint		nCapacity;		// Vertices
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLVertexBuilder
+	{
+	public:
+		GLVertexBuilder(void) { }
+
+		// Empty every stream, keeping the memory
+		void Clear(void) {
+			vPositions.Clear();
+			vNormals.Clear();
+			vColors.Clear();
+			for(int t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				vTexCoords[t].Clear();
+			}
+
+		// Room for nVerts vertices in the positions and in each of the other
+		// streams asked for
+		void Reserve(GLuint nVerts, bool bNormals = false, bool bColors = false, GLuint nTextureUnits = 0) {
+			vPositions.Reserve(nVerts);
+			if(bNormals)
+				vNormals.Reserve(nVerts);
+			if(bColors)
+				vColors.Reserve(nVerts);
+			for(GLuint t = 0; t < nTextureUnits && t < GLT_INTERLEAVED_MAX_TEXTURES; t++)
+				vTexCoords[t].Reserve(nVerts);
+			}
+
+		inline GLVertexStream<3>& Positions(void) { return vPositions; }
+		inline GLVertexStream<3>& Normals(void) { return vNormals; }
+		inline GLVertexStream<4>& Colors(void) { return vColors; }
+		inline GLVertexStream<2>& TexCoords(GLuint nTextureUnit) { return vTexCoords[nTextureUnit]; }
+
+		inline GLuint GetVertexCount(void) const { return vPositions.GetCount(); }
+
+		// Upload everything into batch as primitive and empty the builder.
+		// Streams left empty are not part of the batch; any other must have
+		// as many vertices as the positions, or nothing is uploaded and
+		// false is returned (with the builder left as it was).
+		bool End(GLInterleavedBatch& batch, GLenum primitive) {
+			GLuint nVerts = vPositions.GetCount();
+			if(!Matches(vNormals, nVerts) || !Matches(vColors, nVerts))
+				return false;
+
+			const GLfloat *pTexCoords[GLT_INTERLEAVED_MAX_TEXTURES];
+			GLuint nTextureUnits = 0;
+			for(GLuint t = 0; t < GLT_INTERLEAVED_MAX_TEXTURES; t++) {
+				if(!Matches(vTexCoords[t], nVerts))
+					return false;
+				pTexCoords[t] = vTexCoords[t].IsEmpty() ? NULL : vTexCoords[t].GetData();
+				if(pTexCoords[t] != NULL)
+					nTextureUnits = t + 1;
+				}
+
+			batch.SetVertices(primitive, nVerts, vPositions.GetData(), vNormals.IsEmpty() ? NULL : vNormals.GetData(),
+							  vColors.IsEmpty() ? NULL : vColors.GetData(), pTexCoords, nTextureUnits);
+			Clear();
+			return true;
+			}
+
+	protected:
+		template <int N> static bool Matches(const GLVertexStream<N>& stream, GLuint nVerts) {
+			return stream.IsEmpty() || stream.GetCount() == nVerts;
+			}
+
+		// Streams own their storage, so not to be copied
+		GLVertexBuilder(const GLVertexBuilder&);
+		GLVertexBuilder& operator=(const GLVertexBuilder&);
+
+		GLVertexStream<3>	vPositions;
+		GLVertexStream<3>	vNormals;
+		GLVertexStream<4>	vColors;
+		GLVertexStream<2>	vTexCoords[GLT_INTERLEAVED_MAX_TEXTURES];
+	};
+
+#endif
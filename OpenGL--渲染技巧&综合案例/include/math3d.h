@@ -521,6 +521,102 @@ inline void m3dTranslationMatrix44(M3DMatrix44d m, double x, double y, double z)
 void m3dInvertMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m);
 void m3dInvertMatrix44(M3DMatrix44d mInverse, const M3DMatrix44d m);
 
+// Faster inverses for matrices whose bottom row is (0, 0, 0, 1). An affine
+// matrix only needs its 3x3 part inverted (via cross products), and a rigid
+// body matrix (rotation + translation) only needs its rotation transposed.
+// Either way the new translation is the old one, negated and run through the
+// inverted 3x3. Unlike m3dInvertMatrix44, mInverse may be the same matrix as m.
+inline void m3dInvertRigid44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+	float r0 = m[0], r1 = m[1], r2 = m[2];
+	float u0 = m[4], u1 = m[5], u2 = m[6];
+	float f0 = m[8], f1 = m[9], f2 = m[10];
+	float tx = m[12], ty = m[13], tz = m[14];
+
+	mInverse[0] = r0; mInverse[4] = r1; mInverse[8]  = r2;
+	mInverse[1] = u0; mInverse[5] = u1; mInverse[9]  = u2;
+	mInverse[2] = f0; mInverse[6] = f1; mInverse[10] = f2;
+
+	mInverse[12] = -(r0 * tx + r1 * ty + r2 * tz);
+	mInverse[13] = -(u0 * tx + u1 * ty + u2 * tz);
+	mInverse[14] = -(f0 * tx + f1 * ty + f2 * tz);
+
+	mInverse[3] = 0.0f; mInverse[7] = 0.0f; mInverse[11] = 0.0f; mInverse[15] = 1.0f;
+	}
+
+inline void m3dInvertRigid44(M3DMatrix44d mInverse, const M3DMatrix44d m)
+	{
+	double r0 = m[0], r1 = m[1], r2 = m[2];
+	double u0 = m[4], u1 = m[5], u2 = m[6];
+	double f0 = m[8], f1 = m[9], f2 = m[10];
+	double tx = m[12], ty = m[13], tz = m[14];
+
+	mInverse[0] = r0; mInverse[4] = r1; mInverse[8]  = r2;
+	mInverse[1] = u0; mInverse[5] = u1; mInverse[9]  = u2;
+	mInverse[2] = f0; mInverse[6] = f1; mInverse[10] = f2;
+
+	mInverse[12] = -(r0 * tx + r1 * ty + r2 * tz);
+	mInverse[13] = -(u0 * tx + u1 * ty + u2 * tz);
+	mInverse[14] = -(f0 * tx + f1 * ty + f2 * tz);
+
+	mInverse[3] = 0.0; mInverse[7] = 0.0; mInverse[11] = 0.0; mInverse[15] = 1.0;
+	}
+
+inline void m3dInvertAffine44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+	M3DVector3f c0, c1, c2, r0, r1, r2;
+	m3dLoadVector3(c0, m[0], m[1], m[2]);
+	m3dLoadVector3(c1, m[4], m[5], m[6]);
+	m3dLoadVector3(c2, m[8], m[9], m[10]);
+	float tx = m[12], ty = m[13], tz = m[14];
+
+	// Rows of the inverse are the cross products of the columns over the determinant
+	m3dCrossProduct3(r0, c1, c2);
+	m3dCrossProduct3(r1, c2, c0);
+	m3dCrossProduct3(r2, c0, c1);
+	float invDet = 1.0f / m3dDotProduct3(c0, r0);
+	m3dScaleVector3(r0, invDet);
+	m3dScaleVector3(r1, invDet);
+	m3dScaleVector3(r2, invDet);
+
+	mInverse[0] = r0[0]; mInverse[4] = r0[1]; mInverse[8]  = r0[2];
+	mInverse[1] = r1[0]; mInverse[5] = r1[1]; mInverse[9]  = r1[2];
+	mInverse[2] = r2[0]; mInverse[6] = r2[1]; mInverse[10] = r2[2];
+
+	mInverse[12] = -(r0[0] * tx + r0[1] * ty + r0[2] * tz);
+	mInverse[13] = -(r1[0] * tx + r1[1] * ty + r1[2] * tz);
+	mInverse[14] = -(r2[0] * tx + r2[1] * ty + r2[2] * tz);
+
+	mInverse[3] = 0.0f; mInverse[7] = 0.0f; mInverse[11] = 0.0f; mInverse[15] = 1.0f;
+	}
+
+inline void m3dInvertAffine44(M3DMatrix44d mInverse, const M3DMatrix44d m)
+	{
+	M3DVector3d c0, c1, c2, r0, r1, r2;
+	m3dLoadVector3(c0, m[0], m[1], m[2]);
+	m3dLoadVector3(c1, m[4], m[5], m[6]);
+	m3dLoadVector3(c2, m[8], m[9], m[10]);
+	double tx = m[12], ty = m[13], tz = m[14];
+
+	m3dCrossProduct3(r0, c1, c2);
+	m3dCrossProduct3(r1, c2, c0);
+	m3dCrossProduct3(r2, c0, c1);
+	double invDet = 1.0 / m3dDotProduct3(c0, r0);
+	m3dScaleVector3(r0, invDet);
+	m3dScaleVector3(r1, invDet);
+	m3dScaleVector3(r2, invDet);
+
+	mInverse[0] = r0[0]; mInverse[4] = r0[1]; mInverse[8]  = r0[2];
+	mInverse[1] = r1[0]; mInverse[5] = r1[1]; mInverse[9]  = r1[2];
+	mInverse[2] = r2[0]; mInverse[6] = r2[1]; mInverse[10] = r2[2];
+
+	mInverse[12] = -(r0[0] * tx + r0[1] * ty + r0[2] * tz);
+	mInverse[13] = -(r1[0] * tx + r1[1] * ty + r1[2] * tz);
+	mInverse[14] = -(r2[0] * tx + r2[1] * ty + r2[2] * tz);
+
+	mInverse[3] = 0.0; mInverse[7] = 0.0; mInverse[11] = 0.0; mInverse[15] = 1.0;
+	}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,383 @@
+// math3dBatch.h
+// Batch versions of the math3d vector routines.
+//
+// m3dTransformVector3/4, m3dRotateVector and m3dProjectXYZ work on one vector
+// per call. The routines here take whole arrays and one matrix, so the matrix
+// is loaded once and the SSE2 paths take four points at a time, the AVX2
+// structure of arrays paths eight (m3dTransformVectors4 does one four
+// component vector per SSE2 step). Both the usual array-of-structures layout
+// (M3DVector3f[]) and separate x[], y[], z[] streams are supported. The
+// instruction set follows m3dSIMDGetLevel().
+//
+// The transform and rotate routines put every point through the same
+// multiplies and adds, in the same order, as the single vector math3d
+// routine, so their results are bit identical to calling it in a loop. The
+// project routines work from a combined modelview projection matrix, so they
+// can differ from m3dProjectXYZ in the last bit (see below), though their
+// SIMD and scalar paths agree with each other. Input and output arrays may be
+// the same array, but must not otherwise overlap.
+
+#ifndef _MATH3D_BATCH__
+#define _MATH3D_BATCH__
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+
+
+#if defined(M3D_SIMD_X86)
+///////////////////////////////////////////////////////////////////////////////
+// Swap four packed M3DVector3f (three registers) to and from x, y, z registers
+#define M3D_SHUFFLE(a, b, x, y, z, w)	_mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+M3D_TARGET_SSE2 inline void m3dSSE2LoadVectors3(const float *p, __m128& x, __m128& y, __m128& z)
+	{
+	__m128 r0 = _mm_loadu_ps(p);		// x0 y0 z0 x1
+	__m128 r1 = _mm_loadu_ps(p + 4);	// y1 z1 x2 y2
+	__m128 r2 = _mm_loadu_ps(p + 8);	// z2 x3 y3 z3
+
+	x = M3D_SHUFFLE(r0, M3D_SHUFFLE(r1, r2, 2, 2, 1, 1), 0, 3, 0, 2);
+	y = M3D_SHUFFLE(M3D_SHUFFLE(r0, r1, 1, 1, 0, 0), M3D_SHUFFLE(r1, r2, 3, 3, 2, 2), 0, 2, 0, 2);
+	z = M3D_SHUFFLE(M3D_SHUFFLE(r0, r1, 2, 2, 1, 1), r2, 0, 2, 0, 3);
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2StoreVectors3(float *p, __m128 x, __m128 y, __m128 z)
+	{
+	__m128 xyLo = _mm_unpacklo_ps(x, y);	// x0 y0 x1 y1
+	__m128 xyHi = _mm_unpackhi_ps(x, y);	// x2 y2 x3 y3
+
+	_mm_storeu_ps(p,     M3D_SHUFFLE(xyLo, M3D_SHUFFLE(z, xyLo, 0, 0, 2, 2), 0, 1, 0, 2));
+	_mm_storeu_ps(p + 4, M3D_SHUFFLE(M3D_SHUFFLE(xyLo, z, 3, 3, 1, 1), xyHi, 0, 2, 0, 1));
+	_mm_storeu_ps(p + 8, M3D_SHUFFLE(M3D_SHUFFLE(z, xyHi, 2, 2, 2, 2), M3D_SHUFFLE(xyHi, z, 3, 3, 3, 3), 0, 2, 0, 2));
+	}
+
+#undef M3D_SHUFFLE
+
+// x' = m0 x + m4 y + m8 z (+ m12), for four points at once
+M3D_TARGET_SSE2 inline void m3dSSE2TransformXYZ(__m128& x, __m128& y, __m128& z, const float *m, int stride, bool bTranslate)
+	{
+	const float *c0 = m, *c1 = m + stride, *c2 = m + 2 * stride;
+
+	__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(c0[0]), x), _mm_mul_ps(_mm_set1_ps(c1[0]), y)), _mm_mul_ps(_mm_set1_ps(c2[0]), z));
+	__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(c0[1]), x), _mm_mul_ps(_mm_set1_ps(c1[1]), y)), _mm_mul_ps(_mm_set1_ps(c2[1]), z));
+	__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(c0[2]), x), _mm_mul_ps(_mm_set1_ps(c1[2]), y)), _mm_mul_ps(_mm_set1_ps(c2[2]), z));
+
+	if(bTranslate) {
+		rx = _mm_add_ps(rx, _mm_set1_ps(m[12]));
+		ry = _mm_add_ps(ry, _mm_set1_ps(m[13]));
+		rz = _mm_add_ps(rz, _mm_set1_ps(m[14]));
+		}
+
+	x = rx; y = ry; z = rz;
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2TransformVectors3(M3DVector3f *pOut, const M3DVector3f *pIn, int nCount, const float *m, int stride, bool bTranslate)
+	{
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x, y, z;
+		m3dSSE2LoadVectors3(pIn[i], x, y, z);
+		m3dSSE2TransformXYZ(x, y, z, m, stride, bTranslate);
+		m3dSSE2StoreVectors3(pOut[i], x, y, z);
+		}
+	return i;
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2TransformVectors3SoA(float *xOut, float *yOut, float *zOut,
+													   const float *xIn, const float *yIn, const float *zIn,
+													   int nCount, const M3DMatrix44f m)
+	{
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x = _mm_loadu_ps(xIn + i);
+		__m128 y = _mm_loadu_ps(yIn + i);
+		__m128 z = _mm_loadu_ps(zIn + i);
+		m3dSSE2TransformXYZ(x, y, z, m, 4, true);
+		_mm_storeu_ps(xOut + i, x);
+		_mm_storeu_ps(yOut + i, y);
+		_mm_storeu_ps(zOut + i, z);
+		}
+	return i;
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2TransformVectors4(M3DVector4f *pOut, const M3DVector4f *pIn, int nCount, const M3DMatrix44f m)
+	{
+	__m128 c0 = _mm_loadu_ps(m);
+	__m128 c1 = _mm_loadu_ps(m + 4);
+	__m128 c2 = _mm_loadu_ps(m + 8);
+	__m128 c3 = _mm_loadu_ps(m + 12);
+
+	for(int i = 0; i < nCount; i++) {
+		const float *v = pIn[i];
+		__m128 r = _mm_mul_ps(c0, _mm_set1_ps(v[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+		r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(v[3])));
+		_mm_storeu_ps(pOut[i], r);
+		}
+	}
+
+// Clip space x, y, z, w of four points through mMVP, then divided by w where
+// |w| is not near zero (as m3dProjectXYZ) and mapped to the viewport
+M3D_TARGET_SSE2 inline void m3dSSE2ProjectXYZ(__m128& x, __m128& y, __m128& z, const float *mMVP, __m128 halfWidth, __m128 halfHeight)
+	{
+	__m128 cx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mMVP[0]), x), _mm_mul_ps(_mm_set1_ps(mMVP[4]), y)), _mm_mul_ps(_mm_set1_ps(mMVP[8]), z)), _mm_set1_ps(mMVP[12]));
+	__m128 cy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mMVP[1]), x), _mm_mul_ps(_mm_set1_ps(mMVP[5]), y)), _mm_mul_ps(_mm_set1_ps(mMVP[9]), z)), _mm_set1_ps(mMVP[13]));
+	__m128 cz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mMVP[2]), x), _mm_mul_ps(_mm_set1_ps(mMVP[6]), y)), _mm_mul_ps(_mm_set1_ps(mMVP[10]), z)), _mm_set1_ps(mMVP[14]));
+	__m128 cw = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mMVP[3]), x), _mm_mul_ps(_mm_set1_ps(mMVP[7]), y)), _mm_mul_ps(_mm_set1_ps(mMVP[11]), z)), _mm_set1_ps(mMVP[15]));
+
+	// Lanes to divide: !(|w| < eps), so a NaN w divides as in the scalar code
+	__m128 absW = _mm_andnot_ps(_mm_set1_ps(-0.0f), cw);
+	__m128 divide = _mm_cmpnlt_ps(absW, _mm_set1_ps(0.000001f));
+	__m128 div = _mm_div_ps(_mm_set1_ps(1.0f), cw);
+	cx = _mm_or_ps(_mm_and_ps(divide, _mm_mul_ps(cx, div)), _mm_andnot_ps(divide, cx));
+	cy = _mm_or_ps(_mm_and_ps(divide, _mm_mul_ps(cy, div)), _mm_andnot_ps(divide, cy));
+	cz = _mm_or_ps(_mm_and_ps(divide, _mm_mul_ps(cz, div)), _mm_andnot_ps(divide, cz));
+
+	__m128 one = _mm_set1_ps(1.0f);
+	x = _mm_mul_ps(_mm_add_ps(one, cx), halfWidth);
+	y = _mm_mul_ps(_mm_add_ps(one, cy), halfHeight);
+	z = cz;
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2ProjectVectorsXYZ(M3DVector3f *pOut, const M3DVector3f *pIn, int nCount, const M3DMatrix44f mMVP,
+													float fHalfWidth, float fHalfHeight)
+	{
+	__m128 halfWidth = _mm_set1_ps(fHalfWidth), halfHeight = _mm_set1_ps(fHalfHeight);
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x, y, z;
+		m3dSSE2LoadVectors3(pIn[i], x, y, z);
+		m3dSSE2ProjectXYZ(x, y, z, mMVP, halfWidth, halfHeight);
+		m3dSSE2StoreVectors3(pOut[i], x, y, z);
+		}
+	return i;
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2ProjectVectorsXYZSoA(float *xOut, float *yOut, float *zOut,
+													   const float *xIn, const float *yIn, const float *zIn,
+													   int nCount, const M3DMatrix44f mMVP, float fHalfWidth, float fHalfHeight)
+	{
+	__m128 halfWidth = _mm_set1_ps(fHalfWidth), halfHeight = _mm_set1_ps(fHalfHeight);
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x = _mm_loadu_ps(xIn + i);
+		__m128 y = _mm_loadu_ps(yIn + i);
+		__m128 z = _mm_loadu_ps(zIn + i);
+		m3dSSE2ProjectXYZ(x, y, z, mMVP, halfWidth, halfHeight);
+		_mm_storeu_ps(xOut + i, x);
+		_mm_storeu_ps(yOut + i, y);
+		_mm_storeu_ps(zOut + i, z);
+		}
+	return i;
+	}
+
+M3D_TARGET_AVX2 inline int m3dAVX2TransformVectors3SoA(float *xOut, float *yOut, float *zOut,
+													   const float *xIn, const float *yIn, const float *zIn,
+													   int nCount, const M3DMatrix44f m)
+	{
+	__m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+	__m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]);
+	__m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+	__m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+
+	int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(xIn + i);
+		__m256 y = _mm256_loadu_ps(yIn + i);
+		__m256 z = _mm256_loadu_ps(zIn + i);
+		__m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), _mm256_mul_ps(m8, z)), m12);
+		__m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), _mm256_mul_ps(m9, z)), m13);
+		__m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, x), _mm256_mul_ps(m6, y)), _mm256_mul_ps(m10, z)), m14);
+		_mm256_storeu_ps(xOut + i, rx);
+		_mm256_storeu_ps(yOut + i, ry);
+		_mm256_storeu_ps(zOut + i, rz);
+		}
+	return i;
+	}
+
+M3D_TARGET_AVX2 inline int m3dAVX2ProjectVectorsXYZSoA(float *xOut, float *yOut, float *zOut,
+													   const float *xIn, const float *yIn, const float *zIn,
+													   int nCount, const M3DMatrix44f m, float fHalfWidth, float fHalfHeight)
+	{
+	__m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]), m3 = _mm256_set1_ps(m[3]);
+	__m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]), m7 = _mm256_set1_ps(m[7]);
+	__m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]), m11 = _mm256_set1_ps(m[11]);
+	__m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]), m15 = _mm256_set1_ps(m[15]);
+	__m256 halfWidth = _mm256_set1_ps(fHalfWidth), halfHeight = _mm256_set1_ps(fHalfHeight);
+	__m256 one = _mm256_set1_ps(1.0f), eps = _mm256_set1_ps(0.000001f), signBit = _mm256_set1_ps(-0.0f);
+
+	int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(xIn + i);
+		__m256 y = _mm256_loadu_ps(yIn + i);
+		__m256 z = _mm256_loadu_ps(zIn + i);
+		__m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), _mm256_mul_ps(m8, z)), m12);
+		__m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), _mm256_mul_ps(m9, z)), m13);
+		__m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, x), _mm256_mul_ps(m6, y)), _mm256_mul_ps(m10, z)), m14);
+		__m256 cw = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m3, x), _mm256_mul_ps(m7, y)), _mm256_mul_ps(m11, z)), m15);
+
+		__m256 divide = _mm256_cmp_ps(_mm256_andnot_ps(signBit, cw), eps, _CMP_NLT_UQ);
+		__m256 div = _mm256_div_ps(one, cw);
+		cx = _mm256_blendv_ps(cx, _mm256_mul_ps(cx, div), divide);
+		cy = _mm256_blendv_ps(cy, _mm256_mul_ps(cy, div), divide);
+		cz = _mm256_blendv_ps(cz, _mm256_mul_ps(cz, div), divide);
+
+		_mm256_storeu_ps(xOut + i, _mm256_mul_ps(_mm256_add_ps(one, cx), halfWidth));
+		_mm256_storeu_ps(yOut + i, _mm256_mul_ps(_mm256_add_ps(one, cy), halfHeight));
+		_mm256_storeu_ps(zOut + i, cz);
+		}
+	return i;
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Transform an array of points (w assumed to be 1) by a 4x4 matrix.
+// Same as calling m3dTransformVector3 nCount times.
+inline void m3dTransformVectors3(M3DVector3f *pOut, const M3DVector3f *pIn, int nCount, const M3DMatrix44f m)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2TransformVectors3(pOut, pIn, nCount, m, 4, true);
+#endif
+	for(; i < nCount; i++)
+		m3dScalarTransformVector3(pOut[i], pIn[i], m);
+	}
+
+// Full four component transform of an array of vectors.
+// Same as calling m3dTransformVector4 nCount times.
+inline void m3dTransformVectors4(M3DVector4f *pOut, const M3DVector4f *pIn, int nCount, const M3DMatrix44f m)
+	{
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2) {
+		m3dSSE2TransformVectors4(pOut, pIn, nCount, m);
+		return;
+		}
+#endif
+	for(int i = 0; i < nCount; i++)
+		m3dScalarTransformVector4(pOut[i], pIn[i], m);
+	}
+
+// Rotate an array of vectors by a 3x3 matrix.
+// Same as calling m3dRotateVector nCount times.
+inline void m3dRotateVectors(M3DVector3f *pOut, const M3DVector3f *pIn, int nCount, const M3DMatrix33f m)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2TransformVectors3(pOut, pIn, nCount, m, 3, false);
+#endif
+	for(; i < nCount; i++) {
+		const float *p = pIn[i];
+		float x = p[0], y = p[1], z = p[2];
+		pOut[i][0] = m[0] * x + m[3] * y + m[6] * z;
+		pOut[i][1] = m[1] * x + m[4] * y + m[7] * z;
+		pOut[i][2] = m[2] * x + m[5] * y + m[8] * z;
+		}
+	}
+
+// Structure of arrays version of m3dTransformVectors3. Points are read from
+// the xIn, yIn, zIn streams and written to xOut, yOut, zOut.
+inline void m3dTransformVectors3SoA(float *xOut, float *yOut, float *zOut,
+									const float *xIn, const float *yIn, const float *zIn,
+									int nCount, const M3DMatrix44f m)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	M3D_SIMD_LEVEL level = m3dSIMDGetLevel();
+	if(level >= M3D_SIMD_AVX2)
+		i = m3dAVX2TransformVectors3SoA(xOut, yOut, zOut, xIn, yIn, zIn, nCount, m);
+
+	if(level >= M3D_SIMD_SSE2)
+		i += m3dSSE2TransformVectors3SoA(xOut + i, yOut + i, zOut + i, xIn + i, yIn + i, zIn + i, nCount - i, m);
+#endif
+	for(; i < nCount; i++) {
+		float x = xIn[i], y = yIn[i], z = zIn[i];
+		xOut[i] = m[0] * x + m[4] * y + m[8] *  z + m[12];
+		yOut[i] = m[1] * x + m[5] * y + m[9] *  z + m[13];
+		zOut[i] = m[2] * x + m[6] * y + m[10] * z + m[14];
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Project an array of points to window coordinates, like m3dProjectXYZ. The
+// modelview and projection are combined once up front, so results can differ
+// from m3dProjectXYZ in the last bit. As with m3dProjectXYZ the viewport
+// origin is not added to x and y, and points with w near zero are left
+// undivided.
+inline void m3dProjectVectorsXYZ(M3DVector3f *pOut, const M3DMatrix44f mModelView, const M3DMatrix44f mProjection,
+								 const int iViewPort[4], const M3DVector3f *pIn, int nCount)
+	{
+	M3DMatrix44f mvp;
+	m3dSIMDMatrixMultiply44(mvp, mProjection, mModelView);
+
+	float fHalfWidth = float(iViewPort[2]) * 0.5f;
+	float fHalfHeight = float(iViewPort[3]) * 0.5f;
+
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2ProjectVectorsXYZ(pOut, pIn, nCount, mvp, fHalfWidth, fHalfHeight);
+#endif
+	for(; i < nCount; i++) {
+		M3DVector4f vClip;
+		float x = pIn[i][0], y = pIn[i][1], z = pIn[i][2];
+		vClip[0] = mvp[0] * x + mvp[4] * y + mvp[8] *  z + mvp[12];
+		vClip[1] = mvp[1] * x + mvp[5] * y + mvp[9] *  z + mvp[13];
+		vClip[2] = mvp[2] * x + mvp[6] * y + mvp[10] * z + mvp[14];
+		vClip[3] = mvp[3] * x + mvp[7] * y + mvp[11] * z + mvp[15];
+
+		if(!m3dCloseEnough(vClip[3], 0.0f, 0.000001f)) {
+			float div = 1.0f / vClip[3];
+			vClip[0] *= div;
+			vClip[1] *= div;
+			vClip[2] *= div;
+			}
+
+		pOut[i][0] = (1.0f + vClip[0]) * fHalfWidth;
+		pOut[i][1] = (1.0f + vClip[1]) * fHalfHeight;
+		pOut[i][2] = vClip[2];
+		}
+	}
+
+// Structure of arrays projection. mMVP is the combined modelview projection
+// matrix (GLGeometryTransform::GetModelViewProjectionMatrix for example).
+inline void m3dProjectVectorsXYZSoA(float *xOut, float *yOut, float *zOut,
+									const float *xIn, const float *yIn, const float *zIn,
+									int nCount, const M3DMatrix44f mMVP, const int iViewPort[4])
+	{
+	float fHalfWidth = float(iViewPort[2]) * 0.5f;
+	float fHalfHeight = float(iViewPort[3]) * 0.5f;
+
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	M3D_SIMD_LEVEL level = m3dSIMDGetLevel();
+	if(level >= M3D_SIMD_AVX2)
+		i = m3dAVX2ProjectVectorsXYZSoA(xOut, yOut, zOut, xIn, yIn, zIn, nCount, mMVP, fHalfWidth, fHalfHeight);
+
+	if(level >= M3D_SIMD_SSE2)
+		i += m3dSSE2ProjectVectorsXYZSoA(xOut + i, yOut + i, zOut + i, xIn + i, yIn + i, zIn + i, nCount - i, mMVP, fHalfWidth, fHalfHeight);
+#endif
+	for(; i < nCount; i++) {
+		float x = xIn[i], y = yIn[i], z = zIn[i];
+		float cx = mMVP[0] * x + mMVP[4] * y + mMVP[8] *  z + mMVP[12];
+		float cy = mMVP[1] * x + mMVP[5] * y + mMVP[9] *  z + mMVP[13];
+		float cz = mMVP[2] * x + mMVP[6] * y + mMVP[10] * z + mMVP[14];
+		float cw = mMVP[3] * x + mMVP[7] * y + mMVP[11] * z + mMVP[15];
+
+		if(!m3dCloseEnough(cw, 0.0f, 0.000001f)) {
+			float div = 1.0f / cw;
+			cx *= div;
+			cy *= div;
+			cz *= div;
+			}
+
+		xOut[i] = (1.0f + cx) * fHalfWidth;
+		yOut[i] = (1.0f + cy) * fHalfHeight;
+		zOut[i] = cz;
+		}
+	}
+
+#endif
@@ -0,0 +1,368 @@
+// math3dPack.h
+// Compact encodings for vertex attributes.
+//
+// A float normal is 12 bytes and a float texture coordinate 8. These routines
+// pack whole arrays into the smaller forms the vertex fetch hardware (or a
+// line of shader code) can expand again:
+//
+//	Octahedral normal	Two signed normalized shorts, 4 bytes. The sphere is
+//						folded onto a square; m3dOctDecode (or the GLSL in
+//						GLPackedShaders.h) unfolds it. Worst case error about
+//						0.04 degrees.
+//	10_10_10_2 normal	x, y, z in ten bits each of one word, the layout of
+//						GL_INT_2_10_10_10_REV. Expanded by the hardware, error
+//						about 0.1 degrees.
+//	Half float			IEEE 754 binary16, round to nearest even, as
+//						GL_HALF_FLOAT reads it.
+//	Quantized position	Signed normalized shorts relative to a box around the
+//						mesh, x y z and a w of one, 8 bytes.
+//
+// Four items go through at a time with SSE2 when m3dSIMDGetLevel() allows.
+// The SIMD and scalar paths give identical bits.
+
+#ifndef _MATH3D_PACK__
+#define _MATH3D_PACK__
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+#include "math3dBatch.h"
+#include <string.h>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar encoders. Rounding is lrintf, which is what the SIMD conversions do.
+inline short m3dPackSNorm16(float f)
+	{
+	f = (f < -1.0f) ? -1.0f : ((f > 1.0f) ? 1.0f : f);
+	return short(lrintf(f * 32767.0f));
+	}
+
+inline float m3dUnpackSNorm16(short s)
+	{
+	float f = float(s) / 32767.0f;
+	return (f < -1.0f) ? -1.0f : f;
+	}
+
+inline unsigned short m3dFloatToHalf(float f)
+	{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned int sign = x & 0x80000000u;
+	x ^= sign;
+
+	unsigned int h;
+	if(x >= 0x47800000u)							// Too big, infinity or NaN
+		h = (x > 0x7f800000u) ? 0x7e00u : 0x7c00u;
+	else if(x < 0x38800000u) {						// Denormal or zero
+		// Adding 0.5 lines the mantissa up so the FPU does the rounding
+		float d, magic = 0.5f;
+		memcpy(&d, &x, sizeof(d));
+		d += magic;
+		memcpy(&h, &d, sizeof(h));
+		h -= 0x3f000000u;
+		}
+	else {
+		unsigned int odd = (x >> 13) & 1u;
+		h = (x + 0xc8000fffu + odd) >> 13;			// Rebias exponent, round to even
+		}
+	return (unsigned short)(h | (sign >> 16));
+	}
+
+inline float m3dHalfToFloat(unsigned short h)
+	{
+	unsigned int sign = (unsigned int)(h & 0x8000u) << 16;
+	unsigned int exponent = (h >> 10) & 0x1fu;
+	unsigned int mantissa = h & 0x3ffu;
+
+	float f;
+	if(exponent == 0)
+		f = float(mantissa) * (1.0f / 16777216.0f);	// Denormal, 2^-24 steps
+	else if(exponent == 31) {
+		unsigned int x = 0x7f800000u | (mantissa << 13);
+		memcpy(&f, &x, sizeof(f));
+		}
+	else {
+		unsigned int x = ((exponent + 112u) << 23) | (mantissa << 13);
+		memcpy(&f, &x, sizeof(f));
+		}
+
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	bits |= sign;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+	}
+
+// Unit normal to two shorts. Points on the lower half fold over the diagonals.
+inline void m3dOctEncode(short vOut[2], const float vNormal[3])
+	{
+	float l1 = fabsf(vNormal[0]) + fabsf(vNormal[1]) + fabsf(vNormal[2]);
+	float inv = (l1 > 0.0f) ? 1.0f / l1 : 0.0f;
+	float x = vNormal[0] * inv;
+	float y = vNormal[1] * inv;
+
+	if(vNormal[2] < 0.0f) {
+		float fx = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+		}
+
+	vOut[0] = m3dPackSNorm16(x);
+	vOut[1] = m3dPackSNorm16(y);
+	}
+
+inline void m3dOctDecode(float vNormal[3], const short vIn[2])
+	{
+	float x = m3dUnpackSNorm16(vIn[0]);
+	float y = m3dUnpackSNorm16(vIn[1]);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	if(z < 0.0f) {
+		float fx = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+		}
+
+	vNormal[0] = x;
+	vNormal[1] = y;
+	vNormal[2] = z;
+	m3dNormalizeVector3(vNormal);
+	}
+
+// GL_INT_2_10_10_10_REV, w left at zero
+inline unsigned int m3dPackNormal1010102(const float vNormal[3])
+	{
+	unsigned int word = 0;
+	for(int i = 0; i < 3; i++) {
+		float f = vNormal[i];
+		f = (f < -1.0f) ? -1.0f : ((f > 1.0f) ? 1.0f : f);
+		word |= (unsigned int)(lrintf(f * 511.0f) & 0x3ff) << (i * 10);
+		}
+	return word;
+	}
+
+// Scale and bias taking the mesh's bounding box to [-1, 1] on every axis.
+// The scale is the same on all three axes so the dequantizing matrix (see
+// m3dPositionDequantizeMatrix) keeps normals at right angles to surfaces.
+inline void m3dPositionQuantizeRange(float vBias[3], float *pScale, const M3DVector3f *pVerts, int nCount)
+	{
+	if(nCount <= 0) {
+		vBias[0] = vBias[1] = vBias[2] = 0.0f;
+		*pScale = 1.0f;
+		return;
+		}
+
+	M3DVector3f vMin, vMax;
+	m3dCopyVector3(vMin, pVerts[0]);
+	m3dCopyVector3(vMax, pVerts[0]);
+	for(int i = 1; i < nCount; i++)
+		for(int j = 0; j < 3; j++) {
+			if(pVerts[i][j] < vMin[j]) vMin[j] = pVerts[i][j];
+			if(pVerts[i][j] > vMax[j]) vMax[j] = pVerts[i][j];
+			}
+
+	float fScale = 0.0f;
+	for(int j = 0; j < 3; j++) {
+		vBias[j] = 0.5f * (vMin[j] + vMax[j]);
+		float fHalf = 0.5f * (vMax[j] - vMin[j]);
+		if(fHalf > fScale)
+			fScale = fHalf;
+		}
+	*pScale = (fScale > 0.0f) ? fScale : 1.0f;
+	}
+
+// Model matrix from quantized (normalized short) to the original positions
+inline void m3dPositionDequantizeMatrix(M3DMatrix44f m, const float vBias[3], float fScale)
+	{
+	m3dScaleMatrix44(m, fScale, fScale, fScale);
+	m[12] = vBias[0];
+	m[13] = vBias[1];
+	m[14] = vBias[2];
+	}
+
+
+#if defined(M3D_SIMD_X86)
+///////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels, four items per pass. Each returns how many it did; the caller
+// finishes the rest with the scalar encoder.
+M3D_TARGET_SSE2 inline __m128 m3dSSE2Clamp1(__m128 v)
+	{ return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f)); }
+
+// +1 or -1 with the sign of v, +1 for zero (as the scalar >= 0.0f test)
+M3D_TARGET_SSE2 inline __m128 m3dSSE2SignNotZero(__m128 v)
+	{
+	__m128 neg = _mm_cmplt_ps(v, _mm_setzero_ps());
+	return _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(-1.0f)), _mm_andnot_ps(neg, _mm_set1_ps(1.0f)));
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2OctEncodeNormals(short *pOut, const M3DVector3f *pNormals, int nCount)
+	{
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(32767.0f);
+
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x, y, z;
+		m3dSSE2LoadVectors3(pNormals[i], x, y, z);
+
+		__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(x, absMask), _mm_and_ps(y, absMask)), _mm_and_ps(z, absMask));
+		__m128 valid = _mm_cmpgt_ps(l1, zero);
+		__m128 inv = _mm_and_ps(valid, _mm_div_ps(one, l1));
+		x = _mm_mul_ps(x, inv);
+		y = _mm_mul_ps(y, inv);
+
+		__m128 fx = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(y, absMask)), m3dSSE2SignNotZero(x));
+		__m128 fy = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(x, absMask)), m3dSSE2SignNotZero(y));
+		__m128 lower = _mm_cmplt_ps(z, zero);
+		x = _mm_or_ps(_mm_and_ps(lower, fx), _mm_andnot_ps(lower, x));
+		y = _mm_or_ps(_mm_and_ps(lower, fy), _mm_andnot_ps(lower, y));
+
+		__m128i ix = _mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(x), scale));
+		__m128i iy = _mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(y), scale));
+		__m128i xy = _mm_unpacklo_epi16(_mm_packs_epi32(ix, ix), _mm_packs_epi32(iy, iy));	// x0 y0 x1 y1 ...
+		_mm_storeu_si128((__m128i *)(pOut + i * 2), xy);
+		}
+	return i;
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2PackNormals1010102(unsigned int *pOut, const M3DVector3f *pNormals, int nCount)
+	{
+	__m128 scale = _mm_set1_ps(511.0f);
+	__m128i mask = _mm_set1_epi32(0x3ff);
+
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x, y, z;
+		m3dSSE2LoadVectors3(pNormals[i], x, y, z);
+
+		__m128i ix = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(x), scale)), mask);
+		__m128i iy = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(y), scale)), mask);
+		__m128i iz = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(z), scale)), mask);
+		__m128i word = _mm_or_si128(ix, _mm_or_si128(_mm_slli_epi32(iy, 10), _mm_slli_epi32(iz, 20)));
+		_mm_storeu_si128((__m128i *)(pOut + i), word);
+		}
+	return i;
+	}
+
+// Four floats to halves, in the low 16 bits of each lane
+M3D_TARGET_SSE2 inline __m128i m3dSSE2FloatToHalf(__m128 f)
+	{
+	__m128i x = _mm_castps_si128(f);
+	__m128i sign = _mm_and_si128(x, _mm_set1_epi32(int(0x80000000u)));
+	x = _mm_xor_si128(x, sign);
+
+	// x has no sign bit now, so signed compares work
+	__m128i big = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x47800000 - 1));
+	__m128i nan = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x7f800000));
+	__m128i hBig = _mm_or_si128(_mm_and_si128(nan, _mm_set1_epi32(0x7e00)), _mm_andnot_si128(nan, _mm_set1_epi32(0x7c00)));
+
+	__m128i small = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+	__m128i hSmall = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3f000000));
+
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+	__m128i hNormal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32(int(0xc8000fffu))), odd), 13);
+
+	__m128i h = _mm_or_si128(_mm_and_si128(small, hSmall), _mm_andnot_si128(small, hNormal));
+	h = _mm_or_si128(_mm_and_si128(big, hBig), _mm_andnot_si128(big, h));
+	return _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2FloatsToHalves(unsigned short *pOut, const float *pIn, int nCount)
+	{
+	int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128i lo = m3dSSE2FloatToHalf(_mm_loadu_ps(pIn + i));
+		__m128i hi = m3dSSE2FloatToHalf(_mm_loadu_ps(pIn + i + 4));
+
+		// Sign extend the 16 bit values so the saturating pack keeps them
+		lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+		hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(lo, hi));
+		}
+	return i;
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2QuantizePositions(short *pOut, const M3DVector3f *pVerts, int nCount,
+													const float vBias[3], float fScale)
+	{
+	__m128 bx = _mm_set1_ps(vBias[0]), by = _mm_set1_ps(vBias[1]), bz = _mm_set1_ps(vBias[2]);
+	__m128 inv = _mm_set1_ps(1.0f / fScale), scale = _mm_set1_ps(32767.0f);
+	__m128i w = _mm_set1_epi16(32767);
+
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x, y, z;
+		m3dSSE2LoadVectors3(pVerts[i], x, y, z);
+
+		__m128i ix = _mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(_mm_mul_ps(_mm_sub_ps(x, bx), inv)), scale));
+		__m128i iy = _mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(_mm_mul_ps(_mm_sub_ps(y, by), inv)), scale));
+		__m128i iz = _mm_cvtps_epi32(_mm_mul_ps(m3dSSE2Clamp1(_mm_mul_ps(_mm_sub_ps(z, bz), inv)), scale));
+
+		__m128i xy = _mm_unpacklo_epi16(_mm_packs_epi32(ix, ix), _mm_packs_epi32(iy, iy));	// x0 y0 x1 y1 ...
+		__m128i zw = _mm_unpacklo_epi16(_mm_packs_epi32(iz, iz), w);						// z0 w0 z1 w1 ...
+		_mm_storeu_si128((__m128i *)(pOut + i * 4), _mm_unpacklo_epi32(xy, zw));
+		_mm_storeu_si128((__m128i *)(pOut + i * 4 + 8), _mm_unpackhi_epi32(xy, zw));
+		}
+	return i;
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Array encoders
+
+// Two shorts per normal
+inline void m3dOctEncodeNormals(short *pOut, const M3DVector3f *pNormals, int nCount)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2OctEncodeNormals(pOut, pNormals, nCount);
+#endif
+	for(; i < nCount; i++)
+		m3dOctEncode(pOut + i * 2, pNormals[i]);
+	}
+
+// One word per normal
+inline void m3dPackNormals1010102(unsigned int *pOut, const M3DVector3f *pNormals, int nCount)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2PackNormals1010102(pOut, pNormals, nCount);
+#endif
+	for(; i < nCount; i++)
+		pOut[i] = m3dPackNormal1010102(pNormals[i]);
+	}
+
+// Any number of floats, texture coordinates being two per vertex
+inline void m3dFloatsToHalves(unsigned short *pOut, const float *pIn, int nCount)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2FloatsToHalves(pOut, pIn, nCount);
+#endif
+	for(; i < nCount; i++)
+		pOut[i] = m3dFloatToHalf(pIn[i]);
+	}
+
+// Four shorts per vertex: (p - vBias) / fScale in x, y, z and one in w
+inline void m3dQuantizePositions(short *pOut, const M3DVector3f *pVerts, int nCount, const float vBias[3], float fScale)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	if(m3dSIMDGetLevel() >= M3D_SIMD_SSE2)
+		i = m3dSSE2QuantizePositions(pOut, pVerts, nCount, vBias, fScale);
+#endif
+	float inv = 1.0f / fScale;
+	for(; i < nCount; i++) {
+		for(int j = 0; j < 3; j++)
+			pOut[i * 4 + j] = m3dPackSNorm16((pVerts[i][j] - vBias[j]) * inv);
+		pOut[i * 4 + 3] = 32767;
+		}
+	}
+
+#endif
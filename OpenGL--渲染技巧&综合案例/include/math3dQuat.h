@@ -0,0 +1,222 @@
+// math3dQuat.h
+// Unit quaternions for orientation, in the same style as math3d.h.
+//
+// A quaternion is stored as four floats (or doubles) in x, y, z, w order, w
+// being the scalar part. All functions take the float and double forms alike.
+// Composition follows the matrix convention: m3dQuatMultiply(q, a, b) is the
+// rotation b followed by a, so its matrix is A * B.
+
+#ifndef _MATH3D_QUAT__
+#define _MATH3D_QUAT__
+
+#include "math3d.h"
+
+typedef float	M3DQuaternionf[4];		// x, y, z, w
+typedef double	M3DQuaterniond[4];
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Basics
+template <typename T>
+inline void m3dQuatLoadIdentity(T q[4])
+	{ q[0] = T(0); q[1] = T(0); q[2] = T(0); q[3] = T(1); }
+
+template <typename T>
+inline void m3dQuatCopy(T dst[4], const T src[4])
+	{ memcpy(dst, src, sizeof(T) * 4); }
+
+template <typename T>
+inline T m3dQuatDot(const T a[4], const T b[4])
+	{ return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; }
+
+// The inverse of a unit quaternion
+template <typename T>
+inline void m3dQuatConjugate(T q[4], const T src[4])
+	{ q[0] = -src[0]; q[1] = -src[1]; q[2] = -src[2]; q[3] = src[3]; }
+
+// Cheap enough to do after every composition, which is what stops the drift
+// that GLFrame's vectors suffer from
+template <typename T>
+inline void m3dQuatNormalize(T q[4])
+	{
+	T len = T(sqrt(m3dQuatDot(q, q)));
+	if(len == T(0)) {
+		m3dQuatLoadIdentity(q);
+		return;
+		}
+
+	T inv = T(1) / len;
+	q[0] *= inv; q[1] *= inv; q[2] *= inv; q[3] *= inv;
+	}
+
+// Rotation of angle radians around (x, y, z). The axis does not need to be
+// unit length, a zero axis gives the identity (as m3dRotationMatrix44 does).
+template <typename T>
+inline void m3dQuatFromAxisAngle(T q[4], T angle, T x, T y, T z)
+	{
+	T mag = T(sqrt(x * x + y * y + z * z));
+	if(mag == T(0)) {
+		m3dQuatLoadIdentity(q);
+		return;
+		}
+
+	T s = T(sin(angle * T(0.5))) / mag;
+	q[0] = x * s;
+	q[1] = y * s;
+	q[2] = z * s;
+	q[3] = T(cos(angle * T(0.5)));
+	}
+
+// q = a * b. q may be either of the inputs.
+template <typename T>
+inline void m3dQuatMultiply(T q[4], const T a[4], const T b[4])
+	{
+	T x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+	T y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+	T z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+	T w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+	q[0] = x; q[1] = y; q[2] = z; q[3] = w;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Conversions
+// Columns of the rotation matrix. Column 0, 1 and 2 are where the x, y and z
+// axes end up.
+template <typename T>
+inline void m3dQuatGetAxes(T vX[3], T vY[3], T vZ[3], const T q[4])
+	{
+	T xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+	T xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+	T wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+
+	if(vX != NULL) {
+		vX[0] = T(1) - T(2) * (yy + zz);
+		vX[1] = T(2) * (xy + wz);
+		vX[2] = T(2) * (xz - wy);
+		}
+
+	if(vY != NULL) {
+		vY[0] = T(2) * (xy - wz);
+		vY[1] = T(1) - T(2) * (xx + zz);
+		vY[2] = T(2) * (yz + wx);
+		}
+
+	if(vZ != NULL) {
+		vZ[0] = T(2) * (xz + wy);
+		vZ[1] = T(2) * (yz - wx);
+		vZ[2] = T(1) - T(2) * (xx + yy);
+		}
+	}
+
+template <typename T>
+inline void m3dQuatToMatrix33(T m[9], const T q[4])
+	{ m3dQuatGetAxes(m, m + 3, m + 6, q); }
+
+// Rotation only, the translation column is zero
+template <typename T>
+inline void m3dQuatToMatrix44(T m[16], const T q[4])
+	{
+	m3dQuatGetAxes(m, m + 4, m + 8, q);
+	m[3] = m[7] = m[11] = T(0);
+	m[12] = m[13] = m[14] = T(0);
+	m[15] = T(1);
+	}
+
+// Rotate a vector: vOut = R(q) * v. vOut may be v.
+template <typename T>
+inline void m3dQuatRotateVector3(T vOut[3], const T q[4], const T v[3])
+	{
+	// t = 2 * (q.xyz x v), v' = v + w * t + q.xyz x t
+	T tx = T(2) * (q[1] * v[2] - q[2] * v[1]);
+	T ty = T(2) * (q[2] * v[0] - q[0] * v[2]);
+	T tz = T(2) * (q[0] * v[1] - q[1] * v[0]);
+	T x = v[0] + q[3] * tx + (q[1] * tz - q[2] * ty);
+	T y = v[1] + q[3] * ty + (q[2] * tx - q[0] * tz);
+	T z = v[2] + q[3] * tz + (q[0] * ty - q[1] * tx);
+	vOut[0] = x; vOut[1] = y; vOut[2] = z;
+	}
+
+// From the columns of an orthonormal basis (a rotation matrix)
+template <typename T>
+inline void m3dQuatFromAxes(T q[4], const T vX[3], const T vY[3], const T vZ[3])
+	{
+	T trace = vX[0] + vY[1] + vZ[2];
+
+	if(trace > T(0)) {
+		T s = T(sqrt(trace + T(1))) * T(2);		// 4w
+		q[3] = T(0.25) * s;
+		q[0] = (vY[2] - vZ[1]) / s;
+		q[1] = (vZ[0] - vX[2]) / s;
+		q[2] = (vX[1] - vY[0]) / s;
+		}
+	else if(vX[0] > vY[1] && vX[0] > vZ[2]) {
+		T s = T(sqrt(T(1) + vX[0] - vY[1] - vZ[2])) * T(2);	// 4x
+		q[3] = (vY[2] - vZ[1]) / s;
+		q[0] = T(0.25) * s;
+		q[1] = (vY[0] + vX[1]) / s;
+		q[2] = (vZ[0] + vX[2]) / s;
+		}
+	else if(vY[1] > vZ[2]) {
+		T s = T(sqrt(T(1) + vY[1] - vX[0] - vZ[2])) * T(2);	// 4y
+		q[3] = (vZ[0] - vX[2]) / s;
+		q[0] = (vY[0] + vX[1]) / s;
+		q[1] = T(0.25) * s;
+		q[2] = (vZ[1] + vY[2]) / s;
+		}
+	else {
+		T s = T(sqrt(T(1) + vZ[2] - vX[0] - vY[1])) * T(2);	// 4z
+		q[3] = (vX[1] - vY[0]) / s;
+		q[0] = (vZ[0] + vX[2]) / s;
+		q[1] = (vZ[1] + vY[2]) / s;
+		q[2] = T(0.25) * s;
+		}
+
+	m3dQuatNormalize(q);
+	}
+
+template <typename T>
+inline void m3dQuatFromMatrix33(T q[4], const T m[9])
+	{ m3dQuatFromAxes(q, m, m + 3, m + 6); }
+
+// Only the upper 3x3 is read
+template <typename T>
+inline void m3dQuatFromMatrix44(T q[4], const T m[16])
+	{ m3dQuatFromAxes(q, m, m + 4, m + 8); }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Spherical linear interpolation, t in [0, 1]. Always takes the short way
+// around. Nearly identical inputs fall back to a normalized lerp, where
+// slerp would divide by (almost) zero and the two agree anyway.
+template <typename T>
+inline void m3dQuatSlerp(T q[4], const T a[4], const T b[4], T t)
+	{
+	T cosTheta = m3dQuatDot(a, b);
+	T sign = T(1);
+	if(cosTheta < T(0)) {
+		cosTheta = -cosTheta;
+		sign = T(-1);
+		}
+
+	T wa, wb;
+	if(cosTheta > T(0.9995)) {
+		wa = T(1) - t;
+		wb = t;
+		}
+	else {
+		T theta = T(acos(cosTheta));
+		T invSin = T(1) / T(sin(theta));
+		wa = T(sin((T(1) - t) * theta)) * invSin;
+		wb = T(sin(t * theta)) * invSin;
+		}
+
+	wb *= sign;
+	q[0] = wa * a[0] + wb * b[0];
+	q[1] = wa * a[1] + wb * b[1];
+	q[2] = wa * a[2] + wb * b[2];
+	q[3] = wa * a[3] + wb * b[3];
+	m3dQuatNormalize(q);
+	}
+
+#endif
@@ -0,0 +1,518 @@
+// math3dSIMD.h
+// SIMD kernels for the hottest math3d routines.
+//
+// The matrix stacks and the geometry pipeline spend most of their time in
+// m3dMatrixMultiply44, m3dInvertMatrix44 and the vector transforms. This file
+// provides SSE2 and AVX2 versions of those routines (plus a portable scalar
+// fallback), and picks the best one for the CPU we are running on the first
+// time any of them is called. Everything here is header only, so nothing
+// changes in libGLTools.
+//
+// Accuracy compared to the math3d.cpp versions:
+//	- Multiply and vector transforms perform the same multiplies and adds in
+//	  the same order on every path (no FMA contraction), so results are bit
+//	  identical unless the compiler itself contracts the scalar code.
+//	- Inverse uses 2x2 sub-determinants instead of sixteen 3x3 cofactors. For
+//	  well conditioned matrices every element agrees with m3dInvertMatrix44
+//	  to within 2e-5 (floats) or 1e-12 (doubles) of the largest element of
+//	  the inverse. Singular matrices produce inf/NaN, as the original does.
+//	- Unlike m3dMatrixMultiply44, the product may alias either source matrix.
+
+#ifndef _MATH3D_SIMD__
+#define _MATH3D_SIMD__
+
+#include "math3d.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define M3D_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define M3D_TARGET_SSE2
+#define M3D_TARGET_AVX2
+#else
+#define M3D_TARGET_SSE2		__attribute__((target("sse2")))
+#define M3D_TARGET_AVX2		__attribute__((target("avx2")))
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Instruction set levels, in increasing order of preference
+enum M3D_SIMD_LEVEL { M3D_SIMD_SCALAR = 0, M3D_SIMD_SSE2, M3D_SIMD_AVX2 };
+
+inline const char *m3dSIMDLevelName(M3D_SIMD_LEVEL level)
+	{
+	switch(level) {
+		case M3D_SIMD_AVX2: return "avx2";
+		case M3D_SIMD_SSE2: return "sse2";
+		default:			return "scalar";
+		}
+	}
+
+// Ask the CPU (and the OS, for the wider registers) what it can do
+inline M3D_SIMD_LEVEL m3dSIMDDetectLevel(void)
+	{
+#if defined(M3D_SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	int nIds = info[0];
+
+	__cpuid(info, 1);
+	bool bSSE2 = (info[3] & (1 << 26)) != 0;
+	bool bOSXSave = (info[2] & (1 << 27)) != 0;
+	bool bAVX = (info[2] & (1 << 28)) != 0;
+
+	if(bAVX && bOSXSave && nIds >= 7 && (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		if(info[1] & (1 << 5))
+			return M3D_SIMD_AVX2;
+		}
+
+	if(bSSE2)
+		return M3D_SIMD_SSE2;
+#else
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return M3D_SIMD_AVX2;
+
+	if(__builtin_cpu_supports("sse2"))
+		return M3D_SIMD_SSE2;
+#endif
+#endif
+	return M3D_SIMD_SCALAR;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Portable scalar kernels. These are also the reference the SIMD paths are
+// checked against.
+template <typename T>
+inline void m3dScalarMatrixMultiply44(T *product, const T *a, const T *b)
+	{
+	// Load a completely first so product may alias it
+	T a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+	T a4 = a[4], a5 = a[5], a6 = a[6], a7 = a[7];
+	T a8 = a[8], a9 = a[9], a10 = a[10], a11 = a[11];
+	T a12 = a[12], a13 = a[13], a14 = a[14], a15 = a[15];
+
+	for(int j = 0; j < 16; j += 4) {
+		T b0 = b[j], b1 = b[j+1], b2 = b[j+2], b3 = b[j+3];
+		product[j]   = a0 * b0 + a4 * b1 + a8 *  b2 + a12 * b3;
+		product[j+1] = a1 * b0 + a5 * b1 + a9 *  b2 + a13 * b3;
+		product[j+2] = a2 * b0 + a6 * b1 + a10 * b2 + a14 * b3;
+		product[j+3] = a3 * b0 + a7 * b1 + a11 * b2 + a15 * b3;
+		}
+	}
+
+// Inverse from the twelve 2x2 sub-determinants of the upper and lower halves.
+// The matrix is read as if it were row major; since the inverse of the
+// transpose is the transpose of the inverse, the result comes out column
+// major again.
+template <typename T>
+inline void m3dScalarInvertMatrix44(T *mInverse, const T *m)
+	{
+	T a00 = m[0],  a01 = m[1],  a02 = m[2],  a03 = m[3];
+	T a10 = m[4],  a11 = m[5],  a12 = m[6],  a13 = m[7];
+	T a20 = m[8],  a21 = m[9],  a22 = m[10], a23 = m[11];
+	T a30 = m[12], a31 = m[13], a32 = m[14], a33 = m[15];
+
+	T s0 = a00 * a11 - a10 * a01;
+	T s1 = a00 * a12 - a10 * a02;
+	T s2 = a00 * a13 - a10 * a03;
+	T s3 = a01 * a12 - a11 * a02;
+	T s4 = a01 * a13 - a11 * a03;
+	T s5 = a02 * a13 - a12 * a03;
+
+	T c5 = a22 * a33 - a32 * a23;
+	T c4 = a21 * a33 - a31 * a23;
+	T c3 = a21 * a32 - a31 * a22;
+	T c2 = a20 * a33 - a30 * a23;
+	T c1 = a20 * a32 - a30 * a22;
+	T c0 = a20 * a31 - a30 * a21;
+
+	T invDet = T(1) / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+	mInverse[0]  = ( a11 * c5 - a12 * c4 + a13 * c3) * invDet;
+	mInverse[1]  = (-a01 * c5 + a02 * c4 - a03 * c3) * invDet;
+	mInverse[2]  = ( a31 * s5 - a32 * s4 + a33 * s3) * invDet;
+	mInverse[3]  = (-a21 * s5 + a22 * s4 - a23 * s3) * invDet;
+
+	mInverse[4]  = (-a10 * c5 + a12 * c2 - a13 * c1) * invDet;
+	mInverse[5]  = ( a00 * c5 - a02 * c2 + a03 * c1) * invDet;
+	mInverse[6]  = (-a30 * s5 + a32 * s2 - a33 * s1) * invDet;
+	mInverse[7]  = ( a20 * s5 - a22 * s2 + a23 * s1) * invDet;
+
+	mInverse[8]  = ( a10 * c4 - a11 * c2 + a13 * c0) * invDet;
+	mInverse[9]  = (-a00 * c4 + a01 * c2 - a03 * c0) * invDet;
+	mInverse[10] = ( a30 * s4 - a31 * s2 + a33 * s0) * invDet;
+	mInverse[11] = (-a20 * s4 + a21 * s2 - a23 * s0) * invDet;
+
+	mInverse[12] = (-a10 * c3 + a11 * c1 - a12 * c0) * invDet;
+	mInverse[13] = ( a00 * c3 - a01 * c1 + a02 * c0) * invDet;
+	mInverse[14] = (-a30 * s3 + a31 * s1 - a32 * s0) * invDet;
+	mInverse[15] = ( a20 * s3 - a21 * s1 + a22 * s0) * invDet;
+	}
+
+template <typename T>
+inline void m3dScalarTransformVector3(T *vOut, const T *v, const T *m)
+	{
+	T x = v[0], y = v[1], z = v[2];
+	vOut[0] = m[0] * x + m[4] * y + m[8] *  z + m[12];
+	vOut[1] = m[1] * x + m[5] * y + m[9] *  z + m[13];
+	vOut[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+	}
+
+template <typename T>
+inline void m3dScalarTransformVector4(T *vOut, const T *v, const T *m)
+	{
+	T x = v[0], y = v[1], z = v[2], w = v[3];
+	vOut[0] = m[0] * x + m[4] * y + m[8] *  z + m[12] * w;
+	vOut[1] = m[1] * x + m[5] * y + m[9] *  z + m[13] * w;
+	vOut[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+	vOut[3] = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+	}
+
+
+#if defined(M3D_SIMD_X86)
+///////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels. Columns are loaded straight into registers, and each column of
+// the result is a linear combination of the columns of a.
+M3D_TARGET_SSE2 inline void m3dSSE2MatrixMultiply44(float *product, const float *a, const float *b)
+	{
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[j]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[j+1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[j+2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[j+3])));
+		_mm_storeu_ps(product + j, r);
+		}
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2MatrixMultiply44(double *product, const double *a, const double *b)
+	{
+	__m128d a0l = _mm_loadu_pd(a),      a0h = _mm_loadu_pd(a + 2);
+	__m128d a1l = _mm_loadu_pd(a + 4),  a1h = _mm_loadu_pd(a + 6);
+	__m128d a2l = _mm_loadu_pd(a + 8),  a2h = _mm_loadu_pd(a + 10);
+	__m128d a3l = _mm_loadu_pd(a + 12), a3h = _mm_loadu_pd(a + 14);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m128d b0 = _mm_set1_pd(b[j]);
+		__m128d b1 = _mm_set1_pd(b[j+1]);
+		__m128d b2 = _mm_set1_pd(b[j+2]);
+		__m128d b3 = _mm_set1_pd(b[j+3]);
+
+		__m128d rl = _mm_mul_pd(a0l, b0);
+		rl = _mm_add_pd(rl, _mm_mul_pd(a1l, b1));
+		rl = _mm_add_pd(rl, _mm_mul_pd(a2l, b2));
+		rl = _mm_add_pd(rl, _mm_mul_pd(a3l, b3));
+
+		__m128d rh = _mm_mul_pd(a0h, b0);
+		rh = _mm_add_pd(rh, _mm_mul_pd(a1h, b1));
+		rh = _mm_add_pd(rh, _mm_mul_pd(a2h, b2));
+		rh = _mm_add_pd(rh, _mm_mul_pd(a3h, b3));
+
+		_mm_storeu_pd(product + j, rl);
+		_mm_storeu_pd(product + j + 2, rh);
+		}
+	}
+
+// Block inverse. Each register holds one 2x2 sub matrix (again reading the
+// columns as rows), so the whole thing is done with 2x2 adjugates.
+#define M3D_SHUFFLE(a, b, x, y, z, w)	_mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define M3D_SWIZZLE(v, x, y, z, w)		M3D_SHUFFLE(v, v, x, y, z, w)
+
+// 2x2 A * B
+M3D_TARGET_SSE2 inline __m128 m3dSSE2Mat2Mul(__m128 a, __m128 b)
+	{
+	return _mm_add_ps(_mm_mul_ps(a, M3D_SWIZZLE(b, 0, 3, 0, 3)),
+					  _mm_mul_ps(M3D_SWIZZLE(a, 1, 0, 3, 2), M3D_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+
+// 2x2 adj(A) * B
+M3D_TARGET_SSE2 inline __m128 m3dSSE2Mat2AdjMul(__m128 a, __m128 b)
+	{
+	return _mm_sub_ps(_mm_mul_ps(M3D_SWIZZLE(a, 3, 3, 0, 0), b),
+					  _mm_mul_ps(M3D_SWIZZLE(a, 1, 1, 2, 2), M3D_SWIZZLE(b, 2, 3, 0, 1)));
+	}
+
+// 2x2 A * adj(B)
+M3D_TARGET_SSE2 inline __m128 m3dSSE2Mat2MulAdj(__m128 a, __m128 b)
+	{
+	return _mm_sub_ps(_mm_mul_ps(a, M3D_SWIZZLE(b, 3, 0, 3, 0)),
+					  _mm_mul_ps(M3D_SWIZZLE(a, 1, 0, 3, 2), M3D_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2InvertMatrix44(float *mInverse, const float *m)
+	{
+	__m128 r0 = _mm_loadu_ps(m);
+	__m128 r1 = _mm_loadu_ps(m + 4);
+	__m128 r2 = _mm_loadu_ps(m + 8);
+	__m128 r3 = _mm_loadu_ps(m + 12);
+
+	// Sub matrices | A B |
+	//              | C D |
+	__m128 A = _mm_movelh_ps(r0, r1);
+	__m128 B = _mm_movehl_ps(r1, r0);
+	__m128 C = _mm_movelh_ps(r2, r3);
+	__m128 D = _mm_movehl_ps(r3, r2);
+
+	// (|A| |B| |C| |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(M3D_SHUFFLE(r0, r2, 0, 2, 0, 2), M3D_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+		_mm_mul_ps(M3D_SHUFFLE(r0, r2, 1, 3, 1, 3), M3D_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+	__m128 detA = M3D_SWIZZLE(detSub, 0, 0, 0, 0);
+	__m128 detB = M3D_SWIZZLE(detSub, 1, 1, 1, 1);
+	__m128 detC = M3D_SWIZZLE(detSub, 2, 2, 2, 2);
+	__m128 detD = M3D_SWIZZLE(detSub, 3, 3, 3, 3);
+
+	__m128 D_C = m3dSSE2Mat2AdjMul(D, C);
+	__m128 A_B = m3dSSE2Mat2AdjMul(A, B);
+
+	// Adjugates of the four blocks of the inverse
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), m3dSSE2Mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), m3dSSE2Mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), m3dSSE2Mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), m3dSSE2Mat2MulAdj(A, D_C));
+
+	// |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+	__m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+	__m128 tr = _mm_mul_ps(A_B, M3D_SWIZZLE(D_C, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, M3D_SWIZZLE(tr, 2, 3, 0, 1));
+	tr = _mm_add_ps(tr, M3D_SWIZZLE(tr, 1, 0, 3, 2));
+	detM = _mm_sub_ps(detM, tr);
+
+	__m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+
+	// Undo the adjugate swizzle while storing
+	_mm_storeu_ps(mInverse,      M3D_SHUFFLE(X_, Y_, 3, 1, 3, 1));
+	_mm_storeu_ps(mInverse + 4,  M3D_SHUFFLE(X_, Y_, 2, 0, 2, 0));
+	_mm_storeu_ps(mInverse + 8,  M3D_SHUFFLE(Z_, W_, 3, 1, 3, 1));
+	_mm_storeu_ps(mInverse + 12, M3D_SHUFFLE(Z_, W_, 2, 0, 2, 0));
+	}
+
+#undef M3D_SWIZZLE
+#undef M3D_SHUFFLE
+
+M3D_TARGET_SSE2 inline void m3dSSE2TransformVector3(float *vOut, const float *v, const float *m)
+	{
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(v[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(v[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(v[2])));
+	r = _mm_add_ps(r, _mm_loadu_ps(m + 12));
+
+	// Only three floats may be written
+	_mm_storel_pi((__m64 *)vOut, r);
+	_mm_store_ss(vOut + 2, _mm_movehl_ps(r, r));
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2TransformVector4(float *vOut, const float *v, const float *m)
+	{
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(v[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(v[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(v[2])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(v[3])));
+	_mm_storeu_ps(vOut, r);
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2TransformVector3(double *vOut, const double *v, const double *m)
+	{
+	__m128d x = _mm_set1_pd(v[0]), y = _mm_set1_pd(v[1]), z = _mm_set1_pd(v[2]);
+
+	__m128d rl = _mm_mul_pd(_mm_loadu_pd(m), x);
+	rl = _mm_add_pd(rl, _mm_mul_pd(_mm_loadu_pd(m + 4), y));
+	rl = _mm_add_pd(rl, _mm_mul_pd(_mm_loadu_pd(m + 8), z));
+	rl = _mm_add_pd(rl, _mm_loadu_pd(m + 12));
+
+	__m128d rh = _mm_mul_sd(_mm_load_sd(m + 2), x);
+	rh = _mm_add_sd(rh, _mm_mul_sd(_mm_load_sd(m + 6), y));
+	rh = _mm_add_sd(rh, _mm_mul_sd(_mm_load_sd(m + 10), z));
+	rh = _mm_add_sd(rh, _mm_load_sd(m + 14));
+
+	_mm_storeu_pd(vOut, rl);
+	_mm_store_sd(vOut + 2, rh);
+	}
+
+M3D_TARGET_SSE2 inline void m3dSSE2TransformVector4(double *vOut, const double *v, const double *m)
+	{
+	__m128d x = _mm_set1_pd(v[0]), y = _mm_set1_pd(v[1]);
+	__m128d z = _mm_set1_pd(v[2]), w = _mm_set1_pd(v[3]);
+
+	__m128d rl = _mm_mul_pd(_mm_loadu_pd(m), x);
+	rl = _mm_add_pd(rl, _mm_mul_pd(_mm_loadu_pd(m + 4), y));
+	rl = _mm_add_pd(rl, _mm_mul_pd(_mm_loadu_pd(m + 8), z));
+	rl = _mm_add_pd(rl, _mm_mul_pd(_mm_loadu_pd(m + 12), w));
+
+	__m128d rh = _mm_mul_pd(_mm_loadu_pd(m + 2), x);
+	rh = _mm_add_pd(rh, _mm_mul_pd(_mm_loadu_pd(m + 6), y));
+	rh = _mm_add_pd(rh, _mm_mul_pd(_mm_loadu_pd(m + 10), z));
+	rh = _mm_add_pd(rh, _mm_mul_pd(_mm_loadu_pd(m + 14), w));
+
+	_mm_storeu_pd(vOut, rl);
+	_mm_storeu_pd(vOut + 2, rh);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AVX2 kernels. Floats do two result columns per register, doubles do one.
+// No FMA on purpose - see the accuracy notes at the top.
+M3D_TARGET_AVX2 inline void m3dAVX2MatrixMultiply44(float *product, const float *a, const float *b)
+	{
+	__m256 a0 = _mm256_broadcast_ps((const __m128 *)(a));
+	__m256 a1 = _mm256_broadcast_ps((const __m128 *)(a + 4));
+	__m256 a2 = _mm256_broadcast_ps((const __m128 *)(a + 8));
+	__m256 a3 = _mm256_broadcast_ps((const __m128 *)(a + 12));
+
+	for(int j = 0; j < 16; j += 8) {
+		__m256 bb = _mm256_loadu_ps(b + j);
+		__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bb, 0x00));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bb, 0x55)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bb, 0xAA)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bb, 0xFF)));
+		_mm256_storeu_ps(product + j, r);
+		}
+	}
+
+M3D_TARGET_AVX2 inline void m3dAVX2MatrixMultiply44(double *product, const double *a, const double *b)
+	{
+	__m256d a0 = _mm256_loadu_pd(a);
+	__m256d a1 = _mm256_loadu_pd(a + 4);
+	__m256d a2 = _mm256_loadu_pd(a + 8);
+	__m256d a3 = _mm256_loadu_pd(a + 12);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m256d r = _mm256_mul_pd(a0, _mm256_broadcast_sd(b + j));
+		r = _mm256_add_pd(r, _mm256_mul_pd(a1, _mm256_broadcast_sd(b + j + 1)));
+		r = _mm256_add_pd(r, _mm256_mul_pd(a2, _mm256_broadcast_sd(b + j + 2)));
+		r = _mm256_add_pd(r, _mm256_mul_pd(a3, _mm256_broadcast_sd(b + j + 3)));
+		_mm256_storeu_pd(product + j, r);
+		}
+	}
+
+M3D_TARGET_AVX2 inline void m3dAVX2TransformVector4(double *vOut, const double *v, const double *m)
+	{
+	__m256d r = _mm256_mul_pd(_mm256_loadu_pd(m), _mm256_set1_pd(v[0]));
+	r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 4), _mm256_set1_pd(v[1])));
+	r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 8), _mm256_set1_pd(v[2])));
+	r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 12), _mm256_set1_pd(v[3])));
+	_mm256_storeu_pd(vOut, r);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Dispatch table. Filled in once, on first use, for the best level the CPU
+// supports. Entries without a wider version fall back to the next level down
+// (a single float vector already fits one SSE register, for example).
+struct M3DSIMDKernels
+	{
+	M3D_SIMD_LEVEL level;
+
+	void (*MatrixMultiply44f)(float *product, const float *a, const float *b);
+	void (*MatrixMultiply44d)(double *product, const double *a, const double *b);
+	void (*InvertMatrix44f)(float *mInverse, const float *m);
+	void (*InvertMatrix44d)(double *mInverse, const double *m);
+	void (*TransformVector3f)(float *vOut, const float *v, const float *m);
+	void (*TransformVector3d)(double *vOut, const double *v, const double *m);
+	void (*TransformVector4f)(float *vOut, const float *v, const float *m);
+	void (*TransformVector4d)(double *vOut, const double *v, const double *m);
+	};
+
+inline M3DSIMDKernels m3dSIMDMakeKernels(M3D_SIMD_LEVEL level)
+	{
+	M3DSIMDKernels k;
+	k.level = M3D_SIMD_SCALAR;
+	k.MatrixMultiply44f = m3dScalarMatrixMultiply44<float>;
+	k.MatrixMultiply44d = m3dScalarMatrixMultiply44<double>;
+	k.InvertMatrix44f = m3dScalarInvertMatrix44<float>;
+	k.InvertMatrix44d = m3dScalarInvertMatrix44<double>;
+	k.TransformVector3f = m3dScalarTransformVector3<float>;
+	k.TransformVector3d = m3dScalarTransformVector3<double>;
+	k.TransformVector4f = m3dScalarTransformVector4<float>;
+	k.TransformVector4d = m3dScalarTransformVector4<double>;
+
+#if defined(M3D_SIMD_X86)
+	if(level >= M3D_SIMD_SSE2) {
+		k.level = M3D_SIMD_SSE2;
+		k.MatrixMultiply44f = m3dSSE2MatrixMultiply44;
+		k.MatrixMultiply44d = m3dSSE2MatrixMultiply44;
+		k.InvertMatrix44f = m3dSSE2InvertMatrix44;
+		k.TransformVector3f = m3dSSE2TransformVector3;
+		k.TransformVector3d = m3dSSE2TransformVector3;
+		k.TransformVector4f = m3dSSE2TransformVector4;
+		k.TransformVector4d = m3dSSE2TransformVector4;
+		}
+
+	if(level >= M3D_SIMD_AVX2) {
+		k.level = M3D_SIMD_AVX2;
+		k.MatrixMultiply44f = m3dAVX2MatrixMultiply44;
+		k.MatrixMultiply44d = m3dAVX2MatrixMultiply44;
+		k.TransformVector4d = m3dAVX2TransformVector4;
+		}
+#else
+	(void)level;
+#endif
+
+	return k;
+	}
+
+inline M3DSIMDKernels& m3dSIMDGetKernels(void)
+	{
+	static M3DSIMDKernels kernels = m3dSIMDMakeKernels(m3dSIMDDetectLevel());
+	return kernels;
+	}
+
+// Which level is in use
+inline M3D_SIMD_LEVEL m3dSIMDGetLevel(void) { return m3dSIMDGetKernels().level; }
+
+// Force a lower level (for testing and benchmarking). Requests above what the
+// CPU supports are clamped. Not thread safe - call it before rendering starts.
+inline M3D_SIMD_LEVEL m3dSIMDSetLevel(M3D_SIMD_LEVEL level)
+	{
+	M3D_SIMD_LEVEL maxLevel = m3dSIMDDetectLevel();
+	if(level > maxLevel)
+		level = maxLevel;
+
+	m3dSIMDGetKernels() = m3dSIMDMakeKernels(level);
+	return m3dSIMDGetKernels().level;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Drop in replacements for the math3d versions
+inline void m3dSIMDMatrixMultiply44(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{ m3dSIMDGetKernels().MatrixMultiply44f(product, a, b); }
+
+inline void m3dSIMDMatrixMultiply44(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{ m3dSIMDGetKernels().MatrixMultiply44d(product, a, b); }
+
+inline void m3dSIMDInvertMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{ m3dSIMDGetKernels().InvertMatrix44f(mInverse, m); }
+
+inline void m3dSIMDInvertMatrix44(M3DMatrix44d mInverse, const M3DMatrix44d m)
+	{ m3dSIMDGetKernels().InvertMatrix44d(mInverse, m); }
+
+inline void m3dSIMDTransformVector3(M3DVector3f vOut, const M3DVector3f v, const M3DMatrix44f m)
+	{ m3dSIMDGetKernels().TransformVector3f(vOut, v, m); }
+
+inline void m3dSIMDTransformVector3(M3DVector3d vOut, const M3DVector3d v, const M3DMatrix44d m)
+	{ m3dSIMDGetKernels().TransformVector3d(vOut, v, m); }
+
+inline void m3dSIMDTransformVector4(M3DVector4f vOut, const M3DVector4f v, const M3DMatrix44f m)
+	{ m3dSIMDGetKernels().TransformVector4f(vOut, v, m); }
+
+inline void m3dSIMDTransformVector4(M3DVector4d vOut, const M3DVector4d v, const M3DMatrix44d m)
+	{ m3dSIMDGetKernels().TransformVector4d(vOut, v, m); }
+
+#endif
@@ -0,0 +1,284 @@
+// math3dTrig.h
+// Polynomial sin/cos for whole arrays of angles, and batch rotation matrices.
+//
+// m3dRotationMatrix44 calls sin and cos from libm for every matrix. When
+// thousands of objects spin every frame that is where the time goes, so these
+// routines evaluate sine and cosine together, four (SSE2) or eight (AVX2)
+// angles at a time, with one of two polynomials:
+//
+//	M3D_SINCOS_FAST		sin to x^5, cos to x^4. Absolute error below 4e-4,
+//						fine for animation.
+//	M3D_SINCOS_PRECISE	The Cephes single precision polynomials. Absolute
+//						error below 2e-7 for |angle| < 8192 radians.
+//
+// The instruction set follows m3dSIMDGetLevel(). Every lane does the same
+// float operations, so the SIMD and scalar paths give identical results.
+
+#ifndef _MATH3D_TRIG__
+#define _MATH3D_TRIG__
+
+#include "math3d.h"
+#include "math3dSIMD.h"
+
+enum M3D_SINCOS_ACCURACY { M3D_SINCOS_FAST = 0, M3D_SINCOS_PRECISE };
+
+// pi/2 split in three so k * pi/2 can be subtracted without losing bits
+#define M3D_SINCOS_PIO2_1		1.5703125f
+#define M3D_SINCOS_PIO2_2		4.837512969970703125e-4f
+#define M3D_SINCOS_PIO2_3		7.54978995489188216e-8f
+#define M3D_SINCOS_2OPI			0.636619772367581343f
+
+// Polynomial coefficients, valid on [-pi/4, pi/4]
+#define M3D_SIN_P0				-1.6666654611e-1f
+#define M3D_SIN_P1				8.3321608736e-3f
+#define M3D_SIN_P2				-1.9515295891e-4f
+#define M3D_COS_P0				4.166664568298827e-2f
+#define M3D_COS_P1				-1.388731625493765e-3f
+#define M3D_COS_P2				2.443315711809948e-5f
+#define M3D_SIN_FAST_P0			-1.6666667e-1f
+#define M3D_SIN_FAST_P1			8.3333333e-3f
+#define M3D_COS_FAST_P0			4.1666667e-2f
+
+
+///////////////////////////////////////////////////////////////////////////////
+// One angle. Reduce to r in [-pi/4, pi/4] and quadrant k, evaluate both
+// polynomials, then swap and negate by quadrant.
+inline void m3dSinCos(float fAngle, float *pSin, float *pCos, M3D_SINCOS_ACCURACY accuracy = M3D_SINCOS_PRECISE)
+	{
+	// Nearest quadrant in the current rounding mode, as the SIMD conversion does
+	int k = int(lrintf(fAngle * M3D_SINCOS_2OPI));
+	float fk = float(k);
+
+	float r = fAngle - fk * M3D_SINCOS_PIO2_1;
+	r = r - fk * M3D_SINCOS_PIO2_2;
+	r = r - fk * M3D_SINCOS_PIO2_3;
+	float r2 = r * r;
+
+	float s, c;
+	if(accuracy == M3D_SINCOS_PRECISE) {
+		s = r + r * r2 * (M3D_SIN_P0 + r2 * (M3D_SIN_P1 + r2 * M3D_SIN_P2));
+		c = 1.0f - 0.5f * r2 + r2 * r2 * (M3D_COS_P0 + r2 * (M3D_COS_P1 + r2 * M3D_COS_P2));
+		}
+	else {
+		s = r + r * r2 * (M3D_SIN_FAST_P0 + r2 * M3D_SIN_FAST_P1);
+		c = 1.0f - 0.5f * r2 + r2 * r2 * M3D_COS_FAST_P0;
+		}
+
+	if(k & 1) {
+		float t = s;
+		s = c;
+		c = -t;
+		}
+	if(k & 2) {
+		s = -s;
+		c = -c;
+		}
+
+	*pSin = s;
+	*pCos = c;
+	}
+
+
+#if defined(M3D_SIMD_X86)
+///////////////////////////////////////////////////////////////////////////////
+// Four angles per iteration
+M3D_TARGET_SSE2 inline void m3dSSE2SinCos(__m128 a, __m128& sOut, __m128& cOut, M3D_SINCOS_ACCURACY accuracy)
+	{
+	__m128i k = _mm_cvtps_epi32(_mm_mul_ps(a, _mm_set1_ps(M3D_SINCOS_2OPI)));
+	__m128 fk = _mm_cvtepi32_ps(k);
+
+	__m128 r = _mm_sub_ps(a, _mm_mul_ps(fk, _mm_set1_ps(M3D_SINCOS_PIO2_1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fk, _mm_set1_ps(M3D_SINCOS_PIO2_2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fk, _mm_set1_ps(M3D_SINCOS_PIO2_3)));
+	__m128 r2 = _mm_mul_ps(r, r);
+	__m128 r3 = _mm_mul_ps(r, r2);
+	__m128 r4 = _mm_mul_ps(r2, r2);
+
+	__m128 ps, pc;
+	if(accuracy == M3D_SINCOS_PRECISE) {
+		ps = _mm_add_ps(_mm_set1_ps(M3D_SIN_P1), _mm_mul_ps(r2, _mm_set1_ps(M3D_SIN_P2)));
+		ps = _mm_add_ps(_mm_set1_ps(M3D_SIN_P0), _mm_mul_ps(r2, ps));
+		pc = _mm_add_ps(_mm_set1_ps(M3D_COS_P1), _mm_mul_ps(r2, _mm_set1_ps(M3D_COS_P2)));
+		pc = _mm_add_ps(_mm_set1_ps(M3D_COS_P0), _mm_mul_ps(r2, pc));
+		}
+	else {
+		ps = _mm_add_ps(_mm_set1_ps(M3D_SIN_FAST_P0), _mm_mul_ps(r2, _mm_set1_ps(M3D_SIN_FAST_P1)));
+		pc = _mm_set1_ps(M3D_COS_FAST_P0);
+		}
+
+	__m128 s = _mm_add_ps(r, _mm_mul_ps(r3, ps));
+	__m128 c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(r4, pc));
+
+	// Odd quadrants swap sine and cosine (negating the new cosine), quadrants
+	// 2 and 3 negate both
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(k, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 negS = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(k, _mm_set1_epi32(2)), 30));
+	__m128 negC = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(k, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+	__m128 sw = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+	__m128 cw = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+	sOut = _mm_xor_ps(sw, negS);
+	cOut = _mm_xor_ps(cw, negC);
+	}
+
+M3D_TARGET_SSE2 inline int m3dSSE2SinCosv(float *pSin, float *pCos, const float *pAngles, int nCount, M3D_SINCOS_ACCURACY accuracy)
+	{
+	int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 s, c;
+		m3dSSE2SinCos(_mm_loadu_ps(pAngles + i), s, c, accuracy);
+		_mm_storeu_ps(pSin + i, s);
+		_mm_storeu_ps(pCos + i, c);
+		}
+	return i;
+	}
+
+M3D_TARGET_AVX2 inline int m3dAVX2SinCosv(float *pSin, float *pCos, const float *pAngles, int nCount, M3D_SINCOS_ACCURACY accuracy)
+	{
+	const __m256 pio2_1 = _mm256_set1_ps(M3D_SINCOS_PIO2_1);
+	const __m256 pio2_2 = _mm256_set1_ps(M3D_SINCOS_PIO2_2);
+	const __m256 pio2_3 = _mm256_set1_ps(M3D_SINCOS_PIO2_3);
+	const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+	const bool bPrecise = (accuracy == M3D_SINCOS_PRECISE);
+	const __m256 s0 = _mm256_set1_ps(bPrecise ? M3D_SIN_P0 : M3D_SIN_FAST_P0);
+	const __m256 s1 = _mm256_set1_ps(bPrecise ? M3D_SIN_P1 : M3D_SIN_FAST_P1);
+	const __m256 s2 = _mm256_set1_ps(M3D_SIN_P2);
+	const __m256 c0 = _mm256_set1_ps(bPrecise ? M3D_COS_P0 : M3D_COS_FAST_P0);
+	const __m256 c1 = _mm256_set1_ps(M3D_COS_P1);
+	const __m256 c2 = _mm256_set1_ps(M3D_COS_P2);
+
+	int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 a = _mm256_loadu_ps(pAngles + i);
+		__m256i k = _mm256_cvtps_epi32(_mm256_mul_ps(a, _mm256_set1_ps(M3D_SINCOS_2OPI)));
+		__m256 fk = _mm256_cvtepi32_ps(k);
+
+		__m256 r = _mm256_sub_ps(a, _mm256_mul_ps(fk, pio2_1));
+		r = _mm256_sub_ps(r, _mm256_mul_ps(fk, pio2_2));
+		r = _mm256_sub_ps(r, _mm256_mul_ps(fk, pio2_3));
+		__m256 r2 = _mm256_mul_ps(r, r);
+		__m256 r3 = _mm256_mul_ps(r, r2);
+		__m256 r4 = _mm256_mul_ps(r2, r2);
+
+		__m256 ps, pc;
+		if(bPrecise) {
+			ps = _mm256_add_ps(s0, _mm256_mul_ps(r2, _mm256_add_ps(s1, _mm256_mul_ps(r2, s2))));
+			pc = _mm256_add_ps(c0, _mm256_mul_ps(r2, _mm256_add_ps(c1, _mm256_mul_ps(r2, c2))));
+			}
+		else {
+			ps = _mm256_add_ps(s0, _mm256_mul_ps(r2, s1));
+			pc = c0;
+			}
+
+		__m256 s = _mm256_add_ps(r, _mm256_mul_ps(r3, ps));
+		__m256 c = _mm256_add_ps(_mm256_sub_ps(one, _mm256_mul_ps(half, r2)), _mm256_mul_ps(r4, pc));
+
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(k, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+		__m256 negS = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(k, _mm256_set1_epi32(2)), 30));
+		__m256 negC = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(k, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+
+		_mm256_storeu_ps(pSin + i, _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), negS));
+		_mm256_storeu_ps(pCos + i, _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), negC));
+		}
+	return i;
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Sine and cosine of nCount angles (radians). Either output may be pAngles.
+inline void m3dSinCosv(float *pSin, float *pCos, const float *pAngles, int nCount,
+					   M3D_SINCOS_ACCURACY accuracy = M3D_SINCOS_PRECISE)
+	{
+	int i = 0;
+#if defined(M3D_SIMD_X86)
+	M3D_SIMD_LEVEL level = m3dSIMDGetLevel();
+	if(level >= M3D_SIMD_AVX2)
+		i = m3dAVX2SinCosv(pSin, pCos, pAngles, nCount, accuracy);
+
+	if(level >= M3D_SIMD_SSE2)
+		i += m3dSSE2SinCosv(pSin + i, pCos + i, pAngles + i, nCount - i, accuracy);
+#endif
+	for(; i < nCount; i++) {
+		float fAngle = pAngles[i];
+		m3dSinCos(fAngle, pSin + i, pCos + i, accuracy);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Rotation matrix from a precomputed sine and cosine. Same layout and
+// arithmetic as m3dRotationMatrix44, axis need not be unit length.
+inline void m3dRotationMatrix44SinCos(M3DMatrix44f m, float s, float c, const float *pAxis)
+	{
+	float x = pAxis[0], y = pAxis[1], z = pAxis[2];
+	float mag = float(sqrt(x * x + y * y + z * z));
+
+	if(mag == 0.0f) {
+		m3dLoadIdentity44(m);
+		return;
+		}
+
+	x /= mag;
+	y /= mag;
+	z /= mag;
+
+	float xx = x * x, yy = y * y, zz = z * z;
+	float xy = x * y, yz = y * z, zx = z * x;
+	float xs = x * s, ys = y * s, zs = z * s;
+	float one_c = 1.0f - c;
+
+	m[0] = (one_c * xx) + c;
+	m[1] = (one_c * xy) + zs;
+	m[2] = (one_c * zx) - ys;
+	m[3] = 0.0f;
+
+	m[4] = (one_c * xy) - zs;
+	m[5] = (one_c * yy) + c;
+	m[6] = (one_c * yz) + xs;
+	m[7] = 0.0f;
+
+	m[8] = (one_c * zx) + ys;
+	m[9] = (one_c * yz) - xs;
+	m[10] = (one_c * zz) + c;
+	m[11] = 0.0f;
+
+	m[12] = 0.0f;
+	m[13] = 0.0f;
+	m[14] = 0.0f;
+	m[15] = 1.0f;
+	}
+
+// nCount rotation matrices, pOut[i] is pAngles[i] radians around pAxes[i].
+// Sine and cosine are done in blocks through m3dSinCosv.
+inline void m3dRotationMatrices44(M3DMatrix44f *pOut, const float *pAngles, const M3DVector3f *pAxes, int nCount,
+								  M3D_SINCOS_ACCURACY accuracy = M3D_SINCOS_PRECISE)
+	{
+	const int nBlock = 64;
+	float fSin[nBlock], fCos[nBlock];
+
+	for(int i = 0; i < nCount; i += nBlock) {
+		int n = (nCount - i < nBlock) ? nCount - i : nBlock;
+		m3dSinCosv(fSin, fCos, pAngles + i, n, accuracy);
+		for(int j = 0; j < n; j++)
+			m3dRotationMatrix44SinCos(pOut[i + j], fSin[j], fCos[j], pAxes[i + j]);
+		}
+	}
+
+// The common case of everything spinning around the same axis
+inline void m3dRotationMatrices44(M3DMatrix44f *pOut, const float *pAngles, int nCount, float x, float y, float z,
+								  M3D_SINCOS_ACCURACY accuracy = M3D_SINCOS_PRECISE)
+	{
+	const int nBlock = 64;
+	float fSin[nBlock], fCos[nBlock];
+	M3DVector3f vAxis = { x, y, z };
+
+	for(int i = 0; i < nCount; i += nBlock) {
+		int n = (nCount - i < nBlock) ? nCount - i : nBlock;
+		m3dSinCosv(fSin, fCos, pAngles + i, n, accuracy);
+		for(int j = 0; j < n; j++)
+			m3dRotationMatrix44SinCos(pOut[i + j], fSin[j], fCos[j], vAxis);
+		}
+	}
+
+#endif
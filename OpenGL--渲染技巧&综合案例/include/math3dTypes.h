@@ -0,0 +1,371 @@
+// math3dTypes.h
+// Templated vector and matrix types layered over the math3d arrays.
+//
+// M3DVec3<T> and M3DMat4<T> have exactly the layout of M3DVector3f/d and
+// M3DMatrix44f/d (column major, OpenGL style), convert to them implicitly, and
+// can be used in constant expressions.
+//
+// The interesting part is how transforms are applied. Translating, scaling or
+// rotating a matrix only changes some of its columns, so instead of building
+// a full 4x4 for the transform and doing a 64 multiply product (plus copies of
+// the destination), each transform is a small expression object that updates
+// the destination in place:
+//
+//		M3DMat4Ref<float> top(pStack[i]);
+//		top *= M3DTranslate<float>(x, y, z);							// 12 multiplies
+//		top *= M3DRotate<float>(fAngle, 0, 1, 0) * M3DScale<float>(s, s, s);	// 36 + 12
+//
+// Chained transforms are not combined into a matrix first, each one is applied
+// to the destination in turn: M * (A * B) == (M * A) * B. Results are bit
+// identical to multiplying by the equivalent m3dTranslationMatrix44 etc. with
+// m3dMatrixMultiply44 (for finite values).
+//
+// Every expression also knows its M3D_MATRIX_KIND, so a caller keeping track
+// of what its matrices are (GLMatrixStack) can pick the cheapest product.
+
+#ifndef _MATH3D_TYPES__
+#define _MATH3D_TYPES__
+
+#include "math3d.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Three component vector
+template <typename T>
+struct M3DVec3
+	{
+	T v[3];
+
+	constexpr M3DVec3(void) : v{ T(0), T(0), T(0) } {}
+	constexpr M3DVec3(T x, T y, T z) : v{ x, y, z } {}
+	explicit M3DVec3(const T *p) : v{ p[0], p[1], p[2] } {}
+
+	constexpr T operator[](int i) const { return v[i]; }
+	constexpr T& operator[](int i) { return v[i]; }
+
+	// Pass straight to anything taking an M3DVector3f/d
+	operator T *(void) { return v; }
+	operator const T *(void) const { return v; }
+
+	constexpr M3DVec3& operator+=(const M3DVec3& b) { v[0] += b.v[0]; v[1] += b.v[1]; v[2] += b.v[2]; return *this; }
+	constexpr M3DVec3& operator-=(const M3DVec3& b) { v[0] -= b.v[0]; v[1] -= b.v[1]; v[2] -= b.v[2]; return *this; }
+	constexpr M3DVec3& operator*=(T s) { v[0] *= s; v[1] *= s; v[2] *= s; return *this; }
+	};
+
+template <typename T>
+constexpr M3DVec3<T> operator+(M3DVec3<T> a, const M3DVec3<T>& b) { return a += b; }
+
+template <typename T>
+constexpr M3DVec3<T> operator-(M3DVec3<T> a, const M3DVec3<T>& b) { return a -= b; }
+
+template <typename T>
+constexpr M3DVec3<T> operator*(M3DVec3<T> a, T s) { return a *= s; }
+
+template <typename T>
+constexpr T m3dDot(const M3DVec3<T>& a, const M3DVec3<T>& b)
+	{ return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2]; }
+
+// Same operation order as m3dCrossProduct3
+template <typename T>
+constexpr M3DVec3<T> m3dCross(const M3DVec3<T>& u, const M3DVec3<T>& v)
+	{
+	return M3DVec3<T>(u.v[1] * v.v[2] - v.v[1] * u.v[2],
+					  -u.v[0] * v.v[2] + v.v[0] * u.v[2],
+					  u.v[0] * v.v[1] - v.v[0] * u.v[1]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Matrix kinds, from the least general to the most. The product of two
+// matrices is (at most) the more general of the two kinds.
+//
+//	M3D_MATRIX_IDENTITY		The identity
+//	M3D_MATRIX_TRANSLATION	Identity 3x3, any translation
+//	M3D_MATRIX_RIGID		Rotation (orthonormal 3x3) and translation
+//	M3D_MATRIX_AFFINE		Any 3x3 and translation, bottom row (0, 0, 0, 1)
+//	M3D_MATRIX_PROJECTIVE	Anything
+enum M3D_MATRIX_KIND { M3D_MATRIX_IDENTITY = 0, M3D_MATRIX_TRANSLATION, M3D_MATRIX_RIGID,
+					   M3D_MATRIX_AFFINE, M3D_MATRIX_PROJECTIVE };
+
+constexpr M3D_MATRIX_KIND m3dCombineMatrixKinds(M3D_MATRIX_KIND a, M3D_MATRIX_KIND b)
+	{ return (a > b) ? a : b; }
+
+// Work out the kind of a column major 4x4. Rigid allows the 3x3 to be off
+// orthonormal by fTolerance, as rotations that have been built up over time
+// are; the other tests are exact. m3dClassifyMatrix44Quick leaves out the
+// orthonormal test and calls all rigid matrices affine, which is enough to
+// pick a multiply.
+template <typename T>
+inline M3D_MATRIX_KIND m3dClassifyMatrix44Quick(const T *m)
+	{
+	if(m[3] != T(0) || m[7] != T(0) || m[11] != T(0) || m[15] != T(1))
+		return M3D_MATRIX_PROJECTIVE;
+
+	if(m[0] == T(1) && m[1] == T(0) && m[2] == T(0) &&
+	   m[4] == T(0) && m[5] == T(1) && m[6] == T(0) &&
+	   m[8] == T(0) && m[9] == T(0) && m[10] == T(1))
+		return (m[12] == T(0) && m[13] == T(0) && m[14] == T(0)) ? M3D_MATRIX_IDENTITY : M3D_MATRIX_TRANSLATION;
+
+	return M3D_MATRIX_AFFINE;
+	}
+
+// Whether the 3x3 whose columns start at m, m + stride and m + 2 * stride is
+// orthonormal to within fTolerance
+template <typename T>
+constexpr bool m3dIsOrthonormal33(const T *m, int stride, T fTolerance)
+	{
+	const T *c0 = m, *c1 = m + stride, *c2 = m + 2 * stride;
+	T d[6] = { c0[0] * c0[0] + c0[1] * c0[1] + c0[2] * c0[2] - T(1),
+			   c1[0] * c1[0] + c1[1] * c1[1] + c1[2] * c1[2] - T(1),
+			   c2[0] * c2[0] + c2[1] * c2[1] + c2[2] * c2[2] - T(1),
+			   c0[0] * c1[0] + c0[1] * c1[1] + c0[2] * c1[2],
+			   c0[0] * c2[0] + c0[1] * c2[1] + c0[2] * c2[2],
+			   c1[0] * c2[0] + c1[1] * c2[1] + c1[2] * c2[2] };
+
+	// Written out rather than with fabs so it can be constexpr
+	for(int i = 0; i < 6; i++)
+		if(!(d[i] <= fTolerance && -d[i] <= fTolerance))
+			return false;
+	return true;
+	}
+
+template <typename T>
+inline M3D_MATRIX_KIND m3dClassifyMatrix44(const T *m, T fTolerance = T(1e-5))
+	{
+	M3D_MATRIX_KIND kind = m3dClassifyMatrix44Quick(m);
+	if(kind != M3D_MATRIX_AFFINE)
+		return kind;
+
+	return m3dIsOrthonormal33(m, 4, fTolerance) ? M3D_MATRIX_RIGID : M3D_MATRIX_AFFINE;
+	}
+
+// m = a * b for affine (or more special) a and b: the 3x3 product plus a
+// translation, 36 multiplies instead of 64. The sums run in the same order as
+// the general product, so the result is the same. m may be a or b. With SSE2
+// m3dSIMDMatrixMultiply44 is still quicker; this is for the scalar build.
+template <typename T>
+inline void m3dMultiplyAffine44(T *m, const T *a, const T *b)
+	{
+	// Everything is read before anything is written, which takes care of
+	// m being a or b without going through a temporary
+	const T a0 = a[0], a1 = a[1], a2 = a[2], a4 = a[4], a5 = a[5], a6 = a[6];
+	const T a8 = a[8], a9 = a[9], a10 = a[10], a12 = a[12], a13 = a[13], a14 = a[14];
+	const T b0 = b[0], b1 = b[1], b2 = b[2], b4 = b[4], b5 = b[5], b6 = b[6];
+	const T b8 = b[8], b9 = b[9], b10 = b[10], b12 = b[12], b13 = b[13], b14 = b[14];
+
+	m[0] = a0 * b0 + a4 * b1 + a8 * b2;
+	m[1] = a1 * b0 + a5 * b1 + a9 * b2;
+	m[2] = a2 * b0 + a6 * b1 + a10 * b2;
+	m[3] = T(0);
+	m[4] = a0 * b4 + a4 * b5 + a8 * b6;
+	m[5] = a1 * b4 + a5 * b5 + a9 * b6;
+	m[6] = a2 * b4 + a6 * b5 + a10 * b6;
+	m[7] = T(0);
+	m[8] = a0 * b8 + a4 * b9 + a8 * b10;
+	m[9] = a1 * b8 + a5 * b9 + a9 * b10;
+	m[10] = a2 * b8 + a6 * b9 + a10 * b10;
+	m[11] = T(0);
+	m[12] = a0 * b12 + a4 * b13 + a8 * b14 + a12;
+	m[13] = a1 * b12 + a5 * b13 + a9 * b14 + a13;
+	m[14] = a2 * b12 + a6 * b13 + a10 * b14 + a14;
+	m[15] = T(1);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Transform expressions. Anything derived from M3DTransformExpr knows how to
+// right multiply itself into a column major 4x4 in place (m = m * this).
+template <typename E>
+struct M3DTransformExpr
+	{
+	constexpr const E& Derived(void) const { return static_cast<const E&>(*this); }
+	};
+
+// A * B, applied as A then B. The operands are small and held by value, so
+// a product can be kept (auto t = M3DTranslate... * M3DRotate...) after the
+// temporaries it was made from are gone.
+template <typename A, typename B>
+struct M3DTransformProduct : public M3DTransformExpr< M3DTransformProduct<A, B> >
+	{
+	A a;
+	B b;
+
+	constexpr M3DTransformProduct(const A& _a, const B& _b) : a(_a), b(_b) {}
+
+	template <typename T>
+	constexpr void MultiplyInto(T *m) const { a.MultiplyInto(m); b.MultiplyInto(m); }
+
+	constexpr M3D_MATRIX_KIND Kind(void) const { return m3dCombineMatrixKinds(a.Kind(), b.Kind()); }
+	};
+
+template <typename A, typename B>
+constexpr M3DTransformProduct<A, B> operator*(const M3DTransformExpr<A>& a, const M3DTransformExpr<B>& b)
+	{ return M3DTransformProduct<A, B>(a.Derived(), b.Derived()); }
+
+
+// Translation: only the fourth column changes
+template <typename T>
+struct M3DTranslate : public M3DTransformExpr< M3DTranslate<T> >
+	{
+	T x, y, z;
+
+	constexpr M3DTranslate(T _x, T _y, T _z) : x(_x), y(_y), z(_z) {}
+	explicit M3DTranslate(const T *v) : x(v[0]), y(v[1]), z(v[2]) {}
+
+	constexpr void MultiplyInto(T *m) const
+		{
+		for(int i = 0; i < 4; i++)
+			m[12 + i] = m[i] * x + m[4 + i] * y + m[8 + i] * z + m[12 + i];
+		}
+
+	constexpr M3D_MATRIX_KIND Kind(void) const { return M3D_MATRIX_TRANSLATION; }
+	};
+
+// Scale: the first three columns are scaled, nothing else changes
+template <typename T>
+struct M3DScale : public M3DTransformExpr< M3DScale<T> >
+	{
+	T x, y, z;
+
+	constexpr M3DScale(T _x, T _y, T _z) : x(_x), y(_y), z(_z) {}
+	explicit M3DScale(const T *v) : x(v[0]), y(v[1]), z(v[2]) {}
+
+	constexpr void MultiplyInto(T *m) const
+		{
+		for(int i = 0; i < 4; i++) {
+			m[i] *= x;
+			m[4 + i] *= y;
+			m[8 + i] *= z;
+			}
+		}
+
+	constexpr M3D_MATRIX_KIND Kind(void) const { return M3D_MATRIX_AFFINE; }
+	};
+
+// Rotation: the first three columns are replaced by combinations of
+// themselves. The 3x3 comes from m3dRotationMatrix33, so the angle is in
+// radians and the values match m3dRotationMatrix44 exactly.
+template <typename T>
+struct M3DRotate : public M3DTransformExpr< M3DRotate<T> >
+	{
+	T r[9];
+	M3D_MATRIX_KIND kind;
+
+	M3DRotate(T angle, T x, T y, T z) : kind(M3D_MATRIX_RIGID) { m3dRotationMatrix33(r, angle, x, y, z); }
+
+	// From an existing column major 3x3. Only rigid if it is orthonormal
+	// (as m3dClassifyMatrix44 decides); a scale or shear in it is affine.
+	constexpr explicit M3DRotate(const T (&m)[9]) : r{ m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8] },
+		kind(m3dIsOrthonormal33(m, 3, T(1e-5)) ? M3D_MATRIX_RIGID : M3D_MATRIX_AFFINE) {}
+
+	constexpr void MultiplyInto(T *m) const
+		{
+		for(int i = 0; i < 4; i++) {
+			T c0 = m[i], c1 = m[4 + i], c2 = m[8 + i];
+			m[i]     = c0 * r[0] + c1 * r[1] + c2 * r[2];
+			m[4 + i] = c0 * r[3] + c1 * r[4] + c2 * r[5];
+			m[8 + i] = c0 * r[6] + c1 * r[7] + c2 * r[8];
+			}
+		}
+
+	constexpr M3D_MATRIX_KIND Kind(void) const { return kind; }
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// General product, m = m * b. b may be m itself.
+template <typename T>
+constexpr void m3dMultiplyInto44(T *m, const T *b)
+	{
+	T c[16] = {};
+	for(int i = 0; i < 16; i++)
+		c[i] = b[i];
+
+	for(int i = 0; i < 4; i++) {
+		T a0 = m[i], a1 = m[4 + i], a2 = m[8 + i], a3 = m[12 + i];
+		for(int j = 0; j < 16; j += 4)
+			m[j + i] = a0 * c[j] + a1 * c[j + 1] + a2 * c[j + 2] + a3 * c[j + 3];
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 4x4 matrix with value semantics
+template <typename T>
+struct M3DMat4 : public M3DTransformExpr< M3DMat4<T> >
+	{
+	T m[16];
+
+	constexpr M3DMat4(void) : m{ T(1), T(0), T(0), T(0),  T(0), T(1), T(0), T(0),
+								 T(0), T(0), T(1), T(0),  T(0), T(0), T(0), T(1) } {}
+
+	explicit M3DMat4(const T *p) { for(int i = 0; i < 16; i++) m[i] = p[i]; }
+
+	template <typename E>
+	constexpr M3DMat4(const M3DTransformExpr<E>& e) : M3DMat4() { e.Derived().MultiplyInto(m); }
+
+	static constexpr M3DMat4 Identity(void) { return M3DMat4(); }
+
+	constexpr T operator()(int row, int col) const { return m[col * 4 + row]; }
+	constexpr T& operator()(int row, int col) { return m[col * 4 + row]; }
+
+	// Pass straight to anything taking an M3DMatrix44f/d
+	operator T *(void) { return m; }
+	operator const T *(void) const { return m; }
+
+	template <typename E>
+	constexpr M3DMat4& operator*=(const M3DTransformExpr<E>& e) { e.Derived().MultiplyInto(m); return *this; }
+
+	constexpr void MultiplyInto(T *dst) const { m3dMultiplyInto44(dst, m); }
+
+	M3D_MATRIX_KIND Kind(void) const { return m3dClassifyMatrix44(m); }
+	};
+
+template <typename T, typename E>
+constexpr M3DMat4<T> operator*(M3DMat4<T> a, const M3DTransformExpr<E>& e) { return a *= e; }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// A view over an existing M3DMatrix44f/d (a matrix stack entry, for example).
+// Transforms applied through it land directly in the viewed array.
+template <typename T>
+class M3DMat4Ref : public M3DTransformExpr< M3DMat4Ref<T> >
+	{
+	public:
+		explicit M3DMat4Ref(T *pMatrix) : m(pMatrix) {}
+
+		T operator()(int row, int col) const { return m[col * 4 + row]; }
+		T& operator()(int row, int col) { return m[col * 4 + row]; }
+
+		operator T *(void) const { return m; }
+
+		template <typename E>
+		M3DMat4Ref& operator*=(const M3DTransformExpr<E>& e) { e.Derived().MultiplyInto(m); return *this; }
+
+		// m = e, evaluated straight into the viewed matrix
+		template <typename E>
+		M3DMat4Ref& operator=(const M3DTransformExpr<E>& e)
+			{
+			m3dLoadIdentity44(m);
+			e.Derived().MultiplyInto(m);
+			return *this;
+			}
+
+		M3DMat4Ref& operator=(const M3DMat4Ref& r) { m3dCopyMatrix44(m, r.m); return *this; }
+
+		void MultiplyInto(T *dst) const { m3dMultiplyInto44(dst, m); }
+
+		M3D_MATRIX_KIND Kind(void) const { return m3dClassifyMatrix44(m); }
+
+	protected:
+		T *m;
+	};
+
+typedef M3DVec3<float>		M3DVec3f;
+typedef M3DVec3<double>		M3DVec3d;
+typedef M3DMat4<float>		M3DMat4f;
+typedef M3DMat4<double>		M3DMat4d;
+typedef M3DMat4Ref<float>	M3DMat4Reff;
+typedef M3DMat4Ref<double>	M3DMat4Refd;
+
+#endif